@@ -38,7 +38,7 @@ int main(int argc, char **argv)
     graph_atl_add(3);
     graph_atl_add(3);
 
-    struct Shader *shader = shader_alloc("shaders/vert.grsl", "shaders/frag.grsl");
+    struct Shader *shader = shader_alloc_ex("shaders/vert.grsl", "shaders/frag.grsl", SHADER_JIT);
     graph_use_shader(shader);
 
     while (running)
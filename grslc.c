@@ -0,0 +1,53 @@
+#include "shader.h"
+#include "shaderlang/cgen.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+int main(int argc, char **argv)
+{
+    int flags = 0;
+
+    if (argc == 5 && strcmp(argv[1], "-ffast-math") == 0)
+    {
+        flags |= COMPILER_FAST_MATH;
+        ++argv;
+        --argc;
+    }
+
+    if (argc != 4)
+    {
+        fprintf(stderr, "Usage: %s [-ffast-math] VERT FRAG OUT.c\n"
+                "Build OUT.c with: cc -O2 -shared -fPIC -Isrc OUT.c -o OUT.so -lm\n"
+                "Load the result with shader_load.\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    struct Arena *arena = arena_alloc();
+
+    // Same passes as shaders compiled at runtime
+    struct Node *root_vert = shader_parse_stage(arena, parser_alloc(argv[1], arena));
+    struct Node *root_frag = shader_parse_stage(arena, parser_alloc(argv[2], arena));
+    hoist_stages(arena, root_vert, root_frag);
+
+    struct Program *vert = compiler_compile(root_vert, flags);
+    struct Program *frag = compiler_compile(root_frag, flags);
+
+    FILE *out = fopen(argv[3], "w");
+
+    if (!out)
+    {
+        fprintf(stderr, "Error: Unable to open file '%s'.\n", argv[3]);
+        return EXIT_FAILURE;
+    }
+
+    cgen_module(out, vert, frag);
+    fclose(out);
+
+    program_free(vert);
+    program_free(frag);
+    arena_free(arena);
+
+    return 0;
+}
@@ -10,6 +10,7 @@ struct Buffer *graph_gen_buffer()
     struct Buffer *b = malloc(sizeof(struct Buffer));
     b->data = 0;
     b->data_len = 0;
+    b->depth_prepass = false;
 
     return b;
 }
@@ -36,6 +37,12 @@ void graph_buffer_data(size_t size, float *data)
 }
 
 
+void graph_buffer_depth_prepass(bool enable)
+{
+    g_buffer->depth_prepass = enable;
+}
+
+
 struct Buffer *graph_buffer_bound()
 {
     return g_buffer;
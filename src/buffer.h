@@ -2,11 +2,15 @@
 #define LIBGRAPH_BUFFER_H
 
 #include <sys/types.h>
+#include <stdbool.h>
 
 struct Buffer
 {
     float *data;
     size_t data_len;
+
+    // Draws write depth for every triangle before shading any
+    bool depth_prepass;
 };
 
 struct Buffer *graph_gen_buffer();
@@ -14,6 +18,10 @@ void graph_delete_buffer(struct Buffer *b);
 
 void graph_bind_buffer(struct Buffer *b);
 void graph_buffer_data(size_t size, float *data);
+// Whether draws of the bound buffer run a depth-only pass over each tile
+// first, which shades every visible pixel once at the cost of rasterizing
+// twice. Ignored for shaders that need late depth testing.
+void graph_buffer_depth_prepass(bool enable);
 
 struct Buffer *graph_buffer_bound();
 
@@ -0,0 +1,472 @@
+#include "reload.h"
+#include "shader.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/wait.h>
+
+
+struct Reloader *reload_alloc(struct Shader *s)
+{
+    struct Reloader *r = malloc(sizeof(struct Reloader));
+    r->s = s;
+    r->arena = 0;
+    r->tree_arena = 0;
+
+    r->variants = 0;
+    r->nvariants = 0;
+    r->ready = false;
+
+    r->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+    if (r->inotify == -1 || pipe(r->wake) == -1)
+    {
+        fprintf(stderr, "[reload_alloc] Error: Unable to watch shader sources.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    r->wd_vert = reload_watch_dir(r, s->path_vert, &r->name_vert);
+    r->wd_frag = reload_watch_dir(r, s->path_frag, &r->name_frag);
+
+    // The running programs were compiled from the sources as they are now
+    r->hash_vert = 0;
+    r->hash_frag = 0;
+
+    size_t len;
+    char *src = reload_read_file(s->path_vert, &len);
+
+    if (src)
+        r->hash_vert = cache_hash(CACHE_HASH_BASIS, src, len);
+
+    free(src);
+    src = reload_read_file(s->path_frag, &len);
+
+    if (src)
+        r->hash_frag = cache_hash(CACHE_HASH_BASIS, src, len);
+
+    free(src);
+
+    if (pthread_create(&r->thread, 0, reload_thread, r) != 0)
+    {
+        fprintf(stderr, "[reload_alloc] Error: Unable to start the reload thread.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    return r;
+}
+
+
+void reload_free(struct Reloader *r)
+{
+    write(r->wake[1], "", 1);
+    pthread_join(r->thread, 0);
+
+    close(r->wake[0]);
+    close(r->wake[1]);
+    close(r->inotify);
+
+    reload_drop(r);
+
+    if (r->arena)
+        arena_free(r->arena);
+
+    free(r->name_vert);
+    free(r->name_frag);
+    free(r);
+}
+
+
+void *reload_thread(void *arg)
+{
+    struct Reloader *r = arg;
+    struct pollfd fds[] = { { r->inotify, POLLIN, 0 }, { r->wake[0], POLLIN, 0 } };
+
+    while (poll(fds, 2, -1) != -1 || errno == EINTR)
+    {
+        if (fds[1].revents) break;
+        if (!fds[0].revents) continue;
+
+        bool changed = reload_drain(r);
+
+        // Until the editor is done writing
+        while (poll(fds, 2, RELOAD_SETTLE_MS) > 0 && !fds[1].revents)
+            changed |= reload_drain(r);
+
+        if (fds[1].revents) break;
+
+        if (changed)
+            reload_check(r);
+    }
+
+    return 0;
+}
+
+
+bool reload_drain(struct Reloader *r)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    ssize_t len;
+
+    while ((len = read(r->inotify, buf, sizeof(buf))) > 0)
+    {
+        for (char *at = buf; at < buf + len; at += sizeof(struct inotify_event) + ((struct inotify_event*)at)->len)
+        {
+            struct inotify_event *ev = (struct inotify_event*)at;
+            if (!ev->len) continue;
+
+            if ((ev->wd == r->wd_vert && strcmp(ev->name, r->name_vert) == 0) ||
+                (ev->wd == r->wd_frag && strcmp(ev->name, r->name_frag) == 0))
+                changed = true;
+        }
+    }
+
+    return changed;
+}
+
+
+void reload_check(struct Reloader *r)
+{
+    struct ReloadSources src;
+    src.vert = reload_read_file(r->s->path_vert, &src.vert_len);
+    src.frag = reload_read_file(r->s->path_frag, &src.frag_len);
+
+    // Half written or briefly missing, the next event retries
+    if (!src.vert || !src.frag)
+    {
+        free(src.vert);
+        free(src.frag);
+        return;
+    }
+
+    src.hash_vert = cache_hash(CACHE_HASH_BASIS, src.vert, src.vert_len);
+    src.hash_frag = cache_hash(CACHE_HASH_BASIS, src.frag, src.frag_len);
+
+    if (src.hash_vert != r->hash_vert || src.hash_frag != r->hash_frag)
+    {
+        char *buf = 0;
+        size_t len = 0;
+
+        if (reload_compile(r, &src, &buf, &len) && reload_finish(r, &src, buf, len))
+        {
+            r->hash_vert = src.hash_vert;
+            r->hash_frag = src.hash_frag;
+        }
+        else
+        {
+            fprintf(stderr, "[reload_check] Error: '%s' and '%s' failed to compile, keeping the running "
+                    "programs.\n", r->s->path_vert, r->s->path_frag);
+        }
+
+        free(buf);
+    }
+
+    free(src.vert);
+    free(src.frag);
+}
+
+
+bool reload_compile(struct Reloader *r, struct ReloadSources *src, char **buf, size_t *len)
+{
+    int fds[2];
+    if (pipe(fds) == -1) return false;
+
+    // Buffered output would be written by both processes
+    fflush(0);
+
+    // The child sees specs, variants and trees as of the fork
+    pthread_mutex_lock(&r->s->lock);
+    pid_t pid = fork();
+
+    if (pid == 0)
+    {
+        close(fds[0]);
+        reload_child(r, src, fds[1]);
+        _exit(EXIT_SUCCESS);
+    }
+
+    pthread_mutex_unlock(&r->s->lock);
+    close(fds[1]);
+
+    if (pid == -1)
+    {
+        close(fds[0]);
+        return false;
+    }
+
+    size_t cap = 4096;
+    *buf = malloc(cap);
+    *len = 0;
+
+    ssize_t n;
+
+    while ((n = read(fds[0], *buf + *len, cap - *len)) > 0 || (n == -1 && errno == EINTR))
+    {
+        if (n > 0 && (*len += n) == cap)
+            *buf = realloc(*buf, cap *= 2);
+    }
+
+    close(fds[0]);
+
+    int status;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR);
+
+    // Errors exit the child, its message is already on stderr
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+
+void reload_child(struct Reloader *r, struct ReloadSources *src, int fd)
+{
+    struct Shader *s = r->s;
+
+    // Compile errors exit, which would run the host's atexit handlers and
+    // tear down stdio that other threads may have held locked at the fork.
+    // Handlers run last registered first, so this one goes before them.
+    atexit(reload_child_exit);
+
+    // Other threads may have been allocating from the shared arena
+    s->arena = arena_alloc();
+
+    // Unchanged stages skip parsing, checking and inlining
+    struct Node *vert = s->spec_vert;
+    struct Node *frag = s->spec_frag;
+
+    if (src->hash_vert != r->hash_vert)
+        vert = shader_parse_stage(s->arena, parser_alloc_source(src->vert, src->vert_len, s->arena));
+
+    if (src->hash_frag != r->hash_frag)
+        frag = shader_parse_stage(s->arena, parser_alloc_source(src->frag, src->frag_len, s->arena));
+
+    FILE *fp = fdopen(fd, "wb");
+
+    uint64_t header[] = { s->nvariants, s->nspec_values };
+    fwrite(header, sizeof(header), 1, fp);
+
+    for (size_t i = 0; i < s->nvariants; ++i)
+    {
+        float *values = s->variants[i]->values;
+
+        if (values)
+            fwrite(values, sizeof(float), s->nspec_values, fp);
+
+        struct Program *prog_vert, *prog_frag;
+        shader_compile_stages(s, vert, frag, values, &prog_vert, &prog_frag);
+
+        cache_write_program(fp, prog_vert);
+        cache_write_program(fp, prog_frag);
+    }
+
+    if (fclose(fp) != 0)
+        _exit(EXIT_FAILURE);
+}
+
+
+void reload_child_exit()
+{
+    // Successful children never call exit
+    _exit(EXIT_FAILURE);
+}
+
+
+bool reload_finish(struct Reloader *r, struct ReloadSources *src, const char *buf, size_t len)
+{
+    struct Shader *s = r->s;
+    struct CacheReader rd = { buf, len, 0 };
+    uint64_t header[2];
+
+    if (!cache_read(&rd, header, sizeof(header)) || !header[0])
+        return false;
+
+    struct ShaderVariant **variants = calloc(header[0], sizeof(struct ShaderVariant*));
+    size_t n = 0;
+    bool ok = true;
+
+    for (; ok && n < header[0]; ++n)
+    {
+        // Only the generic variant comes without values
+        float *values = n ? cache_read_array(&rd, header[1], sizeof(float)) : 0;
+        struct Program *prog_vert = cache_read_program(&rd);
+        struct Program *prog_frag = prog_vert ? cache_read_program(&rd) : 0;
+
+        ok = (values || !n) && prog_frag;
+
+        if (!ok)
+        {
+            free(values);
+            if (prog_vert) program_free(prog_vert);
+            break;
+        }
+
+        variants[n] = variant_alloc(s, prog_vert, prog_frag);
+        variants[n]->values = values;
+    }
+
+    if (!ok)
+    {
+        for (size_t i = 0; i < n; ++i)
+            variant_free(variants[i]);
+
+        free(variants);
+        return false;
+    }
+
+    // Same sources the child compiled, so these parse without errors. Both
+    // stages go into a fresh arena, so the previous one can be freed once
+    // these trees replace its own.
+    struct Arena *arena = arena_alloc();
+    struct Node *vert = shader_parse_stage(arena, parser_alloc_source(src->vert, src->vert_len, arena));
+    struct Node *frag = shader_parse_stage(arena, parser_alloc_source(src->frag, src->frag_len, arena));
+
+    int cflags = s->flags & SHADER_FAST_MATH ? COMPILER_FAST_MATH : 0;
+
+    pthread_mutex_lock(&s->lock);
+
+    // Replaces a reload that never got applied
+    reload_drop(r);
+
+    r->variants = variants;
+    r->nvariants = n;
+    r->nspec_values = header[1];
+    r->tree_vert = vert;
+    r->tree_frag = frag;
+    r->tree_arena = arena;
+    r->key = cache_key_sources(src->vert, src->vert_len, src->frag, src->frag_len, cflags);
+    __atomic_store_n(&r->ready, true, __ATOMIC_RELEASE);
+
+    pthread_mutex_unlock(&s->lock);
+
+    return true;
+}
+
+
+void reload_apply(struct Reloader *r)
+{
+    if (!__atomic_load_n(&r->ready, __ATOMIC_ACQUIRE)) return;
+
+    struct Shader *s = r->s;
+    pthread_mutex_lock(&s->lock);
+
+    // Specialized by values the reload didn't have, the next change
+    // reloads again
+    if (r->nspec_values != s->nspec_values)
+    {
+        reload_drop(r);
+        pthread_mutex_unlock(&s->lock);
+        return;
+    }
+
+    struct ShaderVariant **old = s->variants;
+    size_t nold = s->nvariants;
+
+    // Variants compiled since the reload started are compiled again when
+    // next needed
+    struct ShaderVariant *active = r->variants[0];
+
+    for (size_t i = 1; s->active->values && i < r->nvariants; ++i)
+    {
+        if (memcmp(r->variants[i]->values, s->active->values, sizeof(float) * s->nspec_values) == 0)
+            active = r->variants[i];
+    }
+
+    s->variants = r->variants;
+    s->nvariants = r->nvariants;
+    s->active = active;
+
+    s->spec_vert = r->tree_vert;
+    s->spec_frag = r->tree_frag;
+    s->key = r->key;
+
+    // Only the previous reload's trees were in it
+    struct Arena *old_arena = r->arena;
+    r->arena = r->tree_arena;
+
+    r->variants = 0;
+    r->nvariants = 0;
+    r->tree_arena = 0;
+    r->ready = false;
+
+    pthread_mutex_unlock(&s->lock);
+
+    if (old_arena)
+        arena_free(old_arena);
+
+    for (size_t i = 0; i < nold; ++i)
+        variant_free(old[i]);
+
+    free(old);
+    shader_resolve_inputs(s);
+}
+
+
+void reload_drop(struct Reloader *r)
+{
+    for (size_t i = 0; i < r->nvariants; ++i)
+        variant_free(r->variants[i]);
+
+    free(r->variants);
+
+    if (r->tree_arena)
+        arena_free(r->tree_arena);
+
+    r->variants = 0;
+    r->nvariants = 0;
+    r->tree_arena = 0;
+    r->ready = false;
+}
+
+
+char *reload_read_file(const char *path, size_t *len)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp) return 0;
+
+    size_t cap = 4096;
+    char *buf = malloc(cap);
+    *len = 0;
+
+    size_t n;
+
+    while ((n = fread(buf + *len, 1, cap - *len, fp)) > 0)
+    {
+        if ((*len += n) == cap)
+            buf = realloc(buf, cap *= 2);
+    }
+
+    bool ok = !ferror(fp);
+    fclose(fp);
+
+    if (!ok)
+    {
+        free(buf);
+        return 0;
+    }
+
+    return buf;
+}
+
+
+int reload_watch_dir(struct Reloader *r, const char *path, char **name)
+{
+    const char *slash = strrchr(path, '/');
+    char *dir = slash ? strndup(path, slash - path + 1) : strdup(".");
+    *name = strdup(slash ? slash + 1 : path);
+
+    // Editors that save by renaming a new file over the old one only
+    // trigger IN_MOVED_TO
+    int wd = inotify_add_watch(r->inotify, dir, IN_CLOSE_WRITE | IN_MOVED_TO);
+
+    if (wd == -1)
+    {
+        fprintf(stderr, "[reload_watch_dir] Error: Unable to watch '%s'.\n", dir);
+        exit(EXIT_FAILURE);
+    }
+
+    free(dir);
+    return wd;
+}
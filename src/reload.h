@@ -0,0 +1,92 @@
+#ifndef LIBGRAPH_RELOAD_H
+#define LIBGRAPH_RELOAD_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+// Milliseconds of quiet after a change before recompiling, editors often
+// write a file in several steps
+#define RELOAD_SETTLE_MS 50
+
+struct Shader;
+struct ShaderVariant;
+struct Node;
+struct Arena;
+
+// Watches a shader's sources with inotify and recompiles them on a thread
+// of its own. Compiler errors exit, so compiling happens in a forked child
+// that sends the programs back in the disk cache's format. A failed
+// compile leaves the running programs alone.
+struct Reloader
+{
+    struct Shader *s;
+    pthread_t thread;
+
+    int inotify;
+    // Written to by reload_free to wake the thread
+    int wake[2];
+
+    // Watched directories and file names in them, editors often replace
+    // files instead of writing them
+    int wd_vert, wd_frag;
+    char *name_vert, *name_frag;
+
+    // Sources of the running programs
+    uint64_t hash_vert, hash_frag;
+
+    // Holds the running trees once a reload was applied, before that they
+    // live in the shader's arena. Every reload parses into an arena of its
+    // own, freed when reload_apply swaps its trees out again.
+    struct Arena *arena;
+
+    // Finished reload waiting for reload_apply, guarded by the shader's
+    // lock. nspec_values is the shader's when the reload started.
+    struct ShaderVariant **variants;
+    size_t nvariants, nspec_values;
+    struct Node *tree_vert, *tree_frag;
+    struct Arena *tree_arena;
+    uint64_t key;
+    bool ready;
+};
+
+// Sources read for one reload
+struct ReloadSources
+{
+    char *vert, *frag;
+    size_t vert_len, frag_len;
+    uint64_t hash_vert, hash_frag;
+};
+
+struct Reloader *reload_alloc(struct Shader *s);
+// Stops the thread, waiting for a reload in progress
+void reload_free(struct Reloader *r);
+
+void *reload_thread(void *arg);
+// Reads pending events, returns whether any touched a source
+bool reload_drain(struct Reloader *r);
+// Recompiles unless both sources hash the same as the running ones
+void reload_check(struct Reloader *r);
+// Compiles the generic variant and every variant compiled so far, returns
+// whether the child succeeded. buf receives what it wrote.
+bool reload_compile(struct Reloader *r, struct ReloadSources *src, char **buf, size_t *len);
+// Runs in the child, writes the programs of every variant to fd
+void reload_child(struct Reloader *r, struct ReloadSources *src, int fd);
+// Ends a child that hit a compile error without the host's exit handlers
+void reload_child_exit();
+// Builds variants from what the child wrote and hands them to
+// reload_apply, returns false if buf is malformed
+bool reload_finish(struct Reloader *r, struct ReloadSources *src, const char *buf, size_t len);
+// Swaps a finished reload into the shader, from the rendering thread
+// between draws
+void reload_apply(struct Reloader *r);
+// Frees variants of a reload that was never applied
+void reload_drop(struct Reloader *r);
+
+// The whole file or 0 if it can't be read right now
+char *reload_read_file(const char *path, size_t *len);
+// Watch descriptor for the directory of path, name is set to the rest
+int reload_watch_dir(struct Reloader *r, const char *path, char **name);
+
+#endif
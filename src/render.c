@@ -1,16 +1,13 @@
 #include "render.h"
 #include "buffer.h"
 #include "shader.h"
-#include "util.h"
+#include <stdint.h>
+#include <unistd.h>
 
-#define swapv(v1, v2, a, b) { \
+#define swapv(v1, v2) { \
     struct VertFragInfo *tmp = v1; \
     v1 = v2; \
     v2 = tmp; \
-    vec3 tmpv; \
-    glm_vec3_copy(a, tmpv); \
-    glm_vec3_copy(b, a); \
-    glm_vec3_copy(tmpv, b); \
 }
 
 int g_w = 0, g_h = 0;
@@ -20,16 +17,122 @@ float *g_zbuf = 0;
 
 struct Shader *g_shader = 0;
 
+struct RenderTile *g_tiles = 0;
+size_t g_ntiles = 0;
+int g_tiles_w = 0;
+
+// Triangles of the current draw and their planes
+struct RenderTri *g_tris = 0;
+size_t g_ntris = 0, g_tris_cap = 0;
+struct RenderPlane *g_tri_planes = 0;
+size_t g_nplanes = 0, g_planes_cap = 0;
+
+struct RenderPool g_pool;
+
+// Set by graph_viewport, graph_cull and graph_front_face
+int g_viewport[4] = { 0 };
+// Pixels x0 <= x <= x1, y0 <= y <= y1 of the viewport on the screen
+int g_scissor[4] = { 0 };
+int g_cull = GRAPH_CULL_NONE;
+bool g_front_ccw = true;
+
+// Planes of the current draw as x, y, z, w coefficients, positions are
+// inside where the dot product is at least 0. Triangles are clipped
+// against g_clip_planes and dropped when outside one of g_view_planes.
+bool g_clip_space = false;
+vec4 g_clip_planes[RENDER_CLIP_PLANES], g_view_planes[RENDER_CLIP_PLANES];
+int g_nclip_planes = 0, g_nview_planes = 0;
+
+// Interpolated values of vertices made by clipping, two per plane at most
+float *g_clip_values = 0;
+size_t g_clip_values_cap = 0;
+
 void graph_init_renderer(int w, int h)
+{
+    graph_init_renderer_ex(w, h, 0);
+}
+
+
+void graph_init_renderer_ex(int w, int h, int nthreads)
 {
     g_scr = malloc(sizeof(uint32_t) * (w * h));
     g_zbuf = malloc(sizeof(float) * (w * h));
     g_w = w;
     g_h = h;
+
+    graph_viewport(0, 0, w, h);
+
+    g_tiles_w = (w + RENDER_TILE - 1) / RENDER_TILE;
+    int tiles_h = (h + RENDER_TILE - 1) / RENDER_TILE;
+
+    g_ntiles = g_tiles_w * tiles_h;
+    g_tiles = malloc(sizeof(struct RenderTile) * (g_ntiles ? g_ntiles : 1));
+
+    for (size_t i = 0; i < g_ntiles; ++i)
+    {
+        struct RenderTile *t = &g_tiles[i];
+        t->x0 = i % g_tiles_w * RENDER_TILE;
+        t->y0 = i / g_tiles_w * RENDER_TILE;
+        t->x1 = t->x0 + RENDER_TILE < w ? t->x0 + RENDER_TILE : w;
+        t->y1 = t->y0 + RENDER_TILE < h ? t->y0 + RENDER_TILE : h;
+
+        t->tris = 0;
+        t->ntris = 0;
+        t->cap = 0;
+    }
+
+    if (nthreads <= 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    // Extra threads would have no tile to take
+    if ((size_t)nthreads > g_ntiles)
+        nthreads = g_ntiles;
+
+    pthread_mutex_init(&g_pool.lock, 0);
+    pthread_cond_init(&g_pool.start, 0);
+    pthread_cond_init(&g_pool.done, 0);
+
+    g_pool.generation = 0;
+    g_pool.busy = 0;
+    g_pool.quit = false;
+
+    // The drawing thread is thread 0, fewer workers only cost speed
+    g_pool.threads = malloc(sizeof(pthread_t) * (nthreads > 1 ? nthreads : 1));
+    g_pool.nthreads = 1;
+
+    for (int i = 1; i < nthreads; ++i)
+    {
+        if (pthread_create(&g_pool.threads[i], 0, graph_render_worker, (void*)(intptr_t)i) != 0)
+            break;
+
+        ++g_pool.nthreads;
+    }
 }
 
+
 void graph_free_renderer()
 {
+    pthread_mutex_lock(&g_pool.lock);
+    g_pool.quit = true;
+    pthread_cond_broadcast(&g_pool.start);
+    pthread_mutex_unlock(&g_pool.lock);
+
+    for (int i = 1; i < g_pool.nthreads; ++i)
+        pthread_join(g_pool.threads[i], 0);
+
+    free(g_pool.threads);
+    pthread_mutex_destroy(&g_pool.lock);
+    pthread_cond_destroy(&g_pool.start);
+    pthread_cond_destroy(&g_pool.done);
+
+    for (size_t i = 0; i < g_ntiles; ++i)
+        free(g_tiles[i].tris);
+
+    free(g_tiles);
+    free(g_tris);
+    free(g_tri_planes);
+    free(g_clip_values);
+
     free(g_scr);
     free(g_zbuf);
 }
@@ -43,6 +146,19 @@ void graph_reset_renderer()
     }
 }
 
+
+void graph_reset_tile(struct RenderTile *t)
+{
+    for (int y = t->y0; y < t->y1; ++y)
+    {
+        for (int x = t->x0; x < t->x1; ++x)
+        {
+            g_scr[y * g_w + x] = 0x00000000;
+            g_zbuf[y * g_w + x] = INFINITY;
+        }
+    }
+}
+
 void graph_render_result(SDL_Texture *tex)
 {
     SDL_UpdateTexture(tex, 0, g_scr, g_w * sizeof(uint32_t));
@@ -50,7 +166,7 @@ void graph_render_result(SDL_Texture *tex)
 
 void graph_draw(SDL_Renderer *rend)
 {
-    graph_reset_renderer();
+    // Tiles are cleared as they're rasterized
     shader_run_vert(g_shader, rend);
 }
 
@@ -59,149 +175,664 @@ void graph_use_shader(struct Shader *s)
     g_shader = s;
 }
 
-void graph_render_draw_tri(SDL_Renderer *rend, struct VertFragInfo *points[3])
+
+void graph_viewport(int x, int y, int w, int h)
+{
+    g_viewport[0] = x;
+    g_viewport[1] = y;
+    g_viewport[2] = w;
+    g_viewport[3] = h;
+
+    g_scissor[0] = x > 0 ? x : 0;
+    g_scissor[1] = y > 0 ? y : 0;
+    g_scissor[2] = x + w < g_w ? x + w - 1 : g_w - 1;
+    g_scissor[3] = y + h < g_h ? y + h - 1 : g_h - 1;
+}
+
+
+void graph_cull(int faces)
+{
+    g_cull = faces;
+}
+
+
+void graph_front_face(bool ccw)
+{
+    g_front_ccw = ccw;
+}
+
+
+void graph_render_begin(size_t ntris, size_t ninterp, bool clip_space)
+{
+    if (ntris > g_tris_cap)
+    {
+        g_tris = realloc(g_tris, sizeof(struct RenderTri) * ntris);
+        g_tris_cap = ntris;
+    }
+
+    if (ntris * ninterp > g_planes_cap)
+    {
+        g_planes_cap = ntris * ninterp;
+        g_tri_planes = realloc(g_tri_planes, sizeof(struct RenderPlane) * g_planes_cap);
+    }
+
+    if (RENDER_CLIP_PLANES * 2 * ninterp > g_clip_values_cap)
+    {
+        g_clip_values_cap = RENDER_CLIP_PLANES * 2 * ninterp;
+        g_clip_values = realloc(g_clip_values, sizeof(float) * g_clip_values_cap);
+    }
+
+    g_ntris = 0;
+    g_nplanes = ninterp;
+    g_clip_space = clip_space;
+
+    // Clipped vertices land a pixel inside the guard band despite rounding
+    float band = RENDER_GUARD_BAND - 1.f;
+
+    if (clip_space)
+    {
+        // Pixel centers sit on whole coordinates, -1 and 1 are the outer
+        // edges of the viewport's pixels
+        float hx = g_viewport[2] / 2.f, hy = g_viewport[3] / 2.f;
+        float cx = g_viewport[0] + hx - .5f, cy = g_viewport[1] + hy - .5f;
+
+        // Screen y grows downwards
+        glm_vec4_copy((vec4){ hx, 0.f, 0.f, cx + band }, g_clip_planes[0]);
+        glm_vec4_copy((vec4){ -hx, 0.f, 0.f, band - cx }, g_clip_planes[1]);
+        glm_vec4_copy((vec4){ 0.f, -hy, 0.f, cy + band }, g_clip_planes[2]);
+        glm_vec4_copy((vec4){ 0.f, hy, 0.f, band - cy }, g_clip_planes[3]);
+        glm_vec4_copy((vec4){ 0.f, 0.f, 1.f, 1.f }, g_clip_planes[4]);
+        glm_vec4_copy((vec4){ 0.f, 0.f, -1.f, 1.f }, g_clip_planes[5]);
+        g_nclip_planes = 6;
+
+        glm_vec4_copy((vec4){ 1.f, 0.f, 0.f, 1.f }, g_view_planes[0]);
+        glm_vec4_copy((vec4){ -1.f, 0.f, 0.f, 1.f }, g_view_planes[1]);
+        glm_vec4_copy((vec4){ 0.f, 1.f, 0.f, 1.f }, g_view_planes[2]);
+        glm_vec4_copy((vec4){ 0.f, -1.f, 0.f, 1.f }, g_view_planes[3]);
+        glm_vec4_copy(g_clip_planes[4], g_view_planes[4]);
+        glm_vec4_copy(g_clip_planes[5], g_view_planes[5]);
+        g_nview_planes = 6;
+    }
+    else
+    {
+        // Screen positions have no near or far plane
+        glm_vec4_copy((vec4){ 1.f, 0.f, 0.f, band }, g_clip_planes[0]);
+        glm_vec4_copy((vec4){ -1.f, 0.f, 0.f, band }, g_clip_planes[1]);
+        glm_vec4_copy((vec4){ 0.f, 1.f, 0.f, band }, g_clip_planes[2]);
+        glm_vec4_copy((vec4){ 0.f, -1.f, 0.f, band }, g_clip_planes[3]);
+        g_nclip_planes = 4;
+
+        glm_vec4_copy((vec4){ 1.f, 0.f, 0.f, -g_viewport[0] }, g_view_planes[0]);
+        glm_vec4_copy((vec4){ -1.f, 0.f, 0.f, g_viewport[0] + g_viewport[2] - 1 }, g_view_planes[1]);
+        glm_vec4_copy((vec4){ 0.f, 1.f, 0.f, -g_viewport[1] }, g_view_planes[2]);
+        glm_vec4_copy((vec4){ 0.f, -1.f, 0.f, g_viewport[1] + g_viewport[3] - 1 }, g_view_planes[3]);
+        g_nview_planes = 4;
+    }
+
+    for (size_t i = 0; i < g_ntiles; ++i)
+        g_tiles[i].ntris = 0;
+}
+
+
+void graph_render_bin_tri(struct VertFragInfo *points[3])
+{
+    unsigned outside = ~0u, clipped = 0;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        outside &= graph_render_outcode(points[i]->pos, g_view_planes, g_nview_planes);
+        clipped |= graph_render_outcode(points[i]->pos, g_clip_planes, g_nclip_planes);
+    }
+
+    // Every vertex is behind the same plane
+    if (outside)
+        return;
+
+    // Original values are only read, clipping allocates new ones
+    struct VertFragInfo poly[RENDER_CLIP_VERTS];
+    int n = 3;
+
+    for (int i = 0; i < 3; ++i)
+        poly[i] = *points[i];
+
+    if (clipped)
+        n = graph_render_clip(poly, n, clipped);
+
+    for (int i = 0; i < n; ++i)
+        graph_render_viewport(&poly[i]);
+
+    for (int i = 1; i + 1 < n; ++i)
+    {
+        struct VertFragInfo *fan[3] = { &poly[0], &poly[i], &poly[i + 1] };
+        graph_render_add_tri(fan);
+    }
+}
+
+
+unsigned graph_render_outcode(vec4 pos, vec4 *planes, int nplanes)
+{
+    unsigned code = 0;
+
+    for (int i = 0; i < nplanes; ++i)
+    {
+        if (glm_vec4_dot(planes[i], pos) < 0.f)
+            code |= 1u << i;
+    }
+
+    return code;
+}
+
+
+int graph_render_clip(struct VertFragInfo poly[RENDER_CLIP_VERTS], int n, unsigned mask)
+{
+    struct VertFragInfo res[RENDER_CLIP_VERTS];
+    size_t nnew = 0;
+
+    for (int p = 0; p < g_nclip_planes && n >= 3; ++p)
+    {
+        if (!(mask & (1u << p))) continue;
+
+        int m = 0;
+
+        for (int i = 0; i < n; ++i)
+        {
+            struct VertFragInfo *a = &poly[i], *b = &poly[(i + 1) % n];
+            bool a_in = glm_vec4_dot(g_clip_planes[p], a->pos) >= 0.f;
+            bool b_in = glm_vec4_dot(g_clip_planes[p], b->pos) >= 0.f;
+
+            if (a_in)
+                res[m++] = *a;
+
+            if (a_in != b_in)
+            {
+                res[m].values = &g_clip_values[nnew++ * g_nplanes];
+
+                if (a_in)
+                    graph_render_clip_edge(a, b, g_clip_planes[p], &res[m]);
+                else
+                    graph_render_clip_edge(b, a, g_clip_planes[p], &res[m]);
+
+                ++m;
+            }
+        }
+
+        memcpy(poly, res, sizeof(struct VertFragInfo) * m);
+        n = m;
+    }
+
+    return n >= 3 ? n : 0;
+}
+
+
+void graph_render_clip_edge(struct VertFragInfo *in, struct VertFragInfo *out, vec4 plane,
+                            struct VertFragInfo *res)
+{
+    float d_in = glm_vec4_dot(plane, in->pos), d_out = glm_vec4_dot(plane, out->pos);
+    float t = d_in / (d_in - d_out);
+
+    glm_vec4_lerp(in->pos, out->pos, t, res->pos);
+
+    for (size_t i = 0; i < g_nplanes; ++i)
+        res->values[i] = in->values[i] + (out->values[i] - in->values[i]) * t;
+}
+
+
+void graph_render_viewport(struct VertFragInfo *v)
+{
+    // Screen positions are already there with 1 / w = 1
+    if (!g_clip_space)
+        return;
+
+    float hx = g_viewport[2] / 2.f, hy = g_viewport[3] / 2.f;
+    float invw = 1.f / v->pos[3];
+
+    v->pos[0] = g_viewport[0] + hx - .5f + v->pos[0] * invw * hx;
+    v->pos[1] = g_viewport[1] + hy - .5f - v->pos[1] * invw * hy;
+    v->pos[2] = (v->pos[2] * invw + 1.f) / 2.f;
+    v->pos[3] = invw;
+}
+
+
+void graph_render_add_tri(struct VertFragInfo *points[3])
+{
+    // Clipping can add triangles past what graph_render_begin made room for
+    if (g_ntris == g_tris_cap)
+    {
+        g_tris_cap = g_tris_cap ? g_tris_cap * 2 : 16;
+        g_tris = realloc(g_tris, sizeof(struct RenderTri) * g_tris_cap);
+    }
+
+    if (g_tris_cap * g_nplanes > g_planes_cap)
+    {
+        g_planes_cap = g_tris_cap * g_nplanes;
+        g_tri_planes = realloc(g_tri_planes, sizeof(struct RenderPlane) * g_planes_cap);
+    }
+
+    struct RenderTri *tri = &g_tris[g_ntris];
+    tri->planes = &g_tri_planes[g_ntris * g_nplanes];
+
+    if (!graph_render_setup_tri(tri, points))
+        return;
+
+    size_t index = g_ntris++;
+
+    for (int ty = tri->y0 / RENDER_TILE; ty <= tri->y1 / RENDER_TILE; ++ty)
+    {
+        for (int tx = tri->x0 / RENDER_TILE; tx <= tri->x1 / RENDER_TILE; ++tx)
+        {
+            struct RenderTile *t = &g_tiles[ty * g_tiles_w + tx];
+
+            if (t->ntris == t->cap)
+            {
+                t->cap = t->cap ? t->cap * 2 : 16;
+                t->tris = realloc(t->tris, sizeof(size_t) * t->cap);
+            }
+
+            t->tris[t->ntris++] = index;
+        }
+    }
+}
+
+
+bool graph_render_setup_tri(struct RenderTri *tri, struct VertFragInfo *points[3])
 {
-    vec3 a, b, c;
-    glm_vec3_copy(points[0]->pos, a);
-    glm_vec3_copy(points[1]->pos, b);
-    glm_vec3_copy(points[2]->pos, c);
+    struct VertFragInfo *v[3] = { points[0], points[1], points[2] };
+    int64_t x[3], y[3];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        // Also false for NaN
+        if (!(fabsf(v[i]->pos[0]) <= RENDER_GUARD_BAND && fabsf(v[i]->pos[1]) <= RENDER_GUARD_BAND))
+            return false;
+
+        x[i] = roundf(v[i]->pos[0] * RENDER_SUBPIXEL);
+        y[i] = roundf(v[i]->pos[1] * RENDER_SUBPIXEL);
+    }
+
+    int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0) return false;
+
+    // Screen y grows downwards, so a positive area winds clockwise
+    bool front = (area < 0) == g_front_ccw;
+
+    if (g_cull & (front ? GRAPH_CULL_FRONT : GRAPH_CULL_BACK))
+        return false;
 
-    if (a[1] > b[1]) swapv(points[0], points[1], a, b);
-    if (a[1] > c[1]) swapv(points[0], points[2], a, c);
-    if (b[1] > c[1]) swapv(points[1], points[2], b, c);
+    if (area < 0)
+    {
+        swapv(v[1], v[2]);
+
+        int64_t tmp = x[1];
+        x[1] = x[2];
+        x[2] = tmp;
 
-    SDL_SetRenderDrawColor(rend, 255, 255, 255, 255);
+        tmp = y[1];
+        y[1] = y[2];
+        y[2] = tmp;
 
-    RTI r_ac = { a[0], (c[1] - a[1]) / (c[0] - a[0]), a[2], (c[2] - a[2]) / (c[1] - a[1]) };
-    RTI r_ab = { a[0], (b[1] - a[1]) / (b[0] - a[0]), a[2], (b[2] - a[2]) / (b[1] - a[1]) };
-    RTI r_bc = { b[0], (c[1] - b[1]) / (c[0] - b[0]), b[2], (c[2] - b[2]) / (c[1] - b[1]) };
+        area = -area;
+    }
 
-    fill_edges(points[0], points[1], &r_ac, &r_ab, points);
-    fill_edges(points[1], points[2], &r_ac, &r_bc, points);
+    for (int i = 0; i < 3; ++i)
+    {
+        int j = (i + 1) % 3;
+        int64_t dx = x[j] - x[i], dy = y[j] - y[i];
+
+        struct RenderEdge *e = &tri->edges[i];
+        e->a = -dy * RENDER_SUBPIXEL;
+        e->b = dx * RENDER_SUBPIXEL;
+        e->c = dy * x[i] - dx * y[i];
+
+        // Top edges are horizontal with the inside below, left edges go up
+        if (!(dy < 0 || (dy == 0 && dx > 0)))
+            --e->c;
+    }
+
+    // Pixel centers sit on whole coordinates, covered pixels are the ones
+    // whose center is inside
+    int64_t minx = x[0] < x[1] ? (x[0] < x[2] ? x[0] : x[2]) : (x[1] < x[2] ? x[1] : x[2]);
+    int64_t maxx = x[0] > x[1] ? (x[0] > x[2] ? x[0] : x[2]) : (x[1] > x[2] ? x[1] : x[2]);
+    int64_t miny = y[0] < y[1] ? (y[0] < y[2] ? y[0] : y[2]) : (y[1] < y[2] ? y[1] : y[2]);
+    int64_t maxy = y[0] > y[1] ? (y[0] > y[2] ? y[0] : y[2]) : (y[1] > y[2] ? y[1] : y[2]);
+
+    tri->x0 = (minx + RENDER_SUBPIXEL - 1) >> RENDER_SUBPIXEL_BITS;
+    tri->y0 = (miny + RENDER_SUBPIXEL - 1) >> RENDER_SUBPIXEL_BITS;
+    tri->x1 = maxx >> RENDER_SUBPIXEL_BITS;
+    tri->y1 = maxy >> RENDER_SUBPIXEL_BITS;
+
+    // Only pixels of the viewport on the screen are drawn
+    if (tri->x0 < g_scissor[0]) tri->x0 = g_scissor[0];
+    if (tri->y0 < g_scissor[1]) tri->y0 = g_scissor[1];
+    if (tri->x1 > g_scissor[2]) tri->x1 = g_scissor[2];
+    if (tri->y1 > g_scissor[3]) tri->y1 = g_scissor[3];
+
+    if (tri->x0 > tri->x1 || tri->y0 > tri->y1)
+        return false;
+
+    // Planes go through the snapped positions, one divide for all of them
+    double area_px = (double)area / (RENDER_SUBPIXEL * RENDER_SUBPIXEL);
+
+    struct RenderGradients g = {
+        (double)(y[2] - y[0]) / RENDER_SUBPIXEL / area_px,
+        (double)(y[0] - y[1]) / RENDER_SUBPIXEL / area_px,
+        (double)(x[0] - x[2]) / RENDER_SUBPIXEL / area_px,
+        (double)(x[1] - x[0]) / RENDER_SUBPIXEL / area_px,
+        tri->x0 - (double)x[0] / RENDER_SUBPIXEL,
+        tri->y0 - (double)y[0] / RENDER_SUBPIXEL
+    };
+
+    graph_render_plane(&g, v[0]->pos[2], v[1]->pos[2], v[2]->pos[2], &tri->z);
+    graph_render_plane(&g, v[0]->pos[3], v[1]->pos[3], v[2]->pos[3], &tri->invw);
+
+    for (size_t i = 0; i < g_nplanes; ++i)
+    {
+        graph_render_plane(&g, v[0]->values[i] * v[0]->pos[3], v[1]->values[i] * v[1]->pos[3],
+                           v[2]->values[i] * v[2]->pos[3], &tri->planes[i]);
+    }
+
+    return true;
+}
+
+
+void graph_render_plane(struct RenderGradients *g, float v0, float v1, float v2, struct RenderPlane *p)
+{
+    double d1 = v1 - v0, d2 = v2 - v0;
+    double dx = d1 * g->x1 + d2 * g->x2;
+    double dy = d1 * g->y1 + d2 * g->y2;
+
+    p->v = v0 + dx * g->ox + dy * g->oy;
+    p->dx = dx;
+    p->dy = dy;
 }
 
-void interp_vec(struct VertFragInfo *verts[3], vec3 bary, size_t i)
+
+void graph_render_tiles(bool prepass)
 {
-    // a * ba + b * bb + c * bc
-    struct Node *vec = visitor_visit(verts[0]->outputs[i]->vardef_value);
-    size_t vec_len = vec->vec_len;
+    // Planes may have moved while triangles were added
+    for (size_t i = 0; i < g_ntris; ++i)
+        g_tris[i].planes = &g_tri_planes[i * g_nplanes];
 
-    float *aba = malloc(sizeof(float) * vec_len),
-          *bbb = malloc(sizeof(float) * vec_len),
-          *cbc = malloc(sizeof(float) * vec_len);
+    variant_thread_frames(g_shader->active, g_pool.nthreads);
 
-    node_to_vec(verts[0]->outputs[i]->vardef_value, aba);
-    for (size_t j = 0; j < vec_len; ++j) aba[j] *= bary[0];
+    g_pool.next = 0;
+    g_pool.prepass = prepass;
 
-    node_to_vec(verts[1]->outputs[i]->vardef_value, bbb);
-    for (size_t j = 0; j < vec_len; ++j) bbb[j] *= bary[1];
+    pthread_mutex_lock(&g_pool.lock);
+    ++g_pool.generation;
+    g_pool.busy = g_pool.nthreads - 1;
+    pthread_cond_broadcast(&g_pool.start);
+    pthread_mutex_unlock(&g_pool.lock);
 
-    node_to_vec(verts[2]->outputs[i]->vardef_value, cbc);
-    for (size_t j = 0; j < vec_len; ++j) cbc[j] *= bary[2];
+    graph_render_work(0);
 
-    // Store sum in aba (arbitrarily chosen)
-    for (size_t j = 0; j < vec_len; ++j)
-        aba[j] += bbb[j] + cbc[j];
+    pthread_mutex_lock(&g_pool.lock);
 
-    shader_add_input_vec(g_shader, verts[0]->outputs[i]->vardef_name, aba, vec_len);
+    while (g_pool.busy)
+        pthread_cond_wait(&g_pool.done, &g_pool.lock);
 
-    free(aba);
-    free(bbb);
-    free(cbc);
+    pthread_mutex_unlock(&g_pool.lock);
 }
 
-void interp_float(struct VertFragInfo *verts[3], vec3 bary, size_t i)
+
+void *graph_render_worker(void *arg)
 {
-    struct Node *a = visitor_visit(verts[0]->outputs[i]->vardef_value);
-    struct Node *b = visitor_visit(verts[1]->outputs[i]->vardef_value);
-    struct Node *c = visitor_visit(verts[2]->outputs[i]->vardef_value);
+    int thread = (intptr_t)arg;
 
-    float fa = a->float_value;
-    float fb = b->float_value;
-    float fc = c->float_value;
+    // Started before the first draw
+    unsigned long seen = 0;
 
-    float f = fa * bary[0] + fb * bary[1] + fc * bary[2];
-    shader_add_input_float(g_shader, verts[0]->outputs[i]->vardef_name, f);
+    pthread_mutex_lock(&g_pool.lock);
+
+    while (true)
+    {
+        while (g_pool.generation == seen && !g_pool.quit)
+            pthread_cond_wait(&g_pool.start, &g_pool.lock);
+
+        if (g_pool.quit) break;
+
+        seen = g_pool.generation;
+        pthread_mutex_unlock(&g_pool.lock);
+
+        graph_render_work(thread);
+
+        pthread_mutex_lock(&g_pool.lock);
+
+        if (--g_pool.busy == 0)
+            pthread_cond_signal(&g_pool.done);
+    }
+
+    pthread_mutex_unlock(&g_pool.lock);
+    return 0;
+}
+
+
+void graph_render_work(int thread)
+{
+    struct Frame *f = g_shader->active->thread_frames[thread];
+
+    while (true)
+    {
+        size_t i = __atomic_fetch_add(&g_pool.next, 1, __ATOMIC_RELAXED);
+        if (i >= g_ntiles) break;
+
+        graph_render_tile(&g_tiles[i], f, g_pool.prepass);
+    }
 }
 
-void fill_edges(struct VertFragInfo *va, struct VertFragInfo *vb, RTI *l1, RTI *l2, struct VertFragInfo *verts[3])
+
+void graph_render_tile(struct RenderTile *t, struct Frame *f, bool prepass)
 {
-    vec3 a, b;
-    glm_vec3_copy(va->pos, a);
-    glm_vec3_copy(vb->pos, b);
+    graph_reset_tile(t);
 
-    vec3 positions[3];
-    glm_vec3_copy(verts[0]->pos, positions[0]);
-    glm_vec3_copy(verts[1]->pos, positions[1]);
-    glm_vec3_copy(verts[2]->pos, positions[2]);
+    // Both passes stay within the tile, so no other tile waits on them
+    if (prepass)
+    {
+        for (size_t i = 0; i < t->ntris; ++i)
+            graph_render_draw_tri(t, &g_tris[t->tris[i]], f, DEPTH_PASS_ONLY);
 
-    for (int y = a[1]; y < b[1]; ++y)
+        for (size_t i = 0; i < t->ntris; ++i)
+            graph_render_draw_tri(t, &g_tris[t->tris[i]], f, DEPTH_PASS_EQUAL);
+    }
+    else
     {
-        int min = roundf(l1->x < l2->x ? l1->x : l2->x);
-        int max = roundf(l1->x > l2->x ? l1->x : l2->x);
+        for (size_t i = 0; i < t->ntris; ++i)
+            graph_render_draw_tri(t, &g_tris[t->tris[i]], f, DEPTH_PASS_SHADE);
+    }
+}
+
+
+void graph_render_draw_tri(struct RenderTile *t, struct RenderTri *tri, struct Frame *f, DepthPass pass)
+{
+    int x0 = tri->x0 > t->x0 ? tri->x0 : t->x0;
+    int y0 = tri->y0 > t->y0 ? tri->y0 : t->y0;
+    int x1 = tri->x1 < t->x1 - 1 ? tri->x1 : t->x1 - 1;
+    int y1 = tri->y1 < t->y1 - 1 ? tri->y1 : t->y1 - 1;
 
-        float z = l1->z;
-        float sz = (l2->z - l1->z) / (l2->x - l1->x);
+    // Tiles start on a multiple of the block size
+    x0 -= (x0 - t->x0) % RENDER_BLOCK;
+    y0 -= (y0 - t->y0) % RENDER_BLOCK;
 
-        for (int i = min; i < max; ++i)
+    struct RenderBlock b;
+
+    for (b.y = y0; b.y <= y1; b.y += RENDER_BLOCK)
+    {
+        for (b.x = x0; b.x <= x1; b.x += RENDER_BLOCK)
         {
-            z += sz;
+            bool outside = false;
+            b.partial = 0;
 
-            if (i < 0)
+            for (int i = 0; i < 3 && !outside; ++i)
             {
-                z += sz * -i;
-                i = 0;
-                continue;
+                struct RenderEdge *e = &tri->edges[i];
+                b.e[i] = (int64_t)e->a * b.x + (int64_t)e->b * b.y + e->c;
+
+                // Lowest and highest values over the block's corners
+                int64_t span_a = (int64_t)e->a * (RENDER_BLOCK - 1);
+                int64_t span_b = (int64_t)e->b * (RENDER_BLOCK - 1);
+                int64_t lo = b.e[i] + (span_a < 0 ? span_a : 0) + (span_b < 0 ? span_b : 0);
+                int64_t hi = b.e[i] + (span_a > 0 ? span_a : 0) + (span_b > 0 ? span_b : 0);
+
+                outside = hi < 0;
+
+                if (lo < 0)
+                    b.partial |= 1u << i;
             }
 
-            if (i >= g_w) break;
+            if (!outside)
+                graph_render_block(t, tri, &b, f, pass);
+        }
+    }
+}
+
+
+void graph_render_block(struct RenderTile *t, struct RenderTri *tri, struct RenderBlock *b, struct Frame *f,
+                        DepthPass pass)
+{
+    bool late_z = shader_late_z(g_shader);
+
+    // Blocks sit on the tile's grid, so the screen's and viewport's edges
+    // can cut them on any side
+    int x0 = g_scissor[0] > b->x ? g_scissor[0] : b->x;
+    int y0 = g_scissor[1] > b->y ? g_scissor[1] : b->y;
+    int x1 = g_scissor[2] < t->x1 - 1 ? g_scissor[2] : t->x1 - 1;
+    int y1 = g_scissor[3] < t->y1 - 1 ? g_scissor[3] : t->y1 - 1;
+
+    int w = x1 - b->x + 1 < RENDER_BLOCK ? x1 - b->x + 1 : RENDER_BLOCK;
+    int h = y1 - b->y + 1 < RENDER_BLOCK ? y1 - b->y + 1 : RENDER_BLOCK;
+    unsigned inside = ((1u << w) - 1) & ~((1u << (x0 - b->x)) - 1);
+
+    VmLaneInt lanes;
+    VmLane lanesf;
+
+    for (int lane = 0; lane < VM_PACKET_W; ++lane)
+    {
+        lanes[lane] = lane;
+        lanesf[lane] = lane;
+    }
+
+    // Partial edges stay within the block's span of a few pixels, which
+    // the guard band keeps in 32 bits
+    VmLaneInt e[3];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        if (b->partial & (1u << i))
+            e[i] = (int32_t)b->e[i] + tri->edges[i].a * lanes;
+    }
+
+    VmLane dz = tri->z.dx * lanesf;
 
-            vec3 pos = { i, y, z };
-            vec3 bary;
-            util_bary_coefficients(positions, pos, bary);
+    struct Packet pk;
+    pk.x = b->x;
 
-            visitor_bind_scope(g_shader->scope_frag);
-            shader_clear_inputs(g_shader);
+    for (int row = 0; row < h; ++row)
+    {
+        VmLaneInt covered = lanes >= 0;
 
-            // Arbitrarily chose va for iterator condition since they
-            // should all have the same length anyways
-            for (size_t j = 0; j < va->len; ++j)
+        for (int i = 0; i < 3; ++i)
+        {
+            if (b->partial & (1u << i))
             {
-                switch (va->outputs[j]->vardef_type)
-                {
-                case NODE_VEC: interp_vec(verts, bary, j); break;
-                case NODE_FLOAT: interp_float(verts, bary, j); break;
-                default: break;
-                }
+                covered &= e[i] >= 0;
+                e[i] += tri->edges[i].b;
             }
+        }
+
+        pk.y = b->y + row;
+        pk.mask = 0;
 
-            shader_run_frag(g_shader);
+        for (int lane = 0; lane < VM_PACKET_W; ++lane)
+        {
+            if (covered[lane])
+                pk.mask |= 1u << lane;
+        }
 
-            struct Node *color_node = shader_outvar(g_shader, g_shader->scope_frag, "gr_color");
-            struct Node **rgb = color_node->vardef_value->vec_runtime_values;
+        pk.mask &= inside;
+        if (!pk.mask || pk.y < y0) continue;
 
-            uint32_t hex = 0x00000000 |
-                (int)rgb[0]->float_value << 16 |
-                (int)rgb[1]->float_value << 8 |
-                (int)rgb[2]->float_value;
+        VmLane z = tri->z.v + tri->z.dx * (pk.x - tri->x0) + tri->z.dy * (pk.y - tri->y0) + dz;
+        memcpy(pk.z, &z, sizeof(pk.z));
 
-            int idx = y * g_w + i;
+        float *zbuf = &g_zbuf[pk.y * g_w + pk.x];
 
-            if (idx >= 0 && idx < g_w * g_h)
+        if (pass == DEPTH_PASS_ONLY)
+        {
+            for (int lane = 0; lane < VM_PACKET_W; ++lane)
             {
-                if (z < g_zbuf[idx])
-                {
-                    g_scr[idx] = hex;
-                    g_zbuf[idx] = z;
-                }
+                if ((pk.mask & (1u << lane)) && pk.z[lane] < zbuf[lane])
+                    zbuf[lane] = pk.z[lane];
             }
+
+            continue;
         }
 
-        l1->x += 1.f / l1->slopex;
-        l2->x += 1.f / l2->slopex;
+        if (!late_z)
+        {
+            // Cleared lanes may lie past the screen or in another tile
+            for (int lane = 0; lane < VM_PACKET_W; ++lane)
+            {
+                if ((pk.mask & (1u << lane)) &&
+                    (pass == DEPTH_PASS_EQUAL ? pk.z[lane] != zbuf[lane] : !(pk.z[lane] < zbuf[lane])))
+                    pk.mask &= ~(1u << lane);
+            }
+        }
 
-        l1->z += l1->slopez;
-        l2->z += l2->slopez;
+        if (pk.mask)
+            shade_packet(&pk, tri, f, late_z);
     }
 }
 
+
+void shade_packet(struct Packet *pk, struct RenderTri *tri, struct Frame *f, bool late_z)
+{
+    VmLane lanes;
+
+    for (int lane = 0; lane < VM_PACKET_W; ++lane)
+        lanes[lane] = lane;
+
+    float dx = pk->x - tri->x0, dy = pk->y - tri->y0;
+
+    // Screen positions skip the divide, their 1 / w is always 1
+    VmLane w = (VmLane){ 0 } + 1.f;
+
+    if (g_clip_space)
+        w = 1.f / (tri->invw.v + tri->invw.dx * dx + tri->invw.dy * dy + tri->invw.dx * lanes);
+
+    // Idle lanes get values from just outside the triangle, their results
+    // are dropped
+    for (size_t i = 0; i < g_shader->active->nvaryings; ++i)
+    {
+        struct ShaderVarying *v = &g_shader->active->varyings[i];
+
+        for (size_t j = 0; j < v->len; ++j)
+        {
+            struct RenderPlane *p = &tri->planes[v->offset + j];
+
+            // Lanes of a slot are adjacent and aligned like a whole vector
+            *(VmLane*)&FRAME_AT(f, v->slot_frag + j, 0) = (p->v + p->dx * dx + p->dy * dy + p->dx * lanes) * w;
+        }
+    }
+
+    shader_run_frag(f);
+
+    for (int lane = 0; lane < VM_PACKET_W; ++lane)
+    {
+        if (!(pk->mask & (1u << lane))) continue;
+
+        uint32_t hex = 0x00000000 |
+            (int)FRAME_AT(f, g_shader->active->color_slot, lane) << 16 |
+            (int)FRAME_AT(f, g_shader->active->color_slot + 1, lane) << 8 |
+            (int)FRAME_AT(f, g_shader->active->color_slot + 2, lane);
+
+        int idx = pk->y * g_w + pk->x + lane;
+        float z = g_shader->active->depth_slot == -1 ? pk->z[lane] :
+            FRAME_AT(f, g_shader->active->depth_slot, lane);
+
+        // graph_render_block already tested the rest
+        if (late_z && !(z < g_zbuf[idx]))
+            continue;
+
+        g_scr[idx] = hex;
+        g_zbuf[idx] = z;
+    }
+}
\ No newline at end of file
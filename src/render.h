@@ -2,25 +2,201 @@
 #define LIBGRAPH_RENDER_H
 
 #include "shader.h"
+#include <pthread.h>
+#include <stdbool.h>
 #include <SDL2/SDL.h>
 
-typedef struct
+// Width and height of a screen tile in pixels
+#define RENDER_TILE 64
+// Tiles are walked in square blocks whose rows are packets
+#define RENDER_BLOCK VM_PACKET_W
+
+// Vertex positions are snapped to 1 / RENDER_SUBPIXEL of a pixel
+#define RENDER_SUBPIXEL_BITS 4
+#define RENDER_SUBPIXEL (1 << RENDER_SUBPIXEL_BITS)
+// Furthest a vertex may be from the origin in pixels, so edge functions
+// of partially covered blocks fit in 32 bits. Triangles reaching past it
+// are clipped to it.
+#define RENDER_GUARD_BAND 8192.f
+
+// Planes a triangle is clipped against, each adds at most one vertex
+#define RENDER_CLIP_PLANES 6
+#define RENDER_CLIP_VERTS (3 + RENDER_CLIP_PLANES)
+
+// Faces graph_cull drops, front faces wind as set by graph_front_face
+#define GRAPH_CULL_NONE 0
+#define GRAPH_CULL_FRONT 1
+#define GRAPH_CULL_BACK 2
+
+// What rasterizing a triangle does with its fragments
+typedef enum
+{
+    // Shades fragments in front of the depth buffer, tested before shading
+    // unless shader_late_z
+    DEPTH_PASS_SHADE,
+    // Only writes depth
+    DEPTH_PASS_ONLY,
+    // Shades fragments exactly as deep as the depth buffer, after a
+    // DEPTH_PASS_ONLY over the same triangles
+    DEPTH_PASS_EQUAL
+} DepthPass;
+
+// Pixels of one row shaded together, lane i covers pixel x + i
+struct Packet
+{
+    int x, y;
+    unsigned mask; // Lanes inside the triangle
+    float z[VM_PACKET_W];
+};
+
+// a * x + b * y + c at pixel (x, y) is at least 0 on the triangle's side
+// of the edge, in 1 / RENDER_SUBPIXEL pixels squared. Pixels exactly on the
+// edge are only inside for top and left edges, c is biased by one
+// otherwise, so triangles sharing an edge never both cover a pixel on it.
+struct RenderEdge
 {
-    float x, slopex, z, slopez;
-} RTI;
+    int32_t a, b;
+    int64_t c;
+};
+
+// Value interpolated across a triangle, v at the triangle's pixel x0, y0
+// plus dx and dy for every pixel right and down from there
+struct RenderPlane
+{
+    float v, dx, dy;
+};
+
+// Turns the differences d1 and d2 of a value from vertex 0 to vertices 1
+// and 2 into its change per pixel, d1 * x1 + d2 * x2 along x
+struct RenderGradients
+{
+    double x1, x2, y1, y2;
+
+    // Pixel x0, y0 relative to vertex 0
+    double ox, oy;
+};
+
+// Triangle after the vertex stage, wound so every edge function is at
+// least 0 inside. Edge i runs from vertex i to the next one.
+struct RenderTri
+{
+    struct RenderEdge edges[3];
+
+    // Pixels x0 <= x <= x1, y0 <= y <= y1 can be covered
+    int x0, y0, x1, y1;
 
+    struct RenderPlane z;
+    // 1 / w in clip space, values are interpolated divided by w so they
+    // stay correct under perspective. Always 1 for screen positions.
+    struct RenderPlane invw;
+    // One per interpolated value of the vertices
+    struct RenderPlane *planes;
+};
+
+// Block of RENDER_BLOCK squared pixels starting at x, y with the edge
+// functions there. partial has a bit for every edge whose sign changes
+// inside the block.
+struct RenderBlock
+{
+    int x, y;
+    int64_t e[3];
+    unsigned partial;
+};
+
+// Pixels x0 <= x < x1, y0 <= y < y1 of the screen. Only one thread works
+// on a tile at a time, so its color and depth need no locking.
+struct RenderTile
+{
+    int x0, y0, x1, y1;
+
+    // Indices of the triangles overlapping the tile, in draw order
+    size_t *tris;
+    size_t ntris, cap;
+};
+
+// Threads rasterizing tiles, the drawing thread works as thread 0
+struct RenderPool
+{
+    pthread_t *threads;
+    int nthreads;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+
+    // Bumped for every draw, workers run once per bump
+    unsigned long generation;
+    // Workers still busy with the current draw
+    int busy;
+    bool quit;
+
+    // Next tile to take, advanced atomically
+    size_t next;
+    bool prepass;
+};
+
+// Rasterizes with one thread per core
 void graph_init_renderer(int w, int h);
+// Same with nthreads threads, one per core when 0
+void graph_init_renderer_ex(int w, int h, int nthreads);
 void graph_free_renderer();
 
 void graph_reset_renderer();
+void graph_reset_tile(struct RenderTile *t);
 void graph_render_result(SDL_Texture *tex);
 
 void graph_draw(SDL_Renderer *rend);
 
 void graph_use_shader(struct Shader *s);
 
-void graph_render_draw_tri(SDL_Renderer *rend, struct VertFragInfo *points[3]);
-void fill_edges(struct VertFragInfo *va, struct VertFragInfo *vb, RTI *l1, RTI *l2, struct VertFragInfo *verts[3]);
+// Maps clip space to pixels x <= px < x + w, y <= py < y + h, nothing
+// outside them is drawn. Defaults to the whole screen.
+void graph_viewport(int x, int y, int w, int h);
+// One of GRAPH_CULL_*, none by default
+void graph_cull(int faces);
+// Whether front faces wind counterclockwise on screen, the default
+void graph_front_face(bool ccw);
 
-#endif
+// Makes room for ntris triangles interpolating the first ninterp values of
+// their vertices and empties every tile. clip_space is whether vertex
+// positions are in clip space or already on screen.
+void graph_render_begin(size_t ntris, size_t ninterp, bool clip_space);
+// Primitive stage, drops a triangle outside the view, clips it to the near
+// and far planes and the guard band, then adds what's left to the tiles
+void graph_render_bin_tri(struct VertFragInfo *points[3]);
+// Bits for the planes pos is behind
+unsigned graph_render_outcode(vec4 pos, vec4 *planes, int nplanes);
+// Clips the polygon of n vertices against the planes in mask, returns how
+// many vertices are left. New vertices' values come from g_clip_values.
+int graph_render_clip(struct VertFragInfo poly[RENDER_CLIP_VERTS], int n, unsigned mask);
+// Point of the edge from in to out on the plane, computed from the inside
+// vertex so triangles sharing the edge get the same point
+void graph_render_clip_edge(struct VertFragInfo *in, struct VertFragInfo *out, vec4 plane,
+                            struct VertFragInfo *res);
+// Divides by w and maps to the viewport, pos becomes x, y, depth and 1 / w
+void graph_render_viewport(struct VertFragInfo *v);
+// Sets up a triangle on screen and adds it to the tiles its bounding box
+// touches
+void graph_render_add_tri(struct VertFragInfo *points[3]);
+// Snaps positions, culls, sets up edge functions and planes for depth and
+// every interpolated value. Returns false for culled triangles and ones
+// that cover no pixel of the viewport.
+bool graph_render_setup_tri(struct RenderTri *tri, struct VertFragInfo *points[3]);
+void graph_render_plane(struct RenderGradients *g, float v0, float v1, float v2, struct RenderPlane *p);
+// Clears and rasterizes every tile on the pool, returns once all are done
+void graph_render_tiles(bool prepass);
 
+void *graph_render_worker(void *arg);
+// Takes tiles until none are left
+void graph_render_work(int thread);
+void graph_render_tile(struct RenderTile *t, struct Frame *f, bool prepass);
+
+// Covers only the part of tri inside t, skipping blocks outside any edge
+void graph_render_draw_tri(struct RenderTile *t, struct RenderTri *tri, struct Frame *f, DepthPass pass);
+// Tests coverage a row at a time, pixels failing an early depth test
+// never join a packet
+void graph_render_block(struct RenderTile *t, struct RenderTri *tri, struct RenderBlock *b, struct Frame *f,
+                        DepthPass pass);
+// Evaluates every varying's planes straight into the lanes of f
+void shade_packet(struct Packet *pk, struct RenderTri *tri, struct Frame *f, bool late_z);
+
+#endif
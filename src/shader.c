@@ -3,149 +3,801 @@
 #include "attrib.h"
 #include "render.h"
 #include <string.h>
+#include <dlfcn.h>
+#include <unistd.h>
 
-struct VertFragInfo *vfi_alloc(struct Shader *s)
+struct VertFragInfo *vfi_alloc(struct ShaderVariant *sv)
 {
     struct VertFragInfo *vfi = malloc(sizeof(struct VertFragInfo));
-    vfi->outputs = scope_get_vardef_type(s->scope_vert, VAR_OUT, true, &vfi->len);
-
-    struct Node *pos_node = shader_outvar(s, s->scope_vert, "gr_pos");
-    node_to_vec(pos_node->vardef_value, vfi->pos);
+    vfi->values = malloc(sizeof(float) * (sv->nvalues ? sv->nvalues : 1));
 
     return vfi;
 }
 
 void vfi_free(struct VertFragInfo *vfi)
 {
-    for (size_t i = 0; i < vfi->len; ++i)
-        node_free(vfi->outputs[i]);
-
-    free(vfi->outputs);
+    free(vfi->values);
     free(vfi);
 }
 
+void vfi_store(struct ShaderVariant *sv, struct VertFragInfo *vfi)
+{
+    float *slots = sv->frame_vert->slots;
+
+    for (size_t i = 0; i < sv->nvaryings; ++i)
+    {
+        struct ShaderVarying *v = &sv->varyings[i];
+        memcpy(&vfi->values[v->offset], &slots[v->slot_vert], sizeof(float) * v->len);
+    }
+
+    for (size_t i = 0; i < sv->nflats; ++i)
+    {
+        struct ShaderVarying *v = &sv->flats[i];
+        memcpy(&vfi->values[v->offset], &slots[v->slot_vert], sizeof(float) * v->len);
+    }
+
+    // Slots aren't aligned like a vec4
+    if (sv->clip_space)
+    {
+        memcpy(vfi->pos, &slots[sv->pos_slot], sizeof(float) * 4);
+    }
+    else
+    {
+        glm_vec3_copy(&slots[sv->pos_slot], vfi->pos);
+        vfi->pos[3] = 1.f;
+    }
+}
+
 struct Shader *shader_alloc(const char *vert, const char *frag)
+{
+    return shader_alloc_ex(vert, frag, 0);
+}
+
+
+struct Shader *shader_alloc_ex(const char *vert, const char *frag, int flags)
 {
     struct Shader *s = malloc(sizeof(struct Shader));
+    s->flags = flags;
+    s->module = 0;
 
-    s->inputs = 0;
-    s->ninputs = 0;
+    s->arena = arena_alloc();
+    s->root_vert = 0;
+    s->root_frag = 0;
+
+    s->path_vert = strdup(vert);
+    s->path_frag = strdup(frag);
+    s->spec_vert = 0;
+    s->spec_frag = 0;
+
+    int cflags = flags & SHADER_FAST_MATH ? COMPILER_FAST_MATH : 0;
+    const char *cache_dir = getenv(SHADER_CACHE_ENV);
+    s->key = cache_dir ? cache_key(vert, frag, cflags) : 0;
+
+    struct Program *prog_vert, *prog_frag;
+
+    if (cache_dir && cache_load(cache_dir, s->key, &prog_vert, &prog_frag))
+    {
+        shader_setup(s, prog_vert, prog_frag);
+        return s;
+    }
+
+    shader_parse(s, &s->root_vert, &s->root_frag);
+    hoist_stages(s->arena, s->root_vert, s->root_frag);
+
+    prog_vert = compiler_compile(s->root_vert, cflags);
+    prog_frag = compiler_compile(s->root_frag, cflags);
+
+    if (cache_dir)
+        cache_store(cache_dir, s->key, prog_vert, prog_frag);
+
+    shader_setup(s, prog_vert, prog_frag);
+    return s;
+}
+
+
+void shader_alloc_batch(struct ShaderJob *jobs, size_t njobs, int nthreads)
+{
+    if (nthreads <= 0)
+        nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if ((size_t)nthreads > njobs)
+        nthreads = njobs;
+
+    struct ShaderBatch batch = { jobs, njobs, 0 };
+
+    // The calling thread works too
+    pthread_t *threads = malloc(sizeof(pthread_t) * (nthreads ? nthreads : 1));
+    int nstarted = 0;
+
+    for (; nstarted < nthreads - 1; ++nstarted)
+    {
+        if (pthread_create(&threads[nstarted], 0, shader_batch_worker, &batch) != 0)
+            break;
+    }
+
+    shader_batch_worker(&batch);
 
-    s->scope_vert = scope_alloc();
-    s->scope_frag = scope_alloc();
+    for (int i = 0; i < nstarted; ++i)
+        pthread_join(threads[i], 0);
 
-    struct Parser *parser_vert = parser_alloc(vert);
-    s->root_vert = parser_parse(parser_vert);
-    parser_free(parser_vert);
+    free(threads);
+}
+
+
+void *shader_batch_worker(void *arg)
+{
+    struct ShaderBatch *batch = arg;
+
+    for (;;)
+    {
+        size_t i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+        if (i >= batch->njobs) break;
+
+        struct ShaderJob *job = &batch->jobs[i];
+        job->shader = shader_alloc_ex(job->vert, job->frag, job->flags);
+    }
+
+    return 0;
+}
+
+
+struct Shader *shader_load(const char *path, int flags)
+{
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+
+    if (!handle)
+    {
+        fprintf(stderr, "[shader_load] Error: %s.\n", dlerror());
+        exit(EXIT_FAILURE);
+    }
+
+    const struct Module *m = dlsym(handle, MODULE_SYMBOL);
+
+    if (!m || m->version != MODULE_VERSION)
+    {
+        fprintf(stderr, "[shader_load] Error: '%s' is not a shader module built by this version of grslc.\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    if (m->vert.width != 1 || m->frag.width != VM_PACKET_W)
+    {
+        fprintf(stderr, "[shader_load] Error: '%s' was built for %zu wide packets, expected %d.\n",
+                path, m->frag.width, VM_PACKET_W);
+        exit(EXIT_FAILURE);
+    }
+
+    struct Shader *s = malloc(sizeof(struct Shader));
+    s->flags = flags;
+    s->module = handle;
 
-    struct Parser *parser_frag = parser_alloc(frag);
-    s->root_frag = parser_parse(parser_frag);
-    parser_free(parser_frag);
+    s->arena = arena_alloc();
+    s->root_vert = 0;
+    s->root_frag = 0;
 
-    visitor_ignore_fdefs(false);
-    visitor_bind_scope(s->scope_vert);
-    visitor_visit(s->root_vert);
+    // Modules have no sources to specialize
+    s->path_vert = 0;
+    s->path_frag = 0;
+    s->spec_vert = 0;
+    s->spec_frag = 0;
+    s->key = 0;
 
-    visitor_bind_scope(s->scope_frag);
-    visitor_visit(s->root_frag);
-    visitor_ignore_fdefs(true);
+    shader_setup(s, program_load(&m->vert), program_load(&m->frag));
 
-    s->main_call = node_alloc(NODE_FUNC_CALL);
-    s->main_call->call_name = strdup("main");
+    s->active->frame_vert->native = m->vert.run;
+    s->active->frame_frag->native = m->frag.run;
 
     return s;
 }
 
 
+void shader_setup(struct Shader *s, struct Program *vert, struct Program *frag)
+{
+    s->inputs = 0;
+    s->ninputs = 0;
+
+    s->specs = 0;
+    s->nspecs = 0;
+    s->nspec_values = 0;
+
+    s->variants = malloc(sizeof(struct ShaderVariant*));
+    s->variants[0] = variant_alloc(s, vert, frag);
+    s->nvariants = 1;
+    s->active = s->variants[0];
+
+    pthread_mutex_init(&s->lock, 0);
+    s->reloader = 0;
+}
+
+
 void shader_free(struct Shader *s)
 {
-    scope_free(s->scope_vert);
-    node_free(s->root_vert);
+    // Nothing may touch the shader once the reload thread is gone
+    if (s->reloader)
+        reload_free(s->reloader);
+
+    arena_free(s->arena);
 
-    scope_free(s->scope_frag);
-    node_free(s->root_frag);
+    for (size_t i = 0; i < s->nvariants; ++i)
+        variant_free(s->variants[i]);
+
+    free(s->variants);
+
+    shader_clear_inputs(s);
 
-    node_free(s->main_call);
+    for (size_t i = 0; i < s->nspecs; ++i)
+        free(s->specs[i].name);
+
+    free(s->specs);
+    free(s->path_vert);
+    free(s->path_frag);
+
+    pthread_mutex_destroy(&s->lock);
+
+    // Programs hold copies, nothing points into the module anymore
+    if (s->module)
+        dlclose(s->module);
 
     free(s);
 }
 
 
+void shader_parse(struct Shader *s, struct Node **vert, struct Node **frag)
+{
+    *vert = shader_parse_stage(s->arena, parser_alloc(s->path_vert, s->arena));
+    *frag = shader_parse_stage(s->arena, parser_alloc(s->path_frag, s->arena));
+}
+
+
+struct Node *shader_parse_stage(struct Arena *a, struct Parser *p)
+{
+    struct Node *root = parser_parse(p);
+    parser_free(p);
+
+    sema_check(root);
+    inliner_inline(a, root);
+
+    return root;
+}
+
+
+struct ShaderVariant *variant_alloc(struct Shader *s, struct Program *vert, struct Program *frag)
+{
+    struct ShaderVariant *sv = malloc(sizeof(struct ShaderVariant));
+    sv->values = 0;
+
+    sv->prog_vert = vert;
+    sv->prog_frag = frag;
+
+    sv->frame_vert = frame_alloc(vert, 1);
+    sv->frame_frag = frame_alloc(frag, VM_PACKET_W);
+
+    sv->jit_vert = 0;
+    sv->jit_frag = 0;
+
+    // Stays interpreted where there's no native backend
+    if (s->flags & SHADER_JIT)
+    {
+        sv->jit_vert = jit_compile(vert, sv->frame_vert->width);
+        sv->jit_frag = jit_compile(frag, sv->frame_frag->width);
+    }
+
+    sv->frame_vert->jit = sv->jit_vert;
+    sv->frame_frag->jit = sv->jit_frag;
+
+    sv->thread_frames = 0;
+    sv->nthread_frames = 0;
+
+    shader_link(sv);
+
+    // Sized by the varying layout
+    for (int i = 0; i < 3; ++i)
+        sv->verts[i] = vfi_alloc(sv);
+
+    return sv;
+}
+
+
+void variant_free(struct ShaderVariant *sv)
+{
+    for (int i = 0; i < 3; ++i)
+        vfi_free(sv->verts[i]);
+
+    frame_free(sv->frame_vert);
+    frame_free(sv->frame_frag);
+
+    for (size_t i = 0; i < sv->nthread_frames; ++i)
+        frame_free(sv->thread_frames[i]);
+
+    free(sv->thread_frames);
+
+    if (sv->jit_vert) jit_free(sv->jit_vert);
+    if (sv->jit_frag) jit_free(sv->jit_frag);
+
+    program_free(sv->prog_vert);
+    program_free(sv->prog_frag);
+
+    free(sv->varyings);
+    free(sv->flats);
+    free(sv->values);
+    free(sv);
+}
+
+
+void variant_thread_frames(struct ShaderVariant *sv, size_t n)
+{
+    if (n > sv->nthread_frames)
+    {
+        sv->thread_frames = realloc(sv->thread_frames, sizeof(struct Frame*) * n);
+
+        for (size_t i = sv->nthread_frames; i < n; ++i)
+        {
+            struct Frame *f = frame_alloc(sv->prog_frag, sv->frame_frag->width);
+            f->jit = sv->frame_frag->jit;
+            f->native = sv->frame_frag->native;
+
+            sv->thread_frames[i] = f;
+        }
+
+        sv->nthread_frames = n;
+    }
+
+    size_t size = sizeof(float) * sv->prog_frag->nslots * sv->frame_frag->width;
+
+    for (size_t i = 0; i < n; ++i)
+        memcpy(sv->thread_frames[i]->slots, sv->frame_frag->slots, size);
+}
+
+
+void shader_specialize(struct Shader *s, const char *name)
+{
+    if (!s->path_vert)
+    {
+        fprintf(stderr, "[shader_specialize] Error: Shaders loaded from modules can't be specialized.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < s->nspecs; ++i)
+    {
+        if (strcmp(s->specs[i].name, name) == 0)
+            return;
+    }
+
+    // Types come from the generic variant, which declares every in variable
+    struct ShaderVariant *sv = s->variants[0];
+    struct ProgramVar *var = program_find_var(sv->prog_vert, name, VAR_IN);
+
+    if (!var)
+        var = program_find_var(sv->prog_frag, name, VAR_IN);
+
+    if (!var || program_find_var(sv->prog_vert, name, VAR_OUT))
+    {
+        fprintf(stderr, "[shader_specialize] Error: '%s' is not an in variable set by inputs.\n", name);
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_mutex_lock(&s->lock);
+
+    // Variants compiled so far lack the new constant's value
+    for (size_t i = 1; i < s->nvariants; ++i)
+        variant_free(s->variants[i]);
+
+    s->nvariants = 1;
+    s->active = s->variants[0];
+
+    s->specs = realloc(s->specs, sizeof(struct ShaderSpec) * ++s->nspecs);
+    s->specs[s->nspecs - 1] = (struct ShaderSpec){ strdup(name), var->type, var->len };
+    s->nspec_values += var->len;
+
+    pthread_mutex_unlock(&s->lock);
+    shader_resolve_inputs(s);
+}
+
+
+void shader_select_variant(struct Shader *s)
+{
+    if (!s->nspecs) return;
+
+    float *values = malloc(sizeof(float) * s->nspec_values);
+    size_t offset = 0;
+    bool all = true;
+
+    for (size_t i = 0; i < s->nspecs; ++i)
+    {
+        struct ShaderSpec *spec = &s->specs[i];
+        struct ShaderInput *input = shader_find_input(s, spec->name);
+
+        if (!input)
+        {
+            all = false;
+            break;
+        }
+
+        if (input->type != spec->type || input->len != spec->len)
+        {
+            fprintf(stderr, "[shader_select_variant] Error: Input '%s' does not match the type of its in "
+                    "variable.\n", spec->name);
+            exit(EXIT_FAILURE);
+        }
+
+        memcpy(&values[offset], input->values, sizeof(float) * spec->len);
+        offset += spec->len;
+    }
+
+    struct ShaderVariant *sv = s->variants[0];
+
+    if (all)
+    {
+        sv = shader_find_variant(s, values);
+
+        if (!sv)
+            sv = shader_compile_variant(s, values);
+    }
+
+    free(values);
+
+    // Inputs were resolved against the variant active when they were added
+    if (sv != s->active)
+    {
+        s->active = sv;
+        shader_resolve_inputs(s);
+    }
+}
+
+
+struct ShaderVariant *shader_find_variant(struct Shader *s, const float *values)
+{
+    for (size_t i = 1; i < s->nvariants; ++i)
+    {
+        if (memcmp(s->variants[i]->values, values, sizeof(float) * s->nspec_values) == 0)
+            return s->variants[i];
+    }
+
+    return 0;
+}
+
+
+struct ShaderVariant *shader_compile_variant(struct Shader *s, const float *values)
+{
+    uint64_t key = shader_variant_key(s, values);
+    const char *cache_dir = key ? getenv(SHADER_CACHE_ENV) : 0;
+
+    struct Program *prog_vert, *prog_frag;
+
+    if (!cache_dir || !cache_load(cache_dir, key, &prog_vert, &prog_frag))
+    {
+        if (!s->spec_vert)
+            shader_parse(s, &s->spec_vert, &s->spec_frag);
+
+        shader_compile_stages(s, s->spec_vert, s->spec_frag, values, &prog_vert, &prog_frag);
+
+        if (cache_dir)
+            cache_store(cache_dir, key, prog_vert, prog_frag);
+    }
+
+    struct ShaderVariant *sv = variant_alloc(s, prog_vert, prog_frag);
+    sv->values = malloc(sizeof(float) * s->nspec_values);
+    memcpy(sv->values, values, sizeof(float) * s->nspec_values);
+
+    pthread_mutex_lock(&s->lock);
+    s->variants = realloc(s->variants, sizeof(struct ShaderVariant*) * ++s->nvariants);
+    s->variants[s->nvariants - 1] = sv;
+    pthread_mutex_unlock(&s->lock);
+
+    return sv;
+}
+
+
+uint64_t shader_variant_key(struct Shader *s, const float *values)
+{
+    // Sources hashed while the cache was off would share keys with every
+    // other such shader
+    if (!s->key)
+        return 0;
+
+    // Values alone would match those of other inputs specialized alike
+    uint64_t key = s->key;
+
+    for (size_t i = 0; i < s->nspecs; ++i)
+    {
+        struct ShaderSpec *spec = &s->specs[i];
+        int32_t type = spec->type;
+        uint64_t len = spec->len;
+
+        key = cache_hash(key, spec->name, strlen(spec->name) + 1);
+        key = cache_hash(key, &type, sizeof(type));
+        key = cache_hash(key, &len, sizeof(len));
+    }
+
+    return cache_hash(key, values, sizeof(float) * s->nspec_values);
+}
+
+
+void shader_compile_stages(struct Shader *s, struct Node *vert, struct Node *frag, const float *values,
+                           struct Program **prog_vert, struct Program **prog_frag)
+{
+    // The optimizer rewrites trees in place, every compile gets a copy
+    vert = node_copy(s->arena, vert);
+    frag = node_copy(s->arena, frag);
+
+    if (values)
+    {
+        for (size_t i = 0, offset = 0; i < s->nspecs; offset += s->specs[i++].len)
+        {
+            shader_bind_spec(s->arena, vert, &s->specs[i], &values[offset]);
+            shader_bind_spec(s->arena, frag, &s->specs[i], &values[offset]);
+        }
+
+        // Folded before hoisting, which only moves work it sees is uniform
+        optimizer_optimize(vert);
+        optimizer_optimize(frag);
+    }
+
+    hoist_stages(s->arena, vert, frag);
+
+    int cflags = s->flags & SHADER_FAST_MATH ? COMPILER_FAST_MATH : 0;
+    *prog_vert = compiler_compile(vert, cflags);
+    *prog_frag = compiler_compile(frag, cflags);
+}
+
+
+void shader_watch(struct Shader *s)
+{
+    if (!s->path_vert)
+    {
+        fprintf(stderr, "[shader_watch] Error: Shaders loaded from modules have no sources to watch.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (s->reloader) return;
+
+    // Reloads only parse the stages that changed and reuse these otherwise
+    if (!s->spec_vert)
+        shader_parse(s, &s->spec_vert, &s->spec_frag);
+
+    s->reloader = reload_alloc(s);
+}
+
+
+void shader_bind_spec(struct Arena *a, struct Node *root, struct ShaderSpec *spec, const float *values)
+{
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+        if (n->type != NODE_VARDEF || n->vardef.modifier != VAR_IN || strcmp(n->vardef.name, spec->name) != 0)
+            continue;
+
+        // A global nothing assigns to, the optimizer folds it into its readers
+        struct Node *value = node_alloc(a, spec->type);
+
+        if (spec->type == NODE_INT)
+            value->int_value = values[0];
+        else if (spec->type == NODE_FLOAT)
+            value->float_value = values[0];
+        else
+        {
+            value->vec.len = spec->len;
+            memcpy(value->vec.values, values, sizeof(float) * spec->len);
+        }
+
+        n->vardef.modifier = VAR_REG;
+        n->vardef.value = value;
+    }
+}
+
+
+void shader_link(struct ShaderVariant *sv)
+{
+    struct ProgramVar *pos = shader_outvar(sv->prog_vert, "gr_pos", NODE_VEC, 3);
+    sv->pos_slot = pos->slot;
+    sv->clip_space = pos->len == 4;
+
+    sv->color_slot = shader_outvar(sv->prog_frag, "gr_color", NODE_VEC, 3)->slot;
+
+    sv->depth_slot = -1;
+
+    if (program_find_var(sv->prog_frag, "gr_depth", VAR_OUT))
+        sv->depth_slot = shader_outvar(sv->prog_frag, "gr_depth", NODE_FLOAT, 1)->slot;
+
+    sv->varyings = 0;
+    sv->nvaryings = 0;
+
+    sv->flats = 0;
+    sv->nflats = 0;
+
+    for (size_t i = 0; i < sv->prog_vert->nvars; ++i)
+    {
+        struct ProgramVar *out = &sv->prog_vert->vars[i];
+        if (out->modifier != VAR_OUT) continue;
+
+        struct ProgramVar *in = program_find_var(sv->prog_frag, out->name, VAR_IN);
+        if (!in) continue;
+
+        if (in->type != out->type || in->len != out->len)
+        {
+            fprintf(stderr, "[shader_link] Error: Vertex output '%s' does not match fragment input type.\n",
+                    out->name);
+            exit(EXIT_FAILURE);
+        }
+
+        struct ShaderVarying v = { out->slot, in->slot, out->len, 0 };
+
+        if (in->uniform)
+            shader_add_varying(&sv->flats, &sv->nflats, v);
+        else
+            shader_add_varying(&sv->varyings, &sv->nvaryings, v);
+    }
+
+    // Interpolated values first, each vertex stores only what's read
+    sv->nvalues = 0;
+    sv->nvaryings = shader_pack_varyings(sv->varyings, sv->nvaryings, &sv->nvalues);
+    sv->ninterp = sv->nvalues;
+    sv->nflats = shader_pack_varyings(sv->flats, sv->nflats, &sv->nvalues);
+}
+
+
+void shader_add_varying(struct ShaderVarying **list, size_t *n, struct ShaderVarying v)
+{
+    *list = realloc(*list, sizeof(struct ShaderVarying) * ++*n);
+
+    size_t i = *n - 1;
+
+    for (; i > 0 && (*list)[i - 1].slot_frag > v.slot_frag; --i)
+        (*list)[i] = (*list)[i - 1];
+
+    (*list)[i] = v;
+}
+
+
+size_t shader_pack_varyings(struct ShaderVarying *list, size_t n, size_t *offset)
+{
+    size_t kept = 0;
+
+    for (size_t i = 0; i < n; ++i)
+    {
+        struct ShaderVarying *last = kept ? &list[kept - 1] : 0;
+        struct ShaderVarying v = list[i];
+
+        if (last && last->slot_vert + (int)last->len == v.slot_vert &&
+            last->slot_frag + (int)last->len == v.slot_frag)
+        {
+            last->len += v.len;
+        }
+        else
+        {
+            v.offset = *offset;
+            list[kept++] = v;
+        }
+
+        *offset += v.len;
+    }
+
+    return kept;
+}
+
+
 void shader_run_vert(struct Shader *s, SDL_Renderer *rend)
 {
     struct Buffer *buf = graph_buffer_bound();
     struct AttribLayout *atl = graph_atl_bound();
 
+    // Between frames, so a draw never mixes old and new programs
+    if (s->reloader)
+        reload_apply(s->reloader);
+
+    shader_select_variant(s);
+    struct ShaderVariant *sv = s->active;
+
+    struct Frame *f = sv->frame_vert;
+
+    shader_check_layout(s, atl);
+    shader_insert_runtime_inputs(s, sv->frame_vert);
+    shader_insert_runtime_inputs(s, sv->frame_frag);
+
+    vm_exec(f, f->prog->uniform);
+
+    graph_render_begin((buf->data_len + atl->stride * 3 - 1) / (atl->stride * 3), sv->ninterp, sv->clip_space);
+    shader_draw_tris(s);
+
+    // Depth of every triangle first, so shading only reaches visible pixels
+    graph_render_tiles(buf->depth_prepass && !shader_late_z(s));
+
+    shader_clear_inputs(s);
+}
+
+
+void shader_draw_tris(struct Shader *s)
+{
+    struct Buffer *buf = graph_buffer_bound();
+    struct AttribLayout *atl = graph_atl_bound();
+
+    struct ShaderVariant *sv = s->active;
+    struct Frame *f = sv->frame_vert;
     float *start = buf->data;
 
     size_t i = 0;
     while (i < buf->data_len)
     {
-        struct VertFragInfo *verts[3];
-
         for (int j = 0; j < 3; ++j)
         {
             // Vertex shader
-            visitor_bind_scope(s->scope_vert);
-            scope_clear_vardefs(s->scope_vert);
-            visitor_visit(s->root_vert);
-
+            frame_reset(f);
             shader_insert_layout_vars(s, start);
-            shader_insert_runtime_inputs(s);
-            visitor_visit(s->main_call);
 
-            verts[j] = vfi_alloc(s);
+            vm_exec(f, f->prog->init);
+            vm_exec(f, f->prog->entry);
+
+            vfi_store(sv, sv->verts[j]);
             start += atl->stride;
         }
 
-        graph_render_draw_tri(rend, verts);
+        // Flat varyings are known once the first vertex ran
+        if (i == 0)
+        {
+            for (size_t k = 0; k < sv->nflats; ++k)
+            {
+                struct ShaderVarying *v = &sv->flats[k];
+                frame_store(sv->frame_frag, v->slot_frag, &sv->verts[0]->values[v->offset], v->len);
+            }
 
-        for (int j = 0; j < 3; ++j)
-            vfi_free(verts[j]);
+            vm_exec(sv->frame_frag, sv->prog_frag->uniform);
+        }
 
+        graph_render_bin_tri(sv->verts);
         i += atl->stride * 3;
     }
+}
 
-    shader_clear_inputs(s);
+
+bool shader_late_z(struct Shader *s)
+{
+    return s->flags & SHADER_LATE_Z || s->active->depth_slot != -1;
 }
 
 
-void shader_run_frag(struct Shader *s)
+void shader_run_frag(struct Frame *f)
 {
-    // Inputs are already refreshed, no need to clear
+    frame_reset(f);
+    vm_exec(f, f->prog->init);
+    vm_exec(f, f->prog->entry);
+}
 
-    visitor_bind_scope(s->scope_frag);
-    scope_clear_vardefs(s->scope_frag);
-    visitor_visit(s->root_frag);
 
-    shader_insert_runtime_inputs(s);
-    visitor_visit(s->main_call);
+void shader_insert_runtime_inputs(struct Shader *s, struct Frame *f)
+{
+    for (size_t i = 0; i < s->ninputs; ++i)
+    {
+        struct ShaderInput *input = &s->inputs[i];
+        int slot = f == s->active->frame_vert ? input->slot_vert : input->slot_frag;
+
+        if (slot != -1)
+            frame_store(f, slot, input->values, input->len);
+    }
 }
 
 
-void shader_insert_runtime_inputs(struct Shader *s)
+void shader_check_layout(struct Shader *s, struct AttribLayout *atl)
 {
-    struct Scope *scope = visitor_scope_bound();
-    struct ScopeLayer *layer = &scope->layers[0];
+    struct Program *p = s->active->prog_vert;
 
-    for (size_t i = 0; i < layer->nvardefs; ++i)
+    for (size_t i = 0; i < p->nvars; ++i)
     {
-        struct Node *def = layer->vardefs[i];
+        struct ProgramVar *var = &p->vars[i];
+        if (var->modifier != VAR_LAYOUT) continue;
 
-        if (def->vardef_modifier == VAR_IN)
+        if (var->layout_loc < 0 || (size_t)var->layout_loc >= atl->len)
         {
-            for (size_t j = 0; j < s->ninputs; ++j)
-            {
-                struct Node *input = s->inputs[j];
+            fprintf(stderr, "[shader_check_layout] Error: Layout location %d of '%s' is not in the attrib "
+                    "layout.\n", var->layout_loc, var->name);
+            exit(EXIT_FAILURE);
+        }
 
-                if (strcmp(def->vardef_name, input->vardef_name) == 0)
-                {
-                    node_free(def->vardef_value);
-                    def->vardef_value = node_copy(input->vardef_value);
+        struct AttribLayoutElement *atle = &atl->layout[var->layout_loc];
 
-                    break;
-                }
-            }
+        if (var->len != atle->count)
+        {
+            fprintf(stderr, "[shader_check_layout] Error: Variable vector length (%zu) "
+                    "does not match attrib layout count (%d).\n", var->len, atle->count);
+            exit(EXIT_FAILURE);
         }
     }
 }
@@ -153,35 +805,18 @@ void shader_insert_runtime_inputs(struct Shader *s)
 
 void shader_insert_layout_vars(struct Shader *s, float *start)
 {
-    struct Scope *scope = visitor_scope_bound();
-    struct ScopeLayer *layer = &scope->layers[0];
-
+    struct Program *p = s->active->prog_vert;
+    float *slots = s->active->frame_vert->slots;
     struct AttribLayout *atl = graph_atl_bound();
 
-    for (size_t i = 0; i < layer->nvardefs; ++i)
+    for (size_t i = 0; i < p->nvars; ++i)
     {
-        struct Node *def = layer->vardefs[i];
+        struct ProgramVar *var = &p->vars[i];
 
-        if (def->vardef_modifier == VAR_LAYOUT)
+        if (var->modifier == VAR_LAYOUT)
         {
-            struct AttribLayoutElement *atle = &atl->layout[def->vardef_layout_loc];
-            float *begin = start + atle->offset;
-
-            if (def->vardef_value->vec_len != atle->count)
-            {
-                fprintf(stderr, "[shader_insert_layout_vars] Error: Variable vector length (%zu) "
-                        "does not match attrib layout count (%d).\n", def->vardef_value->vec_len, atle->count);
-                exit(EXIT_FAILURE);
-            }
-
-            for (int j = 0; j < atle->count; ++j)
-            {
-                struct Node *n = node_alloc(NODE_FLOAT);
-                n->float_value = begin[j];
-
-                node_free(def->vardef_value->vec_tree_values[j]);
-                def->vardef_value->vec_tree_values[j] = n;
-            }
+            struct AttribLayoutElement *atle = &atl->layout[var->layout_loc];
+            memcpy(&slots[var->slot], start + atle->offset, sizeof(float) * atle->count);
         }
     }
 }
@@ -189,55 +824,89 @@ void shader_insert_layout_vars(struct Shader *s, float *start)
 
 void shader_add_input_int(struct Shader *s, const char *name, int i)
 {
-    struct Node *n = shader_new_input(s, name, NODE_INT);
-    n->vardef_value = node_alloc(NODE_INT);
-    n->vardef_value->int_value = i;
+    struct ShaderInput *input = shader_new_input(s, name, NODE_INT, 1);
+    input->values[0] = i;
 }
 
 
 void shader_add_input_vec(struct Shader *s, const char *name, float *v, size_t len)
 {
-    struct Node *n = shader_new_input(s, name, NODE_VEC);
-    n->vardef_value = node_alloc(NODE_VEC);
+    struct ShaderInput *input = shader_new_input(s, name, NODE_VEC, len);
+    memcpy(input->values, v, sizeof(float) * len);
+}
+
+
+void shader_add_input_float(struct Shader *s, const char *name, float f)
+{
+    struct ShaderInput *input = shader_new_input(s, name, NODE_FLOAT, 1);
+    input->values[0] = f;
+}
 
-    n->vardef_value->vec_len = len;
-    n->vardef_value->vec_tree_values = malloc(sizeof(struct Node*) * len);
 
-    for (size_t i = 0; i < len; ++i)
+int shader_input_slot(struct Program *p, const char *name, NodeType type, size_t len)
+{
+    struct ProgramVar *var = program_find_var(p, name, VAR_IN);
+    if (!var) return -1;
+
+    if (var->type != type || var->len != len)
     {
-        struct Node *num = node_alloc(NODE_FLOAT);
-        num->float_value = v[i];
-        n->vardef_value->vec_tree_values[i] = num;
+        fprintf(stderr, "[shader_new_input] Error: Input '%s' does not match the type of its in variable.\n",
+                name);
+        exit(EXIT_FAILURE);
     }
+
+    return var->slot;
 }
 
 
-void shader_add_input_float(struct Shader *s, const char *name, float f)
+struct ShaderInput *shader_new_input(struct Shader *s, const char *name, NodeType type, size_t len)
 {
-    struct Node *n = shader_new_input(s, name, NODE_FLOAT);
-    n->vardef_value = node_alloc(NODE_FLOAT);
-    n->vardef_value->float_value = f;
+    s->inputs = realloc(s->inputs, sizeof(struct ShaderInput) * ++s->ninputs);
+
+    struct ShaderInput *input = &s->inputs[s->ninputs - 1];
+    input->name = strdup(name);
+    input->type = type;
+    input->values = malloc(sizeof(float) * len);
+    input->len = len;
+
+    // Names are only looked up here, never per invocation
+    input->slot_vert = shader_input_slot(s->active->prog_vert, name, type, len);
+    input->slot_frag = shader_input_slot(s->active->prog_frag, name, type, len);
+
+    return input;
 }
 
 
-struct Node *shader_new_input(struct Shader *s, const char *name, int type)
+struct ShaderInput *shader_find_input(struct Shader *s, const char *name)
 {
-    s->inputs = realloc(s->inputs, sizeof(struct Node*) * ++s->ninputs);
-    s->inputs[s->ninputs - 1] = node_alloc(NODE_VARDEF);
+    for (size_t i = s->ninputs; i > 0; --i)
+    {
+        if (strcmp(s->inputs[i - 1].name, name) == 0)
+            return &s->inputs[i - 1];
+    }
 
-    struct Node *n = s->inputs[s->ninputs - 1];
-    n->vardef_type = type;
-    n->vardef_name = strdup(name);
-    n->vardef_modifier = VAR_REG;
+    return 0;
+}
 
-    return n;
+
+void shader_resolve_inputs(struct Shader *s)
+{
+    for (size_t i = 0; i < s->ninputs; ++i)
+    {
+        struct ShaderInput *input = &s->inputs[i];
+        input->slot_vert = shader_input_slot(s->active->prog_vert, input->name, input->type, input->len);
+        input->slot_frag = shader_input_slot(s->active->prog_frag, input->name, input->type, input->len);
+    }
 }
 
 
 void shader_clear_inputs(struct Shader *s)
 {
     for (size_t i = 0; i < s->ninputs; ++i)
-        node_free(s->inputs[i]);
+    {
+        free(s->inputs[i].name);
+        free(s->inputs[i].values);
+    }
 
     free(s->inputs);
 
@@ -246,18 +915,16 @@ void shader_clear_inputs(struct Shader *s)
 }
 
 
-struct Node *shader_outvar(struct Shader *s, struct Scope *scope, const char *name)
+struct ProgramVar *shader_outvar(struct Program *p, const char *name, NodeType type, size_t len)
 {
-    struct ScopeLayer *layer = &scope->layers[0];
+    struct ProgramVar *var = program_find_var(p, name, VAR_OUT);
 
-    for (size_t i = 0; i < layer->nvardefs; ++i)
+    if (!var || var->type != type || var->len < len)
     {
-        struct Node *def = layer->vardefs[i];
-
-        if (strcmp(def->vardef_name, name) == 0 && def->vardef_modifier == VAR_OUT)
-            return layer->vardefs[i];
+        fprintf(stderr, "[shader_outvar] Error: Shader has no out variable '%s' with at least %zu components.\n",
+                name, len);
+        exit(EXIT_FAILURE);
     }
 
-    return 0;
+    return var;
 }
-
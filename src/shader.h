@@ -1,47 +1,263 @@
 #ifndef SHADER_H
 #define SHADER_H
 
-#include "shaderlang/visitor.h"
+#include "shaderlang/parser.h"
+#include "shaderlang/compiler.h"
+#include "shaderlang/sema.h"
+#include "shaderlang/inliner.h"
+#include "shaderlang/hoist.h"
+#include "shaderlang/optimizer.h"
+#include "shaderlang/vm.h"
+#include "shaderlang/jit.h"
+#include "shaderlang/cache.h"
+#include "attrib.h"
+#include "reload.h"
 #include <limits.h>
+#include <pthread.h>
 #include <SDL2/SDL.h>
 
+// Compile both stages to native code where supported
+#define SHADER_JIT 1
+// Approximate sqrt, inversesqrt, sin, cos and the functions built on them,
+// error bounds are in shaderlang/mathlib.h
+#define SHADER_FAST_MATH 2
+// Test depth after shading even when the fragment stage doesn't write
+// gr_depth
+#define SHADER_LATE_Z 4
+
+// Directory compiled shaders are cached in, keyed by a hash of both
+// sources, skips parsing and compiling when set and the entry exists
+#define SHADER_CACHE_ENV "GRAPH_SHADER_CACHE"
+
 struct VertFragInfo
 {
-    vec3 pos;
+    // Clip space position, or screen position with w = 1 when gr_pos is a
+    // vec3
+    vec4 pos;
+
+    // Varyings and flats of one vertex, packed as laid out by shader_link
+    float *values;
+};
+
+struct ShaderInput
+{
+    char *name;
+    NodeType type;
+
+    float *values;
+    size_t len;
+
+    // Slot in each stage, -1 if the stage has no such in variable
+    int slot_vert, slot_frag;
+};
+
+// Vertex out variables feeding fragment in variables, adjacent pairs are
+// merged into one run
+struct ShaderVarying
+{
+    int slot_vert, slot_frag;
+    size_t len;
+
+    // Index into VertFragInfo values
+    size_t offset;
+};
+
+// Compiled programs for one set of specialization constant values and
+// everything derived from them
+struct ShaderVariant
+{
+    // Values of every specialization constant in declaration order, 0 for
+    // the generic variant
+    float *values;
+
+    struct Program *prog_vert, *prog_frag;
+    // Vertices run one at a time, fragments in packets
+    struct Frame *frame_vert, *frame_frag;
+    struct Jit *jit_vert, *jit_frag;
+
+    // Copies of frame_frag, one per rendering thread
+    struct Frame **thread_frames;
+    size_t nthread_frames;
+
+    // Reused for every triangle
+    struct VertFragInfo *verts[3];
+
+    struct ShaderVarying *varyings;
+    size_t nvaryings;
+
+    // Varyings every vertex agrees on, copied once per draw instead of
+    // interpolated
+    struct ShaderVarying *flats;
+    size_t nflats;
 
-    struct Node **outputs;
+    // Floats each vertex keeps for the fragment stage, the first ninterp
+    // are interpolated and the rest flat
+    size_t nvalues, ninterp;
+
+    // gr_pos in the vertex stage and gr_color in the fragment stage
+    int pos_slot, color_slot;
+    // gr_pos is a vec4 in clip space, otherwise a vec3 already on screen
+    bool clip_space;
+    // Optional gr_depth out float of the fragment stage replacing the
+    // interpolated depth, -1 if not written
+    int depth_slot;
+};
+
+// In variable compiled into the shader as a constant
+struct ShaderSpec
+{
+    char *name;
+    NodeType type;
     size_t len;
 };
 
+// One shader of a batch, shader is set once the batch is done
+struct ShaderJob
+{
+    const char *vert, *frag;
+    int flags;
+
+    struct Shader *shader;
+};
+
+// Jobs shared by the workers of shader_alloc_batch
+struct ShaderBatch
+{
+    struct ShaderJob *jobs;
+    size_t njobs;
+
+    // Next job to take, advanced atomically
+    size_t next;
+};
+
 struct Shader
 {
-    struct Scope *scope_vert, *scope_frag;
+    // Storage for all syntax trees
+    struct Arena *arena;
     struct Node *root_vert, *root_frag;
+    int flags;
+
+    // Sources variants are compiled from, 0 when loaded from a module
+    char *path_vert, *path_frag;
+    // Checked and inlined trees every variant starts as a copy of, parsed
+    // when the first variant is compiled
+    struct Node *spec_vert, *spec_frag;
+    // Disk cache key of the sources, see SHADER_CACHE_ENV
+    uint64_t key;
+
+    // dlopen handle when loaded from a grslc module
+    void *module;
 
-    struct Node **inputs;
+    struct ShaderInput *inputs;
     size_t ninputs;
 
-    struct Node *main_call;
+    struct ShaderSpec *specs;
+    size_t nspecs;
+    // Floats every variant's values hold
+    size_t nspec_values;
+
+    // The generic variant reads every in variable and comes first
+    struct ShaderVariant **variants;
+    size_t nvariants;
+    struct ShaderVariant *active;
+
+    // Held while specs, variants or the trees above change, so the reload
+    // thread sees them consistently
+    pthread_mutex_t lock;
+
+    // Set by shader_watch
+    struct Reloader *reloader;
 };
 
-struct VertFragInfo *vfi_alloc(struct Shader *s);
+struct VertFragInfo *vfi_alloc(struct ShaderVariant *sv);
 void vfi_free(struct VertFragInfo *vfi);
 
+// Copies the vertex stage's results into vfi
+void vfi_store(struct ShaderVariant *sv, struct VertFragInfo *vfi);
+
 struct Shader *shader_alloc(const char *vert, const char *frag);
+// flags is a combination of SHADER_* flags, reuses and fills the cache
+// named by SHADER_CACHE_ENV
+struct Shader *shader_alloc_ex(const char *vert, const char *frag, int flags);
+// Compiles every job on nthreads threads, or one per core when 0. Shaders
+// share no compiler state, so they compile independently.
+void shader_alloc_batch(struct ShaderJob *jobs, size_t njobs, int nthreads);
+// Thread entry point, takes jobs off a struct ShaderBatch until none are left
+void *shader_batch_worker(void *arg);
+// Uses a module built by grslc instead of compiling sources
+struct Shader *shader_load(const char *path, int flags);
+// Inputs and the generic variant once both programs exist
+void shader_setup(struct Shader *s, struct Program *vert, struct Program *frag);
 void shader_free(struct Shader *s);
+// Parses, checks and inlines both sources into trees in the arena
+void shader_parse(struct Shader *s, struct Node **vert, struct Node **frag);
+// Same for one stage, frees p
+struct Node *shader_parse_stage(struct Arena *a, struct Parser *p);
+// Recompiles whenever a source file changes, see reload.h
+void shader_watch(struct Shader *s);
+
+// Frames and linking for a pair of programs, which the variant takes
+struct ShaderVariant *variant_alloc(struct Shader *s, struct Program *vert, struct Program *frag);
+void variant_free(struct ShaderVariant *sv);
+// Makes sure there are n thread frames, each holding what frame_frag does
+// once the draw's inputs and uniforms are in it
+void variant_thread_frames(struct ShaderVariant *sv, size_t n);
+
+// Declares the in variable name a specialization constant. Every draw
+// that sets it as an input runs a variant compiled with its value folded
+// in, draws that don't run the generic variant.
+void shader_specialize(struct Shader *s, const char *name);
+// Picks the variant for the current inputs, compiling it on first use
+void shader_select_variant(struct Shader *s);
+struct ShaderVariant *shader_find_variant(struct Shader *s, const float *values);
+struct ShaderVariant *shader_compile_variant(struct Shader *s, const float *values);
+// Disk cache key of the variant for values, 0 if the shader has none
+uint64_t shader_variant_key(struct Shader *s, const float *values);
+// Compiles copies of checked and inlined trees, specialized when values
+// isn't 0
+void shader_compile_stages(struct Shader *s, struct Node *vert, struct Node *frag, const float *values,
+                           struct Program **prog_vert, struct Program **prog_frag);
+// Turns the in variable of spec in root into a plain global holding values
+void shader_bind_spec(struct Arena *a, struct Node *root, struct ShaderSpec *spec, const float *values);
 
+// Resolves names shared between stages and the renderer once, and packs
+// the varyings the fragment stage reads
+void shader_link(struct ShaderVariant *sv);
+// Inserts v in fragment slot order
+void shader_add_varying(struct ShaderVarying **list, size_t *n, struct ShaderVarying v);
+// Merges runs whose slots continue in both stages, returns the new count.
+// Offsets are given from offset on, which is advanced past them.
+size_t shader_pack_varyings(struct ShaderVarying *list, size_t n, size_t *offset);
+
+// Runs both stages' uniform blocks once per draw
 void shader_run_vert(struct Shader *s, SDL_Renderer *rend);
-void shader_run_frag(struct Shader *s);
-void shader_insert_runtime_inputs(struct Shader *s);
+// Runs the vertex stage over the bound buffer and bins every triangle
+void shader_draw_tris(struct Shader *s);
+// Whether depth can only be tested once fragments are shaded
+bool shader_late_z(struct Shader *s);
+// Shades a packet of VM_PACKET_W fragments, varyings must already be
+// written to every lane of f
+void shader_run_frag(struct Frame *f);
+// Uniforms keep their slots between invocations, only needed once per draw
+void shader_insert_runtime_inputs(struct Shader *s, struct Frame *f);
+// Exits unless the bound attrib layout fits the layout variables, once per
+// draw so copying them per vertex needs no checks
+void shader_check_layout(struct Shader *s, struct AttribLayout *atl);
 void shader_insert_layout_vars(struct Shader *s, float *start);
 
 void shader_add_input_int(struct Shader *s, const char *name, int i);
 void shader_add_input_vec(struct Shader *s, const char *name, float *v, size_t len);
 void shader_add_input_float(struct Shader *s, const char *name, float f);
-struct Node *shader_new_input(struct Shader *s, const char *name, int type);
+struct ShaderInput *shader_new_input(struct Shader *s, const char *name, NodeType type, size_t len);
+// Latest input named name or 0
+struct ShaderInput *shader_find_input(struct Shader *s, const char *name);
+// Looks up the slots of every input in the active variant
+void shader_resolve_inputs(struct Shader *s);
+// Slot of a matching in variable or -1
+int shader_input_slot(struct Program *p, const char *name, NodeType type, size_t len);
 void shader_clear_inputs(struct Shader *s);
 
-struct Node *shader_outvar(struct Shader *s, struct Scope *scope, const char *name);
+// Exits if the out variable doesn't exist
+struct ProgramVar *shader_outvar(struct Program *p, const char *name, NodeType type, size_t len);
 
 #endif
-
@@ -0,0 +1,89 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define ALIGN(x) (((x) + 15) & ~(size_t)15)
+
+
+struct Arena *arena_alloc()
+{
+    struct Arena *a = malloc(sizeof(struct Arena));
+    a->head = 0;
+
+    return a;
+}
+
+
+void arena_free(struct Arena *a)
+{
+    struct ArenaBlock *b = a->head;
+
+    while (b)
+    {
+        struct ArenaBlock *next = b->next;
+        free(b);
+        b = next;
+    }
+
+    free(a);
+}
+
+
+void *arena_push(struct Arena *a, size_t size)
+{
+    size = ALIGN(size);
+
+    if (!a->head || a->head->used + size > a->head->size)
+    {
+        // Oversized requests get a block of their own
+        size_t block_size = size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE;
+
+        struct ArenaBlock *b = malloc(sizeof(struct ArenaBlock) + block_size);
+        b->next = a->head;
+        b->size = block_size;
+        b->used = 0;
+
+        a->head = b;
+    }
+
+    void *ptr = a->head->data + a->head->used;
+    a->head->used += size;
+
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+
+void *arena_realloc(struct Arena *a, void *ptr, size_t old_size, size_t size)
+{
+    if (!ptr) return arena_push(a, size);
+
+    struct ArenaBlock *b = a->head;
+    old_size = ALIGN(old_size);
+
+    if ((char*)ptr + old_size == b->data + b->used && b->used - old_size + ALIGN(size) <= b->size)
+    {
+        if (ALIGN(size) > old_size)
+            memset((char*)ptr + old_size, 0, ALIGN(size) - old_size);
+
+        b->used = b->used - old_size + ALIGN(size);
+        return ptr;
+    }
+
+    void *new = arena_push(a, size);
+    memcpy(new, ptr, old_size < size ? old_size : size);
+
+    return new;
+}
+
+
+char *arena_strdup(struct Arena *a, const char *s)
+{
+    size_t len = strlen(s);
+
+    char *dup = arena_push(a, len + 1);
+    memcpy(dup, s, len);
+
+    return dup;
+}
+
@@ -0,0 +1,28 @@
+#ifndef SHADER_ARENA_H
+#define SHADER_ARENA_H
+
+#include <sys/types.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+// Bump allocator, everything in it is released at once
+struct Arena
+{
+    struct ArenaBlock
+    {
+        struct ArenaBlock *next;
+        size_t size, used;
+        char data[];
+    } *head;
+};
+
+struct Arena *arena_alloc();
+void arena_free(struct Arena *a);
+
+// Memory is zeroed and 16 byte aligned
+void *arena_push(struct Arena *a, size_t size);
+// Grows the newest allocation in place when possible
+void *arena_realloc(struct Arena *a, void *ptr, size_t old_size, size_t size);
+char *arena_strdup(struct Arena *a, const char *s);
+
+#endif
@@ -0,0 +1,97 @@
+#include "builtin.h"
+#include "mathlib.h"
+#include "vm.h"
+#include <string.h>
+
+// Lane loops only vectorize once the width is a constant
+#define BUILTIN_WIDTHS(fn) \
+    static void fn##_1(float *d, const float *a, size_t n, size_t w) { (void)w; fn(d, a, n, 1); } \
+    static void fn##_p(float *d, const float *a, size_t n, size_t w) { (void)w; fn(d, a, n, VM_PACKET_W); }
+
+BUILTIN_WIDTHS(math_sqrt)
+BUILTIN_WIDTHS(math_sqrt_fast)
+BUILTIN_WIDTHS(math_inversesqrt)
+BUILTIN_WIDTHS(math_inversesqrt_fast)
+BUILTIN_WIDTHS(math_sin)
+BUILTIN_WIDTHS(math_sin_fast)
+BUILTIN_WIDTHS(math_cos)
+BUILTIN_WIDTHS(math_cos_fast)
+BUILTIN_WIDTHS(math_abs)
+BUILTIN_WIDTHS(math_floor)
+BUILTIN_WIDTHS(math_fract)
+BUILTIN_WIDTHS(math_exp)
+BUILTIN_WIDTHS(math_log)
+BUILTIN_WIDTHS(math_pow)
+BUILTIN_WIDTHS(math_min2)
+BUILTIN_WIDTHS(math_max2)
+BUILTIN_WIDTHS(math_step)
+BUILTIN_WIDTHS(math_clamp)
+BUILTIN_WIDTHS(math_mix)
+BUILTIN_WIDTHS(math_smoothstep3)
+BUILTIN_WIDTHS(math_dot)
+BUILTIN_WIDTHS(math_length)
+BUILTIN_WIDTHS(math_length_fast)
+BUILTIN_WIDTHS(math_distance)
+BUILTIN_WIDTHS(math_distance_fast)
+BUILTIN_WIDTHS(math_normalize)
+BUILTIN_WIDTHS(math_normalize_fast)
+BUILTIN_WIDTHS(math_cross)
+
+#define BUILTIN(name, nargs, shape, len, fn, fast) \
+    { name, nargs, shape, len, #fn, #fast, { { fn##_1, fn##_p, fn }, { fast##_1, fast##_p, fast } } }
+
+// Fast math only changes the entries with a _fast implementation
+const struct Builtin builtins[] = {
+    BUILTIN("sqrt", 1, BUILTIN_MAP, 0, math_sqrt, math_sqrt_fast),
+    BUILTIN("inversesqrt", 1, BUILTIN_MAP, 0, math_inversesqrt, math_inversesqrt_fast),
+    BUILTIN("sin", 1, BUILTIN_MAP, 0, math_sin, math_sin_fast),
+    BUILTIN("cos", 1, BUILTIN_MAP, 0, math_cos, math_cos_fast),
+    BUILTIN("abs", 1, BUILTIN_MAP, 0, math_abs, math_abs),
+    BUILTIN("floor", 1, BUILTIN_MAP, 0, math_floor, math_floor),
+    BUILTIN("fract", 1, BUILTIN_MAP, 0, math_fract, math_fract),
+    BUILTIN("exp", 1, BUILTIN_MAP, 0, math_exp, math_exp),
+    BUILTIN("log", 1, BUILTIN_MAP, 0, math_log, math_log),
+    BUILTIN("pow", 2, BUILTIN_MAP, 0, math_pow, math_pow),
+    BUILTIN("min", 2, BUILTIN_MAP, 0, math_min2, math_min2),
+    BUILTIN("max", 2, BUILTIN_MAP, 0, math_max2, math_max2),
+    BUILTIN("step", 2, BUILTIN_MAP, 0, math_step, math_step),
+    BUILTIN("clamp", 3, BUILTIN_MAP, 0, math_clamp, math_clamp),
+    BUILTIN("mix", 3, BUILTIN_MAP, 0, math_mix, math_mix),
+    BUILTIN("smoothstep", 3, BUILTIN_MAP, 0, math_smoothstep3, math_smoothstep3),
+    BUILTIN("dot", 2, BUILTIN_REDUCE, 0, math_dot, math_dot),
+    BUILTIN("length", 1, BUILTIN_REDUCE, 0, math_length, math_length_fast),
+    BUILTIN("distance", 2, BUILTIN_REDUCE, 0, math_distance, math_distance_fast),
+    BUILTIN("normalize", 1, BUILTIN_VEC, 0, math_normalize, math_normalize_fast),
+    BUILTIN("cross", 2, BUILTIN_VEC, 3, math_cross, math_cross)
+};
+
+const size_t nbuiltins = sizeof(builtins) / sizeof(builtins[0]);
+
+
+int builtin_find(const char *name)
+{
+    for (size_t i = 0; i < nbuiltins; ++i)
+    {
+        if (strcmp(builtins[i].name, name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+
+BuiltinFn builtin_fn(const struct Builtin *b, bool fast, size_t width)
+{
+    const BuiltinFn *fns = b->fns[fast];
+
+    if (width == 1) return fns[0];
+    if (width == VM_PACKET_W) return fns[1];
+
+    return fns[2];
+}
+
+
+size_t builtin_result_len(const struct Builtin *b, size_t n)
+{
+    return b->shape == BUILTIN_REDUCE ? 1 : n;
+}
@@ -0,0 +1,42 @@
+#ifndef SHADER_BUILTIN_H
+#define SHADER_BUILTIN_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Argument layout is described in mathlib.h
+typedef void (*BuiltinFn)(float *d, const float *a, size_t n, size_t w);
+
+typedef enum
+{
+    BUILTIN_MAP, // Component wise, float arguments are broadcast to vectors
+    BUILTIN_REDUCE, // Vectors of the same length to a float
+    BUILTIN_VEC // Vectors of the same length to another one
+} BuiltinShape;
+
+struct Builtin
+{
+    const char *name;
+    size_t nargs;
+    BuiltinShape shape;
+
+    // Vector length the arguments must have, 0 for any
+    size_t len;
+
+    // mathlib.h names for grslc, precise and fast math
+    const char *symbol, *fast_symbol;
+
+    // Indexed by fast math, then scalar frames, packets and any other width
+    BuiltinFn fns[2][3];
+};
+
+extern const struct Builtin builtins[];
+extern const size_t nbuiltins;
+
+// Index into builtins or -1
+int builtin_find(const char *name);
+BuiltinFn builtin_fn(const struct Builtin *b, bool fast, size_t width);
+// Components in the result for n component arguments
+size_t builtin_result_len(const struct Builtin *b, size_t n);
+
+#endif
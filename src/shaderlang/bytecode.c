@@ -0,0 +1,167 @@
+#include "bytecode.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+struct Program *program_alloc()
+{
+    struct Program *p = malloc(sizeof(struct Program));
+    p->code = 0;
+    p->ncode = 0;
+
+    p->consts = 0;
+    p->nconsts = 0;
+
+    p->vars = 0;
+    p->nvars = 0;
+
+    p->funcs = 0;
+    p->nfuncs = 0;
+
+    p->setup = 0;
+    p->init = 0;
+    p->entry = 0;
+    p->uniform = 0;
+
+    p->nslots = 0;
+    p->nvarslots = 0;
+
+    p->image = 0;
+
+    p->resets = 0;
+    p->nresets = 0;
+
+    return p;
+}
+
+
+void program_free(struct Program *p)
+{
+    for (size_t i = 0; i < p->nvars; ++i)
+        free(p->vars[i].name);
+
+    for (size_t i = 0; i < p->nfuncs; ++i)
+        free(p->funcs[i].name);
+
+    free(p->code);
+    free(p->consts);
+    free(p->vars);
+    free(p->funcs);
+    free(p->image);
+    free(p->resets);
+    free(p);
+}
+
+
+struct Program *program_load(const struct ModuleStage *st)
+{
+    struct Program *p = program_alloc();
+
+    p->nvars = st->nvars;
+    p->vars = malloc(sizeof(struct ProgramVar) * (p->nvars ? p->nvars : 1));
+
+    for (size_t i = 0; i < p->nvars; ++i)
+    {
+        const struct ModuleVar *v = &st->vars[i];
+        p->vars[i] = (struct ProgramVar){ strdup(v->name), v->modifier, v->type, v->len, v->slot, v->layout_loc,
+            v->uniform };
+    }
+
+    p->nconsts = st->nconsts;
+    p->consts = malloc(sizeof(float) * (p->nconsts ? p->nconsts : 1));
+    memcpy(p->consts, st->consts, sizeof(float) * p->nconsts);
+
+    p->nslots = st->nslots;
+    p->nvarslots = st->nvarslots;
+
+    p->image = malloc(sizeof(float) * (p->nvarslots ? p->nvarslots : 1));
+    memcpy(p->image, st->image, sizeof(float) * p->nvarslots);
+
+    p->nresets = st->nresets;
+    p->resets = malloc(sizeof(struct ProgramRange) * (p->nresets ? p->nresets : 1));
+
+    for (size_t i = 0; i < p->nresets; ++i)
+        p->resets[i] = (struct ProgramRange){ st->resets[i].slot, st->resets[i].len };
+
+    p->init = st->init;
+    p->entry = st->entry;
+    p->uniform = st->uniform;
+
+    return p;
+}
+
+
+size_t program_emit(struct Program *p, struct Instr in)
+{
+    p->code = realloc(p->code, sizeof(struct Instr) * ++p->ncode);
+    p->code[p->ncode - 1] = in;
+
+    return p->ncode - 1;
+}
+
+
+int program_add_const(struct Program *p, float f)
+{
+    for (size_t i = 0; i < p->nconsts; ++i)
+    {
+        if (p->consts[i] == f)
+            return i;
+    }
+
+    p->consts = realloc(p->consts, sizeof(float) * ++p->nconsts);
+    p->consts[p->nconsts - 1] = f;
+
+    return p->nconsts - 1;
+}
+
+
+struct ProgramVar *program_add_var(struct Program *p, struct Node *vardef, size_t len)
+{
+    struct ProgramVar *var = program_alias_var(p, vardef, len, p->nvarslots);
+    p->nvarslots += len;
+
+    return var;
+}
+
+
+struct ProgramVar *program_alias_var(struct Program *p, struct Node *vardef, size_t len, int slot)
+{
+    p->vars = realloc(p->vars, sizeof(struct ProgramVar) * ++p->nvars);
+    p->vars[p->nvars - 1] = (struct ProgramVar){
+        .name = strdup(vardef->vardef.name),
+        .modifier = vardef->vardef.modifier,
+        .type = vardef->vardef.type,
+        .len = len,
+        .slot = slot,
+        .layout_loc = vardef->vardef.layout_loc,
+        .uniform = vardef->vardef.uniform
+    };
+
+    return &p->vars[p->nvars - 1];
+}
+
+
+struct ProgramVar *program_find_var(struct Program *p, const char *name, VarModifier modifier)
+{
+    for (size_t i = 0; i < p->nvars; ++i)
+    {
+        struct ProgramVar *var = &p->vars[i];
+
+        if ((!modifier || var->modifier & modifier) && strcmp(var->name, name) == 0)
+            return var;
+    }
+
+    return 0;
+}
+
+
+int program_find_func(struct Program *p, const char *name)
+{
+    for (size_t i = 0; i < p->nfuncs; ++i)
+    {
+        if (strcmp(p->funcs[i].name, name) == 0)
+            return i;
+    }
+
+    return -1;
+}
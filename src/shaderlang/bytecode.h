@@ -0,0 +1,116 @@
+#ifndef SHADER_BYTECODE_H
+#define SHADER_BYTECODE_H
+
+#include "node.h"
+#include "module.h"
+
+typedef enum
+{
+    OP_LOADK, // r[dst] = consts[a]
+    OP_MOV, // r[dst .. dst + n] = r[a .. a + n]
+
+    // r[dst] = r[a] op r[b], same order as Binop
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+
+    // Integer variants, ints are kept in float registers
+    OP_IADD,
+    OP_ISUB,
+    OP_IMUL,
+    OP_IDIV,
+
+    // r[dst .. dst + n] = r[a .. a + n] op r[b .. b + n], same order as Binop
+    OP_VADD,
+    OP_VSUB,
+    OP_VMUL,
+    OP_VDIV,
+
+    OP_SPLAT, // r[dst .. dst + n] = r[a]
+
+    // r[dst ..] = builtins[b](r[a ..]), every argument has n components
+    OP_BUILTIN,
+    OP_BUILTIN_FAST,
+
+    OP_CALL, // Call funcs[a], arguments and the return value are in slots of their own
+    OP_RET
+} Opcode;
+
+struct Instr
+{
+    Opcode op;
+    int dst, a, b, n;
+};
+
+struct Program
+{
+    struct Instr *code;
+    size_t ncode;
+
+    float *consts;
+    size_t nconsts;
+
+    // Every variable owns a fixed range of frame slots
+    struct ProgramVar
+    {
+        char *name;
+        VarModifier modifier;
+        NodeType type;
+        size_t len;
+
+        int slot;
+        int layout_loc;
+        bool uniform;
+    } *vars;
+    size_t nvars;
+
+    struct ProgramFunc
+    {
+        char *name;
+        size_t offset;
+    } *funcs;
+    size_t nfuncs;
+
+    // Constant global initializers, run once per frame, initializers that
+    // read in or layout variables, run every invocation, and main
+    size_t setup, init, entry;
+
+    // Everything that only depends on uniforms, run once per draw before
+    // any invocation
+    size_t uniform;
+
+    // Frame size: variable slots followed by temporaries
+    size_t nslots, nvarslots;
+
+    // Variable slots as left by setup
+    float *image;
+
+    // Slots the program reads before writing them, restored from image
+    // before every invocation
+    struct ProgramRange
+    {
+        int slot;
+        size_t len;
+    } *resets;
+    size_t nresets;
+};
+
+struct Program *program_alloc();
+void program_free(struct Program *p);
+// Copies a stage compiled by grslc, the result has no code of its own
+struct Program *program_load(const struct ModuleStage *st);
+
+// Returns index of the emitted instruction
+size_t program_emit(struct Program *p, struct Instr in);
+int program_add_const(struct Program *p, float f);
+
+struct ProgramVar *program_add_var(struct Program *p, struct Node *vardef, size_t len);
+// Variable over slots that are already allocated
+struct ProgramVar *program_alias_var(struct Program *p, struct Node *vardef, size_t len, int slot);
+// First match wins, modifier 0 matches any variable
+struct ProgramVar *program_find_var(struct Program *p, const char *name, VarModifier modifier);
+
+int program_find_func(struct Program *p, const char *name);
+
+#endif
@@ -0,0 +1,344 @@
+#include "cache.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+
+uint64_t cache_hash(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *bytes = data;
+
+    for (size_t i = 0; i < len; ++i)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+    return hash;
+}
+
+
+uint64_t cache_key(const char *vert, const char *frag, int flags)
+{
+    size_t vert_len, frag_len;
+    const char *vert_src = util_map_file(vert, &vert_len);
+    const char *frag_src = util_map_file(frag, &frag_len);
+
+    uint64_t key = cache_key_sources(vert_src, vert_len, frag_src, frag_len, flags);
+
+    util_unmap_file(vert_src, vert_len);
+    util_unmap_file(frag_src, frag_len);
+
+    return key;
+}
+
+
+uint64_t cache_key_sources(const char *vert, size_t vert_len, const char *frag, size_t frag_len, int flags)
+{
+    // Lengths keep the boundary between the sources part of the key
+    uint64_t hash = CACHE_HASH_BASIS;
+    hash = cache_hash(hash, &vert_len, sizeof(vert_len));
+    hash = cache_hash(hash, vert, vert_len);
+    hash = cache_hash(hash, &frag_len, sizeof(frag_len));
+    hash = cache_hash(hash, frag, frag_len);
+
+    int version = CACHE_VERSION;
+    hash = cache_hash(hash, &flags, sizeof(flags));
+    hash = cache_hash(hash, &version, sizeof(version));
+
+    return hash;
+}
+
+
+char *cache_path(const char *dir, uint64_t key)
+{
+    size_t len = strlen(dir) + 32;
+    char *path = malloc(len);
+    snprintf(path, len, "%s/%016llx.grsc", dir, (unsigned long long)key);
+
+    return path;
+}
+
+
+bool cache_load(const char *dir, uint64_t key, struct Program **vert, struct Program **frag)
+{
+    char *path = cache_path(dir, key);
+
+    // Mapped here rather than by util_map_file, which exits on failure.
+    // Entries can disappear at any point, that's only a miss.
+    int fd = open(path, O_RDONLY);
+    free(path);
+
+    struct stat st;
+
+    if (fd == -1 || fstat(fd, &st) == -1 || st.st_size == 0)
+    {
+        if (fd != -1) close(fd);
+        return false;
+    }
+
+    size_t len = st.st_size;
+    const char *contents = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (contents == MAP_FAILED)
+        return false;
+
+    struct CacheReader r = { contents, len, 0 };
+    uint32_t magic, version;
+    uint64_t stored_key, sum;
+
+    struct Program *v = 0, *f = 0;
+
+    if (cache_read(&r, &magic, sizeof(magic)) && magic == CACHE_MAGIC &&
+        cache_read(&r, &version, sizeof(version)) && version == CACHE_VERSION &&
+        cache_read(&r, &stored_key, sizeof(stored_key)) && stored_key == key &&
+        cache_read(&r, &sum, sizeof(sum)) && sum == cache_hash(CACHE_HASH_BASIS, r.data + r.pos, r.len - r.pos))
+    {
+        v = cache_read_program(&r);
+        f = v ? cache_read_program(&r) : 0;
+    }
+
+    util_unmap_file(contents, len);
+
+    if (!v || !f)
+    {
+        if (v) program_free(v);
+        return false;
+    }
+
+    *vert = v;
+    *frag = f;
+
+    return true;
+}
+
+
+void cache_store(const char *dir, uint64_t key, struct Program *vert, struct Program *frag)
+{
+    // Fails harmlessly when dir already exists
+    mkdir(dir, 0755);
+
+    char *path = cache_path(dir, key);
+    size_t tmp_len = strlen(path) + 8;
+    char *tmp = malloc(tmp_len);
+    snprintf(tmp, tmp_len, "%s.XXXXXX", path);
+
+    // Programs go to memory first, the checksum covers all of them
+    char *body;
+    size_t body_len;
+    FILE *mem = open_memstream(&body, &body_len);
+
+    cache_write_program(mem, vert);
+    cache_write_program(mem, frag);
+    fclose(mem);
+
+    uint32_t magic = CACHE_MAGIC, version = CACHE_VERSION;
+    uint64_t sum = cache_hash(CACHE_HASH_BASIS, body, body_len);
+
+    // Unique per call, threads and processes storing the same key each
+    // write their own file
+    int fd = mkstemp(tmp);
+
+    // Readable by everyone mkdir let in, mkstemp only allows the owner
+    if (fd != -1)
+        fchmod(fd, 0644);
+
+    FILE *fp = fd == -1 ? 0 : fdopen(fd, "wb");
+
+    // An unwritable cache only costs the next process a compile
+    if (fp)
+    {
+        fwrite(&magic, sizeof(magic), 1, fp);
+        fwrite(&version, sizeof(version), 1, fp);
+        fwrite(&key, sizeof(key), 1, fp);
+        fwrite(&sum, sizeof(sum), 1, fp);
+        fwrite(body, 1, body_len, fp);
+
+        bool ok = !ferror(fp);
+
+        // Something in the way of the entry leaves it out, not the file
+        if (fclose(fp) != 0 || !ok || rename(tmp, path) != 0)
+            unlink(tmp);
+    }
+
+    free(body);
+    free(tmp);
+    free(path);
+}
+
+
+void cache_write_program(FILE *fp, struct Program *p)
+{
+    uint64_t header[] = { p->ncode, p->nconsts, p->nvars, p->nfuncs, p->nresets, p->nslots, p->nvarslots,
+        p->setup, p->init, p->entry, p->uniform };
+    fwrite(header, sizeof(header), 1, fp);
+
+    // Empty arrays may be null
+    if (p->ncode) fwrite(p->code, sizeof(struct Instr), p->ncode, fp);
+    if (p->nconsts) fwrite(p->consts, sizeof(float), p->nconsts, fp);
+    if (p->nvarslots) fwrite(p->image, sizeof(float), p->nvarslots, fp);
+    if (p->nresets) fwrite(p->resets, sizeof(struct ProgramRange), p->nresets, fp);
+
+    for (size_t i = 0; i < p->nvars; ++i)
+    {
+        struct ProgramVar *var = &p->vars[i];
+        cache_write_str(fp, var->name);
+
+        int32_t fields[] = { var->modifier, var->type };
+        fwrite(fields, sizeof(fields), 1, fp);
+
+        uint64_t len = var->len;
+        fwrite(&len, sizeof(len), 1, fp);
+
+        int32_t loc[] = { var->slot, var->layout_loc, var->uniform };
+        fwrite(loc, sizeof(loc), 1, fp);
+    }
+
+    for (size_t i = 0; i < p->nfuncs; ++i)
+    {
+        cache_write_str(fp, p->funcs[i].name);
+
+        uint64_t offset = p->funcs[i].offset;
+        fwrite(&offset, sizeof(offset), 1, fp);
+    }
+}
+
+
+void cache_write_str(FILE *fp, const char *s)
+{
+    uint64_t len = strlen(s);
+    fwrite(&len, sizeof(len), 1, fp);
+    fwrite(s, 1, len, fp);
+}
+
+
+struct Program *cache_read_program(struct CacheReader *r)
+{
+    uint64_t header[11];
+
+    if (!cache_read(r, header, sizeof(header)))
+        return 0;
+
+    struct Program *p = program_alloc();
+
+    p->nslots = header[5];
+    p->setup = header[7];
+    p->init = header[8];
+    p->entry = header[9];
+    p->uniform = header[10];
+
+    // Counts are only set once their arrays exist, so program_free works
+    // on a partially read program
+    bool ok = (p->code = cache_read_array(r, header[0], sizeof(struct Instr))) &&
+        (p->consts = cache_read_array(r, header[1], sizeof(float))) &&
+        (p->image = cache_read_array(r, header[6], sizeof(float))) &&
+        (p->resets = cache_read_array(r, header[4], sizeof(struct ProgramRange)));
+
+    if (ok)
+    {
+        p->ncode = header[0];
+        p->nconsts = header[1];
+        p->nvarslots = header[6];
+        p->nresets = header[4];
+
+        // Every entry takes at least a name length, which bounds the counts
+        ok = header[2] <= r->len - r->pos && header[3] <= r->len - r->pos;
+    }
+
+    if (ok)
+    {
+        p->vars = malloc(sizeof(struct ProgramVar) * (header[2] ? header[2] : 1));
+        p->funcs = malloc(sizeof(struct ProgramFunc) * (header[3] ? header[3] : 1));
+    }
+
+    for (size_t i = 0; ok && i < header[2]; ++i)
+    {
+        struct ProgramVar *var = &p->vars[i];
+        int32_t fields[2], loc[3];
+        uint64_t len;
+
+        if (!(var->name = cache_read_str(r)))
+            ok = false;
+        else
+            ++p->nvars;
+
+        ok = ok && cache_read(r, fields, sizeof(fields)) && cache_read(r, &len, sizeof(len)) &&
+            cache_read(r, loc, sizeof(loc));
+
+        if (ok)
+        {
+            var->modifier = fields[0];
+            var->type = fields[1];
+            var->len = len;
+            var->slot = loc[0];
+            var->layout_loc = loc[1];
+            var->uniform = loc[2];
+        }
+    }
+
+    for (size_t i = 0; ok && i < header[3]; ++i)
+    {
+        struct ProgramFunc *fn = &p->funcs[i];
+        uint64_t offset;
+
+        if (!(fn->name = cache_read_str(r)))
+            ok = false;
+        else
+            ++p->nfuncs;
+
+        ok = ok && cache_read(r, &offset, sizeof(offset));
+
+        if (ok)
+            fn->offset = offset;
+    }
+
+    if (!ok)
+    {
+        program_free(p);
+        return 0;
+    }
+
+    return p;
+}
+
+
+bool cache_read(struct CacheReader *r, void *dst, size_t size)
+{
+    if (size > r->len - r->pos)
+        return false;
+
+    memcpy(dst, r->data + r->pos, size);
+    r->pos += size;
+
+    return true;
+}
+
+
+void *cache_read_array(struct CacheReader *r, size_t n, size_t size)
+{
+    // Checked by count first so n * size can't overflow
+    if (n > (r->len - r->pos) / size)
+        return 0;
+
+    void *arr = malloc(size * (n ? n : 1));
+    cache_read(r, arr, size * n);
+
+    return arr;
+}
+
+
+char *cache_read_str(struct CacheReader *r)
+{
+    uint64_t len;
+
+    if (!cache_read(r, &len, sizeof(len)) || len > r->len - r->pos)
+        return 0;
+
+    char *s = malloc(len + 1);
+    cache_read(r, s, len);
+    s[len] = '\0';
+
+    return s;
+}
@@ -0,0 +1,60 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include "bytecode.h"
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+// Bump whenever the compiler's output or the entry layout changes, old
+// entries then stop matching any key
+#define CACHE_VERSION 1
+#define CACHE_MAGIC 0x43535247 // "GRSC"
+#define CACHE_HASH_BASIS 14695981039346656037ull
+
+// Compiled programs of both stages stored on disk, one file per pair of
+// sources named after the key. Entries are only an optimization, anything
+// that fails to load or store is treated as a miss.
+//
+// Entry layout, native endianness:
+//   u32 magic, u32 version, u64 key, u64 hash of everything after it
+//   vertex stage, then fragment stage:
+//     u64 ncode, nconsts, nvars, nfuncs, nresets, nslots, nvarslots
+//     u64 setup, init, entry, uniform
+//     code, consts, image (nvarslots floats), resets
+//     vars: u64 name length, name, i32 modifier, i32 type, u64 len,
+//           i32 slot, i32 layout_loc, i32 uniform
+//     funcs: u64 name length, name, u64 offset
+
+struct CacheReader
+{
+    const char *data;
+    size_t len, pos;
+};
+
+// FNV-1a, continued from hash
+uint64_t cache_hash(uint64_t hash, const void *data, size_t len);
+// Hash of both sources, compiler flags and CACHE_VERSION
+uint64_t cache_key(const char *vert, const char *frag, int flags);
+// Same for sources already in memory
+uint64_t cache_key_sources(const char *vert, size_t vert_len, const char *frag, size_t frag_len, int flags);
+// dir/<key>.grsc, the result is malloc'd
+char *cache_path(const char *dir, uint64_t key);
+
+// Maps the entry for key, programs are only set on a hit
+bool cache_load(const char *dir, uint64_t key, struct Program **vert, struct Program **frag);
+// Writes to a temporary file renamed into place, so processes sharing dir
+// never see a partial entry
+void cache_store(const char *dir, uint64_t key, struct Program *vert, struct Program *frag);
+
+void cache_write_program(FILE *fp, struct Program *p);
+void cache_write_str(FILE *fp, const char *s);
+
+// Returns 0 once the entry is exhausted or malformed
+struct Program *cache_read_program(struct CacheReader *r);
+bool cache_read(struct CacheReader *r, void *dst, size_t size);
+// malloc'd copy of n elements of size bytes, at least one element is allocated
+void *cache_read_array(struct CacheReader *r, size_t n, size_t size);
+char *cache_read_str(struct CacheReader *r);
+
+#endif
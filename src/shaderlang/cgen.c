@@ -0,0 +1,209 @@
+#include "cgen.h"
+#include "module.h"
+#include "vm.h"
+#include "builtin.h"
+#include <stdlib.h>
+#include <math.h>
+
+
+void cgen_module(FILE *out, struct Program *vert, struct Program *frag)
+{
+    fprintf(out, "// Generated by grslc, do not edit\n\n");
+    fprintf(out, "#include \"shaderlang/module.h\"\n");
+    fprintf(out, "#include \"shaderlang/mathlib.h\"\n\n");
+
+    fprintf(out, "typedef float lane __attribute__((vector_size(%zu), may_alias));\n",
+            sizeof(float) * VM_PACKET_W);
+    fprintf(out, "typedef int ilane __attribute__((vector_size(%zu)));\n\n", sizeof(int) * VM_PACKET_W);
+
+    fprintf(out, "#define I(x) __builtin_convertvector(x, ilane)\n");
+    fprintf(out, "#define F(x) __builtin_convertvector(x, lane)\n\n");
+
+    // Lanes that would trap divide by 1, like vm_run_packet
+    fprintf(out, "#define IDIV(a, b) ({ ilane a_ = (a), b_ = (b); \\\n"
+            "    ilane trap_ = (b_ == 0) | ((a_ == -2147483647 - 1) & (b_ == -1)); \\\n"
+            "    a_ / ((b_ & ~trap_) | (trap_ & 1)); })\n\n");
+
+    cgen_stage(out, vert, "vert", 1);
+    cgen_stage(out, frag, "frag", VM_PACKET_W);
+
+    cgen_tables(out, vert, "vert", 1);
+    cgen_tables(out, frag, "frag", VM_PACKET_W);
+
+    fprintf(out, "const struct Module %s = {\n", MODULE_SYMBOL);
+    fprintf(out, "    MODULE_VERSION,\n");
+    fprintf(out, "    vert_stage,\n");
+    fprintf(out, "    frag_stage\n");
+    fprintf(out, "};\n");
+}
+
+
+void cgen_stage(FILE *out, struct Program *p, const char *name, size_t width)
+{
+    // Every block is a function, declared first since calls can go forward
+    for (size_t i = 0; i < p->nfuncs; ++i)
+        fprintf(out, "static void %s_%zu(float *s, const float *k);\n", name, p->funcs[i].offset);
+
+    fprintf(out, "static void %s_%zu(float *s, const float *k);\n", name, p->init);
+    fprintf(out, "static void %s_%zu(float *s, const float *k);\n\n", name, p->uniform);
+
+    for (size_t i = 0; i < p->nfuncs; ++i)
+        cgen_block(out, p, name, p->funcs[i].offset, width);
+
+    cgen_block(out, p, name, p->init, width);
+    cgen_block(out, p, name, p->uniform, width);
+
+    fprintf(out, "static void %s_run(float *s, const float *k, size_t offset)\n{\n", name);
+    fprintf(out, "    switch (offset)\n    {\n");
+    fprintf(out, "    case %zu: %s_%zu(s, k); break;\n", p->init, name, p->init);
+    fprintf(out, "    case %zu: %s_%zu(s, k); break;\n", p->uniform, name, p->uniform);
+
+    for (size_t i = 0; i < p->nfuncs; ++i)
+        fprintf(out, "    case %zu: %s_%zu(s, k); break;\n", p->funcs[i].offset, name, p->funcs[i].offset);
+
+    fprintf(out, "    }\n}\n\n");
+}
+
+
+void cgen_tables(FILE *out, struct Program *p, const char *name, size_t width)
+{
+    // Empty arrays aren't valid C, counts say how much is real
+    fprintf(out, "static const struct ModuleVar %s_vars[] = {\n", name);
+
+    for (size_t i = 0; i < p->nvars; ++i)
+    {
+        struct ProgramVar *v = &p->vars[i];
+        fprintf(out, "    { \"%s\", %d, %d, %zu, %d, %d, %d },\n", v->name, v->modifier, v->type, v->len,
+                v->slot, v->layout_loc, v->uniform);
+    }
+
+    fprintf(out, "    { 0 }\n};\n\n");
+
+    fprintf(out, "static const float %s_consts[] = {\n", name);
+
+    for (size_t i = 0; i < p->nconsts; ++i)
+    {
+        fprintf(out, "    ");
+        cgen_float(out, p->consts[i]);
+        fprintf(out, ",\n");
+    }
+
+    fprintf(out, "    0\n};\n\n");
+
+    fprintf(out, "static const float %s_image[] = {\n", name);
+
+    for (size_t i = 0; i < p->nvarslots; ++i)
+    {
+        fprintf(out, "    ");
+        cgen_float(out, p->image[i]);
+        fprintf(out, ",\n");
+    }
+
+    fprintf(out, "    0\n};\n\n");
+
+    fprintf(out, "static const struct ModuleRange %s_resets[] = {\n", name);
+
+    for (size_t i = 0; i < p->nresets; ++i)
+        fprintf(out, "    { %d, %zu },\n", p->resets[i].slot, p->resets[i].len);
+
+    fprintf(out, "    { 0 }\n};\n\n");
+
+    fprintf(out, "#define %s_stage { %s_vars, %zu, %s_consts, %zu, %s_image, %s_resets, %zu, "
+            "%zu, %zu, %zu, %zu, %zu, %zu, %s_run }\n\n",
+            name, name, p->nvars, name, p->nconsts, name, name, p->nresets,
+            p->nslots, p->nvarslots, p->init, p->entry, p->uniform, width, name);
+}
+
+
+void cgen_block(FILE *out, struct Program *p, const char *name, size_t offset, size_t width)
+{
+    fprintf(out, "static void %s_%zu(float *s, const float *k)\n{\n", name, offset);
+
+    if (width == 1)
+        fprintf(out, "    float *r = s;\n");
+    else
+        fprintf(out, "    lane *r = (lane*)s;\n");
+
+    fprintf(out, "    (void)r;\n    (void)k;\n\n");
+
+    // Blocks have no branches, the first RET ends them
+    for (size_t pc = offset; p->code[pc].op != OP_RET; ++pc)
+        cgen_instr(out, p, name, &p->code[pc], width);
+
+    fprintf(out, "}\n\n");
+}
+
+
+void cgen_instr(FILE *out, struct Program *p, const char *name, struct Instr *in, size_t width)
+{
+    static const char *ops = "+-*/";
+
+    switch (in->op)
+    {
+    case OP_LOADK:
+        fprintf(out, width == 1 ? "    r[%d] = " : "    r[%d] = (lane){ 0 } + ", in->dst);
+        cgen_float(out, p->consts[in->a]);
+        fprintf(out, ";\n");
+        break;
+    case OP_MOV:
+        for (int i = 0; i < in->n; ++i)
+            fprintf(out, "    r[%d] = r[%d];\n", in->dst + i, in->a + i);
+        break;
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+        fprintf(out, "    r[%d] = r[%d] %c r[%d];\n", in->dst, in->a, ops[in->op - OP_ADD], in->b);
+        break;
+    case OP_IADD:
+    case OP_ISUB:
+    case OP_IMUL:
+    case OP_IDIV:
+        if (width == 1)
+            fprintf(out, "    r[%d] = (int)r[%d] %c (int)r[%d];\n", in->dst, in->a, ops[in->op - OP_IADD], in->b);
+        else if (in->op == OP_IDIV)
+            fprintf(out, "    r[%d] = F(IDIV(I(r[%d]), I(r[%d])));\n", in->dst, in->a, in->b);
+        else
+            fprintf(out, "    r[%d] = F(I(r[%d]) %c I(r[%d]));\n", in->dst, in->a, ops[in->op - OP_IADD], in->b);
+        break;
+    case OP_VADD:
+    case OP_VSUB:
+    case OP_VMUL:
+    case OP_VDIV:
+        for (int i = 0; i < in->n; ++i)
+        {
+            fprintf(out, "    r[%d] = r[%d] %c r[%d];\n", in->dst + i, in->a + i, ops[in->op - OP_VADD],
+                    in->b + i);
+        }
+        break;
+    case OP_SPLAT:
+        for (int i = 0; i < in->n; ++i)
+            fprintf(out, "    r[%d] = r[%d];\n", in->dst + i, in->a);
+        break;
+    case OP_BUILTIN:
+    case OP_BUILTIN_FAST:
+    {
+        // Inlined with a constant width, so the lane loops vectorize
+        const struct Builtin *b = &builtins[in->b];
+        fprintf(out, "    %s((float*)&r[%d], (const float*)&r[%d], %d, %zu);\n",
+                in->op == OP_BUILTIN_FAST ? b->fast_symbol : b->symbol, in->dst, in->a, in->n, width);
+    } break;
+    case OP_CALL:
+        fprintf(out, "    %s_%zu(s, k);\n", name, p->funcs[in->a].offset);
+        break;
+    case OP_RET:
+        break;
+    }
+}
+
+
+void cgen_float(FILE *out, float f)
+{
+    // Hex floats keep values exact
+    if (isnan(f))
+        fprintf(out, "__builtin_nanf(\"\")");
+    else if (isinf(f))
+        fprintf(out, f < 0 ? "-__builtin_inff()" : "__builtin_inff()");
+    else
+        fprintf(out, "%af", f);
+}
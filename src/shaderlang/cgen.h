@@ -0,0 +1,23 @@
+#ifndef SHADER_CGEN_H
+#define SHADER_CGEN_H
+
+#include "bytecode.h"
+#include <stdio.h>
+
+// Writes a C translation unit defining MODULE_SYMBOL for both stages. The
+// vertex stage is generated for scalar frames and the fragment stage for
+// packets, the output needs GCC or Clang vector extensions.
+void cgen_module(FILE *out, struct Program *vert, struct Program *frag);
+
+// Functions for every block plus the stage's run function
+void cgen_stage(FILE *out, struct Program *p, const char *name, size_t width);
+// Reflection tables and the ModuleStage initializer
+void cgen_tables(FILE *out, struct Program *p, const char *name, size_t width);
+
+// Straight-line code from offset up to its RET
+void cgen_block(FILE *out, struct Program *p, const char *name, size_t offset, size_t width);
+void cgen_instr(FILE *out, struct Program *p, const char *name, struct Instr *in, size_t width);
+// Float literal that reads back as exactly f
+void cgen_float(FILE *out, float f);
+
+#endif
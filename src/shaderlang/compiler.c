@@ -0,0 +1,1190 @@
+#include "compiler.h"
+#include "vm.h"
+#include "optimizer.h"
+#include "builtin.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define IS_TEMP(reg) ((reg) >= COMPILER_TEMP_BASE)
+
+
+struct Program *compiler_compile(struct Node *root, int flags)
+{
+    optimizer_optimize(root);
+
+    struct Compiler *c = compiler_alloc();
+    struct Program *p = c->prog;
+    c->flags = flags;
+
+    // Function indices first so initializers can call them, then globals
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+
+        if (n->type == NODE_FUNC_DEF)
+        {
+            if (builtin_find(n->fdef.name) != -1)
+            {
+                fprintf(stderr, "[compiler_compile] Error: '%s' is a built-in function.\n", n->fdef.name);
+                exit(EXIT_FAILURE);
+            }
+
+            p->funcs = realloc(p->funcs, sizeof(struct ProgramFunc) * ++p->nfuncs);
+            p->funcs[p->nfuncs - 1] = (struct ProgramFunc){ strdup(n->fdef.name), 0 };
+
+            c->funcs = realloc(c->funcs, sizeof(struct CompilerFunc) * p->nfuncs);
+            c->funcs[p->nfuncs - 1] = (struct CompilerFunc){ n, 0, 0, 0 };
+        }
+    }
+
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        if (root->comp.values[i]->type == NODE_VARDEF)
+            compiler_add_var(c, root->comp.values[i]);
+    }
+
+    for (size_t i = 0; i < p->nfuncs; ++i)
+        compiler_alloc_func(c, &c->funcs[i]);
+
+    c->nglobals = p->nvars;
+    c->scope_start = p->nvars;
+    c->dynamic = calloc(c->nglobals ? c->nglobals : 1, sizeof(bool));
+
+    compiler_reset_hoisted(c, false);
+
+    // In and layout variables are written from outside so they have no
+    // initializer. Initializers that depend on them have to run every
+    // invocation, the rest only once.
+    for (size_t i = 0; i < c->nglobals; ++i)
+    {
+        if (p->vars[i].modifier & (VAR_IN | VAR_LAYOUT))
+            c->dynamic[i] = true;
+    }
+
+    p->setup = p->ncode;
+    compiler_compile_globals(c, root, false);
+
+    // Setup runs at compile time, before any uniform is known
+    c->hoisting = true;
+
+    p->init = p->ncode;
+    compiler_compile_globals(c, root, true);
+
+    c->init_hoisted = malloc(sizeof(int) * (c->nglobals ? c->nglobals : 1));
+    memcpy(c->init_hoisted, c->hoisted, sizeof(int) * c->nglobals);
+
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        if (root->comp.values[i]->type == NODE_FUNC_DEF)
+            compiler_compile_fdef(c, root->comp.values[i]);
+    }
+
+    int main_idx = program_find_func(p, "main");
+
+    if (main_idx == -1)
+    {
+        fprintf(stderr, "[compiler_compile] Error: Shader has no main function.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    p->entry = p->funcs[main_idx].offset;
+
+    p->uniform = p->ncode;
+
+    for (size_t i = 0; i < c->nucode; ++i)
+        program_emit(p, c->ucode[i]);
+
+    program_emit(p, (struct Instr){ OP_RET });
+
+    compiler_relocate(c);
+    compiler_build_image(c);
+    compiler_find_resets(c);
+
+    compiler_free(c);
+    return p;
+}
+
+
+struct Compiler *compiler_alloc()
+{
+    struct Compiler *c = malloc(sizeof(struct Compiler));
+    c->prog = program_alloc();
+    c->flags = 0;
+
+    c->nglobals = 0;
+    c->scope_start = 0;
+    c->dynamic = 0;
+
+    c->reg = COMPILER_TEMP_BASE;
+    c->ntemps = 0;
+
+    c->ucode = 0;
+    c->nucode = 0;
+    c->hoisting = false;
+
+    c->hoisted = 0;
+    c->init_hoisted = 0;
+
+    c->funcs = 0;
+    c->func = -1;
+
+    return c;
+}
+
+
+void compiler_free(struct Compiler *c)
+{
+    free(c->dynamic);
+    free(c->ucode);
+    free(c->hoisted);
+    free(c->init_hoisted);
+    free(c->funcs);
+    free(c);
+}
+
+
+struct ProgramVar *compiler_add_var(struct Compiler *c, struct Node *vardef)
+{
+    NodeType type;
+    size_t len;
+    compiler_infer(c, vardef->vardef.value, &type, &len);
+
+    if (type != vardef->vardef.type)
+    {
+        fprintf(stderr, "[compiler_add_var] Error: Mismatched types on '%s' definition: '%d' and '%d'.\n",
+                vardef->vardef.name, vardef->vardef.type, type);
+        exit(EXIT_FAILURE);
+    }
+
+    struct ProgramVar *var = program_add_var(c->prog, vardef, len);
+
+    c->hoisted = realloc(c->hoisted, sizeof(int) * c->prog->nvars);
+    c->hoisted[c->prog->nvars - 1] = -1;
+
+    return var;
+}
+
+
+struct ProgramVar *compiler_add_param(struct Compiler *c, struct Node *param, int slot)
+{
+    struct Node vardef = { .type = NODE_VARDEF };
+    vardef.vardef.name = param->param.name;
+    vardef.vardef.modifier = VAR_REG;
+    vardef.vardef.type = param->param.type;
+    vardef.vardef.layout_loc = -1;
+
+    size_t len = compiler_type_len(param->param.name, param->param.type, param->param.len);
+    struct ProgramVar *var = program_alias_var(c->prog, &vardef, len, slot);
+
+    c->hoisted = realloc(c->hoisted, sizeof(int) * c->prog->nvars);
+    c->hoisted[c->prog->nvars - 1] = -1;
+
+    return var;
+}
+
+
+void compiler_alloc_func(struct Compiler *c, struct CompilerFunc *f)
+{
+    struct Program *p = c->prog;
+    struct Node *fdef = f->fdef;
+
+    f->params = p->nvarslots;
+
+    for (size_t i = 0; i < fdef->fdef.nparams; ++i)
+    {
+        struct Node *param = fdef->fdef.params[i];
+        p->nvarslots += compiler_type_len(param->param.name, param->param.type, param->param.len);
+    }
+
+    f->ret = p->nvarslots;
+    f->len = fdef->fdef.type == NODE_VOID ? 0 : compiler_type_len(fdef->fdef.name, fdef->fdef.type, fdef->fdef.len);
+    p->nvarslots += f->len;
+}
+
+
+size_t compiler_type_len(const char *name, NodeType type, size_t len)
+{
+    switch (type)
+    {
+    case NODE_INT:
+    case NODE_FLOAT:
+        return 1;
+    case NODE_VEC: return len;
+    default:
+        fprintf(stderr, "[compiler_type_len] Error: '%s' does not have a data type.\n", name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+struct ProgramVar *compiler_find_var(struct Compiler *c, const char *name)
+{
+    struct Program *p = c->prog;
+
+    // Locals of the function being compiled shadow globals
+    for (size_t i = p->nvars; i > c->scope_start; --i)
+    {
+        if (strcmp(p->vars[i - 1].name, name) == 0)
+            return &p->vars[i - 1];
+    }
+
+    for (size_t i = 0; i < c->nglobals; ++i)
+    {
+        if (strcmp(p->vars[i].name, name) == 0)
+            return &p->vars[i];
+    }
+
+    fprintf(stderr, "[compiler_find_var] Error: No variable named '%s'.\n", name);
+    exit(EXIT_FAILURE);
+}
+
+
+int compiler_alloc_regs(struct Compiler *c, size_t n)
+{
+    int reg = c->reg;
+    c->reg += n;
+
+    if (c->reg - COMPILER_TEMP_BASE > c->ntemps)
+        c->ntemps = c->reg - COMPILER_TEMP_BASE;
+
+    return reg;
+}
+
+
+void compiler_relocate(struct Compiler *c)
+{
+    struct Program *p = c->prog;
+    int offset = p->nvarslots - COMPILER_TEMP_BASE;
+
+#define RELOCATE(reg) if (IS_TEMP(reg)) reg += offset
+
+    for (size_t i = 0; i < p->ncode; ++i)
+    {
+        struct Instr *in = &p->code[i];
+
+        switch (in->op)
+        {
+        case OP_LOADK:
+            RELOCATE(in->dst);
+            break;
+        case OP_MOV:
+        case OP_SPLAT:
+        case OP_BUILTIN:
+        case OP_BUILTIN_FAST:
+            RELOCATE(in->dst);
+            RELOCATE(in->a);
+            break;
+        case OP_CALL:
+        case OP_RET:
+            break;
+        default:
+            RELOCATE(in->dst);
+            RELOCATE(in->a);
+            RELOCATE(in->b);
+        }
+    }
+
+#undef RELOCATE
+
+    p->nslots = p->nvarslots + c->ntemps;
+}
+
+
+void compiler_compile_globals(struct Compiler *c, struct Node *root, bool dynamic)
+{
+    struct Program *p = c->prog;
+
+    for (size_t i = 0, var = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+        if (n->type != NODE_VARDEF) continue;
+
+        if (!(p->vars[var].modifier & (VAR_IN | VAR_LAYOUT)))
+        {
+            if (!dynamic && compiler_is_dynamic(c, n->vardef.value))
+                c->dynamic[var] = true;
+
+            if (c->dynamic[var] == dynamic)
+            {
+                struct ExprValue v = compiler_compile_store(c, &p->vars[var], n->vardef.value);
+
+                if (dynamic)
+                    compiler_track(c, &p->vars[var], n->vardef.value, v);
+            }
+        }
+
+        ++var;
+    }
+
+    program_emit(p, (struct Instr){ OP_RET });
+}
+
+
+bool compiler_is_dynamic(struct Compiler *c, struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_VAR:
+    {
+        struct ProgramVar *var = compiler_find_var(c, n->var.name);
+        return c->dynamic[var - c->prog->vars];
+    }
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            if (compiler_is_dynamic(c, n->construct.args[i]))
+                return true;
+        }
+
+        return false;
+    case NODE_BINOP: return compiler_is_dynamic(c, n->binop.l) || compiler_is_dynamic(c, n->binop.r);
+    case NODE_FUNC_CALL:
+        // User functions may read anything
+        if (program_find_func(c->prog, n->call.name) != -1)
+            return true;
+
+        for (size_t i = 0; i < n->call.nargs; ++i)
+        {
+            if (compiler_is_dynamic(c, n->call.args[i]))
+                return true;
+        }
+
+        return false;
+    default: return false;
+    }
+}
+
+
+void compiler_build_image(struct Compiler *c)
+{
+    struct Program *p = c->prog;
+
+    // Run setup on a scratch frame, whatever it leaves behind is the image
+    p->image = calloc(p->nslots ? p->nslots : 1, sizeof(float));
+
+    struct Frame f = { p, p->image, 1 };
+    vm_run(&f, p->setup);
+}
+
+
+void compiler_find_resets(struct Compiler *c)
+{
+    struct Program *p = c->prog;
+
+    // GRSL has no branches, so one pass over the code in execution order
+    // sees every access an invocation makes
+    char *state = calloc(p->nvarslots ? p->nvarslots : 1, sizeof(char));
+
+    compiler_trace(c, p->init, state);
+    compiler_trace(c, p->entry, state);
+
+    for (size_t i = 0; i < p->nvarslots; ++i)
+    {
+        if (state[i] != (TRACE_READ | TRACE_WRITTEN)) continue;
+
+        if (p->nresets && p->resets[p->nresets - 1].slot + p->resets[p->nresets - 1].len == i)
+        {
+            ++p->resets[p->nresets - 1].len;
+        }
+        else
+        {
+            p->resets = realloc(p->resets, sizeof(struct ProgramRange) * ++p->nresets);
+            p->resets[p->nresets - 1] = (struct ProgramRange){ i, 1 };
+        }
+    }
+
+    free(state);
+}
+
+
+void compiler_trace(struct Compiler *c, size_t offset, char *state)
+{
+    struct Program *p = c->prog;
+
+    size_t stack[VM_CALL_DEPTH];
+    size_t sp = 0;
+
+    size_t pc = offset;
+
+#define READ(reg, n) for (int j = 0; j < (n); ++j) \
+        if ((reg) + j < p->nvarslots && !state[(reg) + j]) state[(reg) + j] = TRACE_READ
+#define WRITE(reg, n) for (int j = 0; j < (n); ++j) \
+        if ((reg) + j < p->nvarslots) state[(reg) + j] |= TRACE_WRITTEN
+
+    while (true)
+    {
+        struct Instr *in = &p->code[pc++];
+
+        switch (in->op)
+        {
+        case OP_LOADK:
+            WRITE(in->dst, 1);
+            break;
+        case OP_MOV:
+            READ(in->a, in->n);
+            WRITE(in->dst, in->n);
+            break;
+        case OP_VADD:
+        case OP_VSUB:
+        case OP_VMUL:
+        case OP_VDIV:
+            READ(in->a, in->n);
+            READ(in->b, in->n);
+            WRITE(in->dst, in->n);
+            break;
+        case OP_SPLAT:
+            READ(in->a, 1);
+            WRITE(in->dst, in->n);
+            break;
+        case OP_BUILTIN:
+        case OP_BUILTIN_FAST:
+        {
+            const struct Builtin *b = &builtins[in->b];
+            READ(in->a, (int)(in->n * b->nargs));
+            WRITE(in->dst, (int)builtin_result_len(b, in->n));
+        } break;
+        case OP_CALL:
+            // Overflow is reported by the vm
+            if (sp == VM_CALL_DEPTH) return;
+
+            stack[sp++] = pc;
+            pc = p->funcs[in->a].offset;
+            break;
+        case OP_RET:
+            if (sp == 0) return;
+            pc = stack[--sp];
+            break;
+        default:
+            READ(in->a, 1);
+            READ(in->b, 1);
+            WRITE(in->dst, 1);
+        }
+    }
+
+#undef READ
+#undef WRITE
+}
+
+
+void compiler_compile_fdef(struct Compiler *c, struct Node *fdef)
+{
+    struct Program *p = c->prog;
+    c->func = program_find_func(p, fdef->fdef.name);
+
+    struct CompilerFunc *f = &c->funcs[c->func];
+    p->funcs[c->func].offset = p->ncode;
+
+    // Locals keep their slots but go out of scope with the function
+    c->scope_start = p->nvars;
+    compiler_reset_hoisted(c, strcmp(fdef->fdef.name, "main") == 0);
+
+    for (size_t i = 0, slot = f->params; i < fdef->fdef.nparams; ++i)
+        slot += compiler_add_param(c, fdef->fdef.params[i], slot)->len;
+
+    struct Node *body = fdef->fdef.body;
+    bool returned = false;
+
+    for (size_t i = 0; i < body->comp.nvalues; ++i)
+    {
+        if (!body->comp.values[i]) continue;
+
+        compiler_compile_stmt(c, body->comp.values[i]);
+        returned = body->comp.values[i]->type == NODE_RETURN;
+    }
+
+    if (!returned)
+    {
+        if (f->len)
+        {
+            fprintf(stderr, "[compiler_compile_fdef] Error: '%s' does not return a value.\n", fdef->fdef.name);
+            exit(EXIT_FAILURE);
+        }
+
+        program_emit(p, (struct Instr){ OP_RET });
+    }
+
+    c->scope_start = p->nvars;
+    c->func = -1;
+}
+
+
+void compiler_compile_stmt(struct Compiler *c, struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_VARDEF:
+    {
+        struct ProgramVar *var = compiler_add_var(c, n);
+        compiler_track(c, var, n->vardef.value, compiler_compile_store(c, var, n->vardef.value));
+    } break;
+    case NODE_FUNC_CALL: compiler_compile_call(c, n, -1); break;
+    case NODE_RETURN: compiler_compile_return(c, n); break;
+    default:
+        compiler_compile_expr(c, n, -1);
+    }
+
+    // Temporaries never outlive a statement
+    c->reg = COMPILER_TEMP_BASE;
+}
+
+
+struct ExprValue compiler_compile_store(struct Compiler *c, struct ProgramVar *var, struct Node *n)
+{
+    struct Program *p = c->prog;
+    struct ExprValue v = compiler_compile_expr(c, n, -1);
+
+    if (var->type != v.type || var->len != v.len)
+    {
+        fprintf(stderr, "[compiler_compile_store] Error: Mismatched types on '%s' assignment: '%d' and '%d'.\n",
+                var->name, var->type, v.type);
+        exit(EXIT_FAILURE);
+    }
+
+    // Scalar results can be written to the variable directly, vectors could
+    // clobber components they still read
+    struct Instr *last = p->ncode ? &p->code[p->ncode - 1] : 0;
+
+    if (v.len == 1 && IS_TEMP(v.reg) && last && last->op != OP_CALL && last->op != OP_RET && last->dst == v.reg)
+        last->dst = var->slot;
+    else if (v.reg != var->slot)
+        program_emit(p, (struct Instr){ OP_MOV, var->slot, v.reg, .n = v.len });
+
+    return v;
+}
+
+
+struct ExprValue compiler_compile_expr(struct Compiler *c, struct Node *n, int dst)
+{
+    // Work that only depends on uniforms moves to the per draw block
+    if (c->hoisting && (n->type == NODE_BINOP || n->type == NODE_CONSTRUCTOR || n->type == NODE_FUNC_CALL) &&
+        compiler_is_uniform(c, n))
+        return compiler_hoist(c, n, dst);
+
+    switch (n->type)
+    {
+    case NODE_INT:
+    case NODE_FLOAT:
+    {
+        if (dst == -1) dst = compiler_alloc_regs(c, 1);
+        float f = n->type == NODE_INT ? n->int_value : n->float_value;
+
+        program_emit(c->prog, (struct Instr){ OP_LOADK, dst, program_add_const(c->prog, f) });
+        return (struct ExprValue){ dst, n->type, 1 };
+    }
+    case NODE_VAR: return compiler_compile_var(c, n, dst);
+    case NODE_VEC: return compiler_compile_vec(c, n, dst);
+    case NODE_CONSTRUCTOR: return compiler_compile_construct(c, n, dst);
+    case NODE_BINOP: return compiler_compile_binop(c, n, dst);
+    case NODE_ASSIGN: return compiler_compile_assign(c, n, dst);
+    case NODE_FUNC_CALL: return compiler_compile_call(c, n, dst);
+    default:
+        fprintf(stderr, "[compiler_compile_expr] Error: Unexpected node of type %d in expression.\n",
+                n->type);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+struct ExprValue compiler_compile_var(struct Compiler *c, struct Node *n, int dst)
+{
+    struct ProgramVar *var = compiler_find_var(c, n->var.name);
+    int hoisted = c->hoisted[var - c->prog->vars];
+
+    struct ExprValue v = { hoisted != -1 ? hoisted : var->slot, var->type, var->len };
+
+    if (n->var.memb_access)
+    {
+        int comps[NODE_VEC_MAX];
+        size_t len = compiler_swizzle(var, n->var.memb_access, comps);
+
+        bool run = true;
+
+        for (size_t i = 1; i < len; ++i)
+            run &= comps[i] == comps[0] + (int)i;
+
+        // Ascending runs like .yz are read in place, anything else is
+        // gathered into new registers
+        if (!run)
+        {
+            if (dst == -1) dst = compiler_alloc_regs(c, len);
+
+            for (size_t i = 0; i < len; ++i)
+                program_emit(c->prog, (struct Instr){ OP_MOV, dst + i, v.reg + comps[i], .n = 1 });
+
+            return (struct ExprValue){ dst, NODE_VEC, len };
+        }
+
+        v = (struct ExprValue){ v.reg + comps[0], len == 1 ? NODE_FLOAT : NODE_VEC, len };
+    }
+
+    // Variables are read in place unless the caller needs the value elsewhere
+    if (dst != -1)
+    {
+        program_emit(c->prog, (struct Instr){ OP_MOV, dst, v.reg, .n = v.len });
+        v.reg = dst;
+    }
+
+    return v;
+}
+
+
+struct ExprValue compiler_compile_vec(struct Compiler *c, struct Node *n, int dst)
+{
+    if (dst == -1) dst = compiler_alloc_regs(c, n->vec.len);
+
+    for (size_t i = 0; i < n->vec.len; ++i)
+        program_emit(c->prog, (struct Instr){ OP_LOADK, dst + i, program_add_const(c->prog, n->vec.values[i]) });
+
+    return (struct ExprValue){ dst, NODE_VEC, n->vec.len };
+}
+
+
+struct ExprValue compiler_compile_construct(struct Compiler *c, struct Node *n, int dst)
+{
+    if (n->construct.type != NODE_VEC)
+        return compiler_compile_expr(c, n->construct.args[0], dst);
+
+    if (dst == -1) dst = compiler_alloc_regs(c, n->construct.nargs);
+
+    for (size_t i = 0; i < n->construct.nargs; ++i)
+    {
+        struct ExprValue v = compiler_compile_expr(c, n->construct.args[i], dst + i);
+
+        if (v.len != 1)
+        {
+            fprintf(stderr, "[compiler_compile_construct] Error: Vector components must be scalars.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    return (struct ExprValue){ dst, NODE_VEC, n->construct.nargs };
+}
+
+
+struct ExprValue compiler_compile_binop(struct Compiler *c, struct Node *n, int dst)
+{
+    int mark = c->reg;
+
+    struct ExprValue l = compiler_compile_expr(c, n->binop.l, -1);
+    struct ExprValue r = compiler_compile_expr(c, n->binop.r, -1);
+
+    if (l.type == NODE_VEC || r.type == NODE_VEC)
+        return compiler_compile_vec_binop(c, n->binop.op, l, r, mark, dst);
+
+    if (l.type != r.type)
+    {
+        fprintf(stderr, "[compiler_compile_binop] Error: Types %d and %d are incompatible.\n",
+                l.type, r.type);
+        exit(EXIT_FAILURE);
+    }
+
+    Opcode op;
+
+    switch (l.type)
+    {
+    case NODE_FLOAT: op = OP_ADD + n->binop.op; break;
+    case NODE_INT: op = OP_IADD + n->binop.op; break;
+    default:
+        fprintf(stderr, "[compiler_compile_binop] Error: %d is not a data type.\n", l.type);
+        exit(EXIT_FAILURE);
+    }
+
+    // Operands are dead after this, reuse their registers
+    c->reg = mark;
+    if (dst == -1) dst = compiler_alloc_regs(c, 1);
+
+    program_emit(c->prog, (struct Instr){ op, dst, l.reg, r.reg });
+    return (struct ExprValue){ dst, l.type, 1 };
+}
+
+
+struct ExprValue compiler_compile_vec_binop(struct Compiler *c, Binop op, struct ExprValue l, struct ExprValue r,
+                                           int mark, int dst)
+{
+    // Float scalars are broadcast to the other side's length
+    if (l.len != r.len && (l.len == 1 ? l.type : r.type) == NODE_FLOAT)
+    {
+        struct ExprValue *s = l.len == 1 ? &l : &r;
+        size_t len = l.len == 1 ? r.len : l.len;
+
+        int reg = compiler_alloc_regs(c, len);
+        program_emit(c->prog, (struct Instr){ OP_SPLAT, reg, s->reg, .n = len });
+
+        *s = (struct ExprValue){ reg, NODE_VEC, len };
+    }
+
+    if (l.type != r.type || l.len != r.len)
+    {
+        fprintf(stderr, "[compiler_compile_vec_binop] Error: Types %d (%zu) and %d (%zu) are incompatible.\n",
+                l.type, l.len, r.type, r.len);
+        exit(EXIT_FAILURE);
+    }
+
+    // Components are computed in order and operands never sit below dst,
+    // so reusing their registers is safe here too
+    c->reg = mark;
+    if (dst == -1) dst = compiler_alloc_regs(c, l.len);
+
+    program_emit(c->prog, (struct Instr){ OP_VADD + op, dst, l.reg, r.reg, l.len });
+    return (struct ExprValue){ dst, NODE_VEC, l.len };
+}
+
+
+struct ExprValue compiler_compile_call(struct Compiler *c, struct Node *n, int dst)
+{
+    struct Program *p = c->prog;
+    int idx = program_find_func(p, n->call.name);
+
+    if (idx == -1)
+    {
+        int b = builtin_find(n->call.name);
+        if (b != -1) return compiler_compile_builtin(c, n, b, dst);
+
+        fprintf(stderr, "[compiler_compile_call] Error: No function named '%s'.\n", n->call.name);
+        exit(EXIT_FAILURE);
+    }
+
+    struct CompilerFunc *f = &c->funcs[idx];
+    struct Node *fdef = f->fdef;
+
+    if (n->call.nargs != fdef->fdef.nparams)
+    {
+        fprintf(stderr, "[compiler_compile_call] Error: '%s' takes %zu arguments, %zu were given.\n",
+                n->call.name, fdef->fdef.nparams, n->call.nargs);
+        exit(EXIT_FAILURE);
+    }
+
+    // A call in a later argument could overwrite the parameters stored so
+    // far, those calls get every argument evaluated into temporaries first
+    bool nested = false;
+
+    for (size_t i = 0; i < n->call.nargs; ++i)
+        nested |= compiler_has_call(c, n->call.args[i]);
+
+    int mark = c->reg;
+    int *temps = malloc(sizeof(int) * (n->call.nargs ? n->call.nargs : 1));
+
+    for (size_t i = 0, slot = f->params; i < n->call.nargs; ++i)
+    {
+        struct Node *param = fdef->fdef.params[i];
+        size_t len = compiler_type_len(param->param.name, param->param.type, param->param.len);
+
+        // Parameters are passed by value
+        temps[i] = nested ? compiler_alloc_regs(c, len) : (int)slot;
+
+        struct ProgramVar var = { (char*)param->param.name, VAR_REG, param->param.type, len, temps[i] };
+        compiler_compile_store(c, &var, n->call.args[i]);
+
+        slot += len;
+    }
+
+    for (size_t i = 0, slot = f->params; nested && i < n->call.nargs; ++i)
+    {
+        struct Node *param = fdef->fdef.params[i];
+        size_t len = compiler_type_len(param->param.name, param->param.type, param->param.len);
+
+        program_emit(p, (struct Instr){ OP_MOV, slot, temps[i], .n = len });
+        slot += len;
+    }
+
+    free(temps);
+    c->reg = mark;
+
+    program_emit(p, (struct Instr){ OP_CALL, .a = idx });
+
+    // Callees can overwrite any global
+    compiler_reset_hoisted(c, false);
+
+    if (!f->len)
+        return (struct ExprValue){ -1, NODE_VOID, 0 };
+
+    // The next call overwrites the return value, so it's always copied
+    if (dst == -1) dst = compiler_alloc_regs(c, f->len);
+
+    program_emit(p, (struct Instr){ OP_MOV, dst, f->ret, .n = f->len });
+    return (struct ExprValue){ dst, fdef->fdef.type, f->len };
+}
+
+
+void compiler_compile_return(struct Compiler *c, struct Node *n)
+{
+    struct CompilerFunc *f = &c->funcs[c->func];
+    struct Node *fdef = f->fdef;
+
+    if (!n->ret.value != !f->len)
+    {
+        fprintf(stderr, "[compiler_compile_return] Error: '%s' must return %s.\n", fdef->fdef.name,
+                f->len ? "a value" : "nothing");
+        exit(EXIT_FAILURE);
+    }
+
+    if (n->ret.value)
+    {
+        struct ProgramVar ret = { (char*)fdef->fdef.name, VAR_REG, fdef->fdef.type, f->len, f->ret };
+        compiler_compile_store(c, &ret, n->ret.value);
+    }
+
+    program_emit(c->prog, (struct Instr){ OP_RET });
+}
+
+
+bool compiler_has_call(struct Compiler *c, struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_FUNC_CALL:
+        if (program_find_func(c->prog, n->call.name) != -1)
+            return true;
+
+        for (size_t i = 0; i < n->call.nargs; ++i)
+        {
+            if (compiler_has_call(c, n->call.args[i]))
+                return true;
+        }
+
+        return false;
+    case NODE_BINOP: return compiler_has_call(c, n->binop.l) || compiler_has_call(c, n->binop.r);
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            if (compiler_has_call(c, n->construct.args[i]))
+                return true;
+        }
+
+        return false;
+    case NODE_ASSIGN: return compiler_has_call(c, n->assign.right);
+    default:
+        return false;
+    }
+}
+
+
+struct ExprValue compiler_compile_builtin(struct Compiler *c, struct Node *n, int idx, int dst)
+{
+    const struct Builtin *b = &builtins[idx];
+
+    if (n->call.nargs != b->nargs)
+    {
+        fprintf(stderr, "[compiler_compile_builtin] Error: '%s' takes %zu arguments, %zu were given.\n",
+                b->name, b->nargs, n->call.nargs);
+        exit(EXIT_FAILURE);
+    }
+
+    // Every argument takes as many registers as the longest one
+    size_t len = 1;
+
+    for (size_t i = 0; i < n->call.nargs; ++i)
+    {
+        NodeType type;
+        size_t alen;
+        compiler_infer(c, n->call.args[i], &type, &alen);
+
+        if (type != NODE_FLOAT && type != NODE_VEC)
+        {
+            fprintf(stderr, "[compiler_compile_builtin] Error: '%s' takes float or vector arguments.\n", b->name);
+            exit(EXIT_FAILURE);
+        }
+
+        if (alen > len)
+            len = alen;
+    }
+
+    if (b->len && len != b->len)
+    {
+        fprintf(stderr, "[compiler_compile_builtin] Error: '%s' takes vec%zu arguments.\n", b->name, b->len);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t out = builtin_result_len(b, len);
+
+    // The result goes below the arguments so they can be freed after the
+    // call, natives never write to the registers they read
+    int mark = c->reg;
+    int res = dst != -1 ? dst : compiler_alloc_regs(c, out);
+    int args = compiler_alloc_regs(c, len * b->nargs);
+
+    for (size_t i = 0; i < n->call.nargs; ++i)
+    {
+        int reg = args + i * len;
+        struct ExprValue v = compiler_compile_expr(c, n->call.args[i], reg);
+
+        if (v.len == len) continue;
+
+        if (v.len != 1 || b->shape != BUILTIN_MAP)
+        {
+            fprintf(stderr, "[compiler_compile_builtin] Error: Arguments of '%s' must have the same length.\n",
+                    b->name);
+            exit(EXIT_FAILURE);
+        }
+
+        program_emit(c->prog, (struct Instr){ OP_SPLAT, reg, reg, .n = len });
+    }
+
+    c->reg = dst != -1 ? mark : res + (int)out;
+
+    Opcode op = c->flags & COMPILER_FAST_MATH ? OP_BUILTIN_FAST : OP_BUILTIN;
+    program_emit(c->prog, (struct Instr){ op, res, args, idx, len });
+
+    return (struct ExprValue){ res, out == 1 ? NODE_FLOAT : NODE_VEC, out };
+}
+
+
+size_t compiler_swizzle(struct ProgramVar *var, const char *memb, int *comps)
+{
+    static const char *sets[] = { "xyzw", "rgba" };
+
+    size_t len = strlen(memb);
+    const char *set = 0;
+
+    for (size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); ++i)
+    {
+        if (strchr(sets[i], memb[0]))
+            set = sets[i];
+    }
+
+    bool valid = var->type == NODE_VEC && set && len <= NODE_VEC_MAX;
+
+    for (size_t i = 0; valid && i < len; ++i)
+    {
+        const char *at = strchr(set, memb[i]);
+        valid = at && (size_t)(at - set) < var->len;
+
+        if (valid)
+            comps[i] = at - set;
+    }
+
+    if (!valid)
+    {
+        fprintf(stderr, "[compiler_swizzle] Error: Invalid member access '%s.%s'.\n", var->name, memb);
+        exit(EXIT_FAILURE);
+    }
+
+    return len;
+}
+
+
+struct ExprValue compiler_compile_assign(struct Compiler *c, struct Node *n, int dst)
+{
+    struct ProgramVar *var = compiler_find_var(c, n->assign.left->var.name);
+
+    if (var->modifier & (VAR_IN | VAR_LAYOUT))
+    {
+        fprintf(stderr, "[compiler_compile_assign] Error: Cannot assign to input variable '%s'.\n", var->name);
+        exit(EXIT_FAILURE);
+    }
+    compiler_track(c, var, n->assign.right, compiler_compile_store(c, var, n->assign.right));
+
+    struct ExprValue v = { var->slot, var->type, var->len };
+
+    if (dst != -1)
+    {
+        program_emit(c->prog, (struct Instr){ OP_MOV, dst, v.reg, .n = v.len });
+        v.reg = dst;
+    }
+
+    return v;
+}
+
+
+struct ExprValue compiler_hoist(struct Compiler *c, struct Node *n, int dst)
+{
+    struct Program *p = c->prog;
+
+    NodeType type;
+    size_t len;
+    compiler_infer(c, n, &type, &len);
+
+    // Hidden variable slots, nothing but the uniform block writes them so
+    // they're never reset
+    int slot = p->nvarslots;
+    p->nvarslots += len;
+
+    int mark = c->reg;
+
+    compiler_swap_code(c);
+    c->hoisting = false;
+
+    compiler_compile_expr(c, n, slot);
+
+    c->hoisting = true;
+    compiler_swap_code(c);
+
+    c->reg = mark;
+
+    struct ExprValue v = { slot, type, len };
+
+    if (dst != -1)
+    {
+        program_emit(p, (struct Instr){ OP_MOV, dst, v.reg, .n = v.len });
+        v.reg = dst;
+    }
+
+    return v;
+}
+
+
+bool compiler_is_uniform(struct Compiler *c, struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_INT:
+    case NODE_FLOAT:
+    case NODE_VEC:
+        return true;
+    case NODE_VAR: return c->hoisted[compiler_find_var(c, n->var.name) - c->prog->vars] != -1;
+    case NODE_BINOP: return compiler_is_uniform(c, n->binop.l) && compiler_is_uniform(c, n->binop.r);
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            if (!compiler_is_uniform(c, n->construct.args[i]))
+                return false;
+        }
+
+        return true;
+    case NODE_FUNC_CALL:
+        if (builtin_find(n->call.name) == -1)
+            return false;
+
+        for (size_t i = 0; i < n->call.nargs; ++i)
+        {
+            if (!compiler_is_uniform(c, n->call.args[i]))
+                return false;
+        }
+
+        return true;
+    default:
+        return false;
+    }
+}
+
+
+void compiler_track(struct Compiler *c, struct ProgramVar *var, struct Node *n, struct ExprValue v)
+{
+    // Temporaries and the variable's own slot don't hold the value when
+    // the uniform block runs
+    bool uniform = compiler_is_uniform(c, n) && !IS_TEMP(v.reg) && v.reg != var->slot;
+    c->hoisted[var - c->prog->vars] = uniform ? v.reg : -1;
+}
+
+
+void compiler_reset_hoisted(struct Compiler *c, bool main)
+{
+    struct Program *p = c->prog;
+
+    if (main && c->init_hoisted)
+    {
+        memcpy(c->hoisted, c->init_hoisted, sizeof(int) * c->nglobals);
+        return;
+    }
+
+    for (size_t i = 0; i < c->nglobals; ++i)
+    {
+        struct ProgramVar *var = &p->vars[i];
+        c->hoisted[i] = var->modifier == VAR_IN && var->uniform ? var->slot : -1;
+    }
+}
+
+
+void compiler_swap_code(struct Compiler *c)
+{
+    struct Instr *code = c->prog->code;
+    size_t ncode = c->prog->ncode;
+
+    c->prog->code = c->ucode;
+    c->prog->ncode = c->nucode;
+
+    c->ucode = code;
+    c->nucode = ncode;
+}
+
+
+void compiler_infer(struct Compiler *c, struct Node *n, NodeType *type, size_t *len)
+{
+    switch (n->type)
+    {
+    case NODE_INT:
+    case NODE_FLOAT:
+        *type = n->type;
+        *len = 1;
+        break;
+    case NODE_VEC:
+        *type = NODE_VEC;
+        *len = n->vec.len;
+        break;
+    case NODE_VAR:
+    {
+        struct ProgramVar *var = compiler_find_var(c, n->var.name);
+        *type = var->type;
+        *len = var->len;
+
+        if (n->var.memb_access)
+        {
+            int comps[NODE_VEC_MAX];
+            *len = compiler_swizzle(var, n->var.memb_access, comps);
+            *type = *len == 1 ? NODE_FLOAT : NODE_VEC;
+        }
+    } break;
+    case NODE_CONSTRUCTOR:
+        if (n->construct.type == NODE_VEC)
+        {
+            *type = NODE_VEC;
+            *len = n->construct.nargs;
+        }
+        else
+        {
+            compiler_infer(c, n->construct.args[0], type, len);
+        }
+        break;
+    case NODE_BINOP:
+    {
+        NodeType rtype;
+        size_t rlen;
+
+        compiler_infer(c, n->binop.l, type, len);
+        compiler_infer(c, n->binop.r, &rtype, &rlen);
+
+        // Scalars are broadcast against vectors
+        if (rtype == NODE_VEC && *type != NODE_VEC)
+        {
+            *type = rtype;
+            *len = rlen;
+        }
+    } break;
+    case NODE_ASSIGN: compiler_infer(c, n->assign.right, type, len); break;
+    case NODE_FUNC_CALL:
+    {
+        int func = program_find_func(c->prog, n->call.name);
+        int idx = builtin_find(n->call.name);
+
+        *type = NODE_VOID;
+        *len = 0;
+
+        if (func != -1)
+        {
+            *type = c->funcs[func].fdef->fdef.type;
+            *len = c->funcs[func].len;
+        }
+
+        if (func != -1 || idx == -1) break;
+
+        size_t l = 1;
+
+        for (size_t i = 0; i < n->call.nargs; ++i)
+        {
+            NodeType atype;
+            size_t alen;
+            compiler_infer(c, n->call.args[i], &atype, &alen);
+
+            if (alen > l)
+                l = alen;
+        }
+
+        *len = builtin_result_len(&builtins[idx], l);
+        *type = *len == 1 ? NODE_FLOAT : NODE_VEC;
+    } break;
+    default:
+        *type = NODE_VOID;
+        *len = 0;
+    }
+}
@@ -0,0 +1,127 @@
+#ifndef SHADER_COMPILER_H
+#define SHADER_COMPILER_H
+
+#include "bytecode.h"
+
+// Temporaries are numbered from here until all variable slots are known
+#define COMPILER_TEMP_BASE (1 << 24)
+
+// Slot access state used by compiler_trace
+#define TRACE_READ 1
+#define TRACE_WRITTEN 2
+
+// compiler_compile flags
+#define COMPILER_FAST_MATH 1 // Approximate built-ins, see mathlib.h for the error bounds
+
+struct ExprValue
+{
+    int reg;
+    NodeType type;
+    size_t len;
+};
+
+struct Compiler
+{
+    struct Program *prog;
+    int flags;
+
+    // Variables visible to the function being compiled
+    size_t nglobals, scope_start;
+
+    // Globals whose initializer has to run every invocation
+    bool *dynamic;
+
+    // Next free temporary
+    int reg;
+    int ntemps;
+
+    // Per draw code, swapped with the program's code while hoisting into it
+    struct Instr *ucode;
+    size_t nucode;
+    bool hoisting;
+
+    // Per variable slot holding its current value when that only depends
+    // on uniforms, -1 otherwise. init_hoisted is the state main starts in.
+    int *hoisted;
+    int *init_hoisted;
+
+    // Per function in prog->funcs, first slot of its parameters and of
+    // its return value, len is the return value's
+    struct CompilerFunc
+    {
+        struct Node *fdef;
+        int params, ret;
+        size_t len;
+    } *funcs;
+
+    // Index of the function being compiled, -1 outside of functions
+    int func;
+};
+
+// Compiles a parsed shader, entry point is main. root is optimized in place
+// first.
+struct Program *compiler_compile(struct Node *root, int flags);
+
+struct Compiler *compiler_alloc();
+void compiler_free(struct Compiler *c);
+
+struct ProgramVar *compiler_add_var(struct Compiler *c, struct Node *vardef);
+struct ProgramVar *compiler_find_var(struct Compiler *c, const char *name);
+struct ProgramVar *compiler_add_param(struct Compiler *c, struct Node *param, int slot);
+// Gives f slots for its parameters and return value
+void compiler_alloc_func(struct Compiler *c, struct CompilerFunc *f);
+// Slots a value of the type takes, name is for errors
+size_t compiler_type_len(const char *name, NodeType type, size_t len);
+
+int compiler_alloc_regs(struct Compiler *c, size_t n);
+// Moves temporaries behind the variable slots
+void compiler_relocate(struct Compiler *c);
+
+// Emits initializers of dynamic or constant globals
+void compiler_compile_globals(struct Compiler *c, struct Node *root, bool dynamic);
+bool compiler_is_dynamic(struct Compiler *c, struct Node *n);
+
+void compiler_build_image(struct Compiler *c);
+void compiler_find_resets(struct Compiler *c);
+// Marks slots in state as read and/or written, in execution order
+void compiler_trace(struct Compiler *c, size_t offset, char *state);
+
+void compiler_compile_fdef(struct Compiler *c, struct Node *fdef);
+void compiler_compile_stmt(struct Compiler *c, struct Node *n);
+// Evaluates n into the slots of var, returns where n was evaluated to
+struct ExprValue compiler_compile_store(struct Compiler *c, struct ProgramVar *var, struct Node *n);
+
+// dst: register to store the result in, or -1 to allocate one
+struct ExprValue compiler_compile_expr(struct Compiler *c, struct Node *n, int dst);
+struct ExprValue compiler_compile_var(struct Compiler *c, struct Node *n, int dst);
+struct ExprValue compiler_compile_vec(struct Compiler *c, struct Node *n, int dst);
+struct ExprValue compiler_compile_construct(struct Compiler *c, struct Node *n, int dst);
+struct ExprValue compiler_compile_binop(struct Compiler *c, struct Node *n, int dst);
+// Component wise, scalars are broadcast. mark is the first register the
+// operands took.
+struct ExprValue compiler_compile_vec_binop(struct Compiler *c, Binop op, struct ExprValue l, struct ExprValue r,
+                                           int mark, int dst);
+struct ExprValue compiler_compile_call(struct Compiler *c, struct Node *n, int dst);
+void compiler_compile_return(struct Compiler *c, struct Node *n);
+// Whether n calls a user function
+bool compiler_has_call(struct Compiler *c, struct Node *n);
+// Call to builtins[idx], arguments are evaluated into consecutive registers
+struct ExprValue compiler_compile_builtin(struct Compiler *c, struct Node *n, int idx, int dst);
+// Component indices of a swizzle like .zyx or .rgb, returns their count
+size_t compiler_swizzle(struct ProgramVar *var, const char *memb, int *comps);
+struct ExprValue compiler_compile_assign(struct Compiler *c, struct Node *n, int dst);
+
+// Compiles n into the uniform block and returns the slot it ends up in
+struct ExprValue compiler_hoist(struct Compiler *c, struct Node *n, int dst);
+bool compiler_is_uniform(struct Compiler *c, struct Node *n);
+// Records where var's value lives after storing n to it
+void compiler_track(struct Compiler *c, struct ProgramVar *var, struct Node *n, struct ExprValue v);
+// Forgets every global except uniform in variables, main starts from the
+// state init leaves behind
+void compiler_reset_hoisted(struct Compiler *c, bool main);
+void compiler_swap_code(struct Compiler *c);
+
+// Type and length of an expression without emitting code
+void compiler_infer(struct Compiler *c, struct Node *n, NodeType *type, size_t *len);
+
+#endif
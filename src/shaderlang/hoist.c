@@ -0,0 +1,695 @@
+#include "hoist.h"
+#include "builtin.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+
+void hoist_stages(struct Arena *a, struct Node *vert, struct Node *frag)
+{
+    struct Hoist *h = hoist_alloc(a, vert, frag);
+
+    hoist_mark_inputs(vert);
+    hoist_find_flat(h);
+    hoist_mark_flat(h);
+    hoist_move_all(h);
+    hoist_drop_outputs(vert, frag);
+
+    hoist_free(h);
+}
+
+
+struct Hoist *hoist_alloc(struct Arena *a, struct Node *vert, struct Node *frag)
+{
+    struct Hoist *h = malloc(sizeof(struct Hoist));
+    h->arena = a;
+    h->vert = vert;
+    h->frag = frag;
+
+    h->flat = calloc(vert->comp.nvalues ? vert->comp.nvalues : 1, sizeof(bool));
+    h->changed = false;
+
+    // Every local is a parameter or a statement of the longest body
+    size_t cap = 1;
+
+    for (int s = 0; s < 2; ++s)
+    {
+        struct Node *root = s ? frag : vert;
+
+        for (size_t i = 0; i < root->comp.nvalues; ++i)
+        {
+            struct Node *n = root->comp.values[i];
+
+            if (n->type == NODE_FUNC_DEF && n->fdef.nparams + n->fdef.body->comp.nvalues > cap)
+                cap = n->fdef.nparams + n->fdef.body->comp.nvalues;
+        }
+    }
+
+    h->locals = malloc(sizeof(struct HoistLocal) * cap);
+    h->nlocals = 0;
+
+    h->varyings = 0;
+    h->nmoved = 0;
+
+    return h;
+}
+
+
+void hoist_free(struct Hoist *h)
+{
+    free(h->flat);
+    free(h->locals);
+    free(h);
+}
+
+
+struct Node *hoist_find_global(struct Node *root, const char *name)
+{
+    int i = hoist_global_index(root, name);
+    return i == -1 ? 0 : root->comp.values[i];
+}
+
+
+int hoist_global_index(struct Node *root, const char *name)
+{
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+
+        if (n->type == NODE_VARDEF && strcmp(n->vardef.name, name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+
+struct Node *hoist_find_func(struct Node *root, const char *name)
+{
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+
+        if (n->type == NODE_FUNC_DEF && strcmp(n->fdef.name, name) == 0)
+            return n;
+    }
+
+    return 0;
+}
+
+
+size_t hoist_len(struct Node *vardef)
+{
+    struct Node *value = vardef->vardef.value;
+    return value && value->type == NODE_VEC ? value->vec.len : 1;
+}
+
+
+bool hoist_assigns(struct Node *n, const char *name)
+{
+    if (!n) return false;
+
+    switch (n->type)
+    {
+    case NODE_ASSIGN:
+        return strcmp(n->assign.left->var.name, name) == 0 || hoist_assigns(n->assign.right, name);
+    case NODE_VARDEF: return hoist_assigns(n->vardef.value, name);
+    case NODE_RETURN: return hoist_assigns(n->ret.value, name);
+    case NODE_FUNC_DEF: return hoist_assigns(n->fdef.body, name);
+    case NODE_BINOP: return hoist_assigns(n->binop.l, name) || hoist_assigns(n->binop.r, name);
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < n->comp.nvalues; ++i)
+        {
+            if (hoist_assigns(n->comp.values[i], name))
+                return true;
+        }
+
+        return false;
+    case NODE_FUNC_CALL:
+        for (size_t i = 0; i < n->call.nargs; ++i)
+        {
+            if (hoist_assigns(n->call.args[i], name))
+                return true;
+        }
+
+        return false;
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            if (hoist_assigns(n->construct.args[i], name))
+                return true;
+        }
+
+        return false;
+    default:
+        return false;
+    }
+}
+
+
+bool hoist_reads(struct Node *n, const char *name)
+{
+    if (!n) return false;
+
+    switch (n->type)
+    {
+    case NODE_VAR: return strcmp(n->var.name, name) == 0;
+    case NODE_ASSIGN: return hoist_reads(n->assign.right, name);
+    case NODE_VARDEF: return hoist_reads(n->vardef.value, name);
+    case NODE_RETURN: return hoist_reads(n->ret.value, name);
+    case NODE_FUNC_DEF: return hoist_reads(n->fdef.body, name);
+    case NODE_BINOP: return hoist_reads(n->binop.l, name) || hoist_reads(n->binop.r, name);
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < n->comp.nvalues; ++i)
+        {
+            if (hoist_reads(n->comp.values[i], name))
+                return true;
+        }
+
+        return false;
+    case NODE_FUNC_CALL:
+        for (size_t i = 0; i < n->call.nargs; ++i)
+        {
+            if (hoist_reads(n->call.args[i], name))
+                return true;
+        }
+
+        return false;
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            if (hoist_reads(n->construct.args[i], name))
+                return true;
+        }
+
+        return false;
+    default:
+        return false;
+    }
+}
+
+
+void hoist_drop_outputs(struct Node *vert, struct Node *frag)
+{
+    for (size_t i = 0; i < vert->comp.nvalues; ++i)
+    {
+        struct Node *n = vert->comp.values[i];
+
+        if (n->type != NODE_VARDEF || n->vardef.modifier != VAR_OUT || strcmp(n->vardef.name, "gr_pos") == 0)
+            continue;
+
+        // Reads by shadowing locals count too, which is only cautious
+        struct Node *in = hoist_find_global(frag, n->vardef.name);
+
+        if (!in || in->vardef.modifier != VAR_IN || !hoist_reads(frag, n->vardef.name))
+            n->vardef.modifier = VAR_REG;
+    }
+}
+
+
+void hoist_mark_inputs(struct Node *root)
+{
+    // Inputs are written once per draw, unless the shader overwrites them.
+    // Writes to shadowing locals count too, which is only cautious.
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+
+        if (n->type == NODE_VARDEF && n->vardef.modifier == VAR_IN)
+            n->vardef.uniform = !hoist_assigns(root, n->vardef.name);
+    }
+}
+
+
+void hoist_find_flat(struct Hoist *h)
+{
+    struct Node *root = h->vert;
+
+    // Start optimistic and clear globals until every write agrees. Without
+    // branches every vertex runs the same writes in the same order, so a
+    // global only ever assigned per draw values is per draw itself.
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+        if (n->type != NODE_VARDEF) continue;
+
+        switch (n->vardef.modifier)
+        {
+        case VAR_IN: h->flat[i] = n->vardef.uniform; break;
+        case VAR_LAYOUT: h->flat[i] = false; break;
+        default: h->flat[i] = true;
+        }
+    }
+
+    do
+    {
+        h->changed = false;
+
+        for (size_t i = 0; i < root->comp.nvalues; ++i)
+        {
+            struct Node *n = root->comp.values[i];
+            h->nlocals = 0;
+
+            if (n->type == NODE_FUNC_DEF)
+                hoist_flow_fdef(h, n);
+
+            if (n->type == NODE_VARDEF && n->vardef.modifier & (VAR_REG | VAR_OUT) && h->flat[i] &&
+                !hoist_flow(h, n->vardef.value))
+            {
+                h->flat[i] = false;
+                h->changed = true;
+            }
+        }
+    } while (h->changed);
+}
+
+
+void hoist_flow_fdef(struct Hoist *h, struct Node *fdef)
+{
+    // Parameters could be anything
+    for (size_t i = 0; i < fdef->fdef.nparams; ++i)
+        h->locals[h->nlocals++] = (struct HoistLocal){ fdef->fdef.params[i]->param.name, false };
+
+    struct Node *body = fdef->fdef.body;
+
+    for (size_t i = 0; i < body->comp.nvalues; ++i)
+    {
+        struct Node *stmt = body->comp.values[i];
+        if (!stmt) continue;
+
+        if (stmt->type == NODE_VARDEF)
+        {
+            size_t idx = h->nlocals++;
+            h->locals[idx] = (struct HoistLocal){ stmt->vardef.name, false };
+            h->locals[idx].flat = hoist_flow(h, stmt->vardef.value);
+        }
+        else
+        {
+            hoist_flow(h, stmt);
+        }
+    }
+}
+
+
+bool hoist_flow(struct Hoist *h, struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_INT:
+    case NODE_FLOAT:
+    case NODE_VEC:
+        return true;
+    case NODE_VAR:
+    {
+        for (size_t i = h->nlocals; i > 0; --i)
+        {
+            if (strcmp(h->locals[i - 1].name, n->var.name) == 0)
+                return h->locals[i - 1].flat;
+        }
+
+        int g = hoist_global_index(h->vert, n->var.name);
+        return g != -1 && h->flat[g];
+    }
+    case NODE_BINOP:
+    {
+        // Both sides may hold assignments
+        bool l = hoist_flow(h, n->binop.l);
+        bool r = hoist_flow(h, n->binop.r);
+        return l && r;
+    }
+    case NODE_CONSTRUCTOR:
+    {
+        bool flat = true;
+
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+            flat &= hoist_flow(h, n->construct.args[i]);
+
+        return flat;
+    }
+    case NODE_FUNC_CALL:
+    {
+        // Whatever the callee writes is covered when its own body is walked,
+        // built-ins only depend on their arguments
+        bool flat = builtin_find(n->call.name) != -1;
+
+        for (size_t i = 0; i < n->call.nargs; ++i)
+            flat &= hoist_flow(h, n->call.args[i]);
+
+        return flat;
+    }
+    case NODE_RETURN:
+        if (n->ret.value)
+            hoist_flow(h, n->ret.value);
+
+        return false;
+    case NODE_ASSIGN:
+    {
+        bool flat = hoist_flow(h, n->assign.right);
+        const char *name = n->assign.left->var.name;
+
+        for (size_t i = h->nlocals; i > 0; --i)
+        {
+            if (strcmp(h->locals[i - 1].name, name) == 0)
+            {
+                h->locals[i - 1].flat = flat;
+                return flat;
+            }
+        }
+
+        int g = hoist_global_index(h->vert, name);
+
+        if (g != -1 && h->flat[g] && !flat)
+        {
+            h->flat[g] = false;
+            h->changed = true;
+        }
+
+        return flat;
+    }
+    default:
+        return false;
+    }
+}
+
+
+void hoist_mark_flat(struct Hoist *h)
+{
+    struct Node *root = h->frag;
+
+    // Fragment inputs no vertex output feeds are plain uniforms, the rest
+    // are uniform if every vertex outputs the same value
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+        if (n->type != NODE_VARDEF || n->vardef.modifier != VAR_IN) continue;
+
+        int g = hoist_global_index(h->vert, n->vardef.name);
+        bool flat = g == -1 || h->vert->comp.values[g]->vardef.modifier != VAR_OUT || h->flat[g];
+
+        n->vardef.uniform = flat && !hoist_assigns(root, n->vardef.name);
+    }
+}
+
+
+void hoist_move_all(struct Hoist *h)
+{
+    // Moved expressions run at the end of the vertex main
+    if (!hoist_find_func(h->vert, "main"))
+        return;
+
+    struct Node *root = h->frag;
+
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+        h->nlocals = 0;
+
+        if (n->type == NODE_VARDEF && n->vardef.modifier == VAR_REG)
+            hoist_move(h, n->vardef.value);
+
+        if (n->type != NODE_FUNC_DEF) continue;
+
+        for (size_t j = 0; j < n->fdef.nparams; ++j)
+            h->locals[h->nlocals++] = (struct HoistLocal){ n->fdef.params[j]->param.name, false };
+
+        struct Node *body = n->fdef.body;
+
+        for (size_t j = 0; j < body->comp.nvalues; ++j)
+        {
+            struct Node *stmt = body->comp.values[j];
+            if (!stmt) continue;
+
+            // The compiler adds locals before evaluating their value
+            if (stmt->type == NODE_VARDEF)
+                h->locals[h->nlocals++] = (struct HoistLocal){ stmt->vardef.name, false };
+
+            hoist_move(h, stmt);
+        }
+    }
+}
+
+
+void hoist_move(struct Hoist *h, struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_VARDEF: hoist_move(h, n->vardef.value); return;
+    case NODE_ASSIGN: hoist_move(h, n->assign.right); return;
+    case NODE_RETURN:
+        if (n->ret.value)
+            hoist_move(h, n->ret.value);
+        return;
+    case NODE_FUNC_CALL:
+        for (size_t i = 0; i < n->call.nargs; ++i)
+            hoist_move(h, n->call.args[i]);
+        return;
+    case NODE_BINOP:
+    case NODE_CONSTRUCTOR:
+        break;
+    default:
+        return;
+    }
+
+    NodeType type;
+    size_t len;
+    size_t ops = 0;
+
+    // Largest movable expressions first
+    if (hoist_degree(h, n, &type, &len, &ops) == 1 && ops >= HOIST_MIN_OPS && hoist_bind(h, n, false))
+    {
+        hoist_bind(h, n, true);
+        hoist_replace(h, n, type, len);
+        return;
+    }
+
+    if (n->type == NODE_BINOP)
+    {
+        hoist_move(h, n->binop.l);
+        hoist_move(h, n->binop.r);
+    }
+    else
+    {
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+            hoist_move(h, n->construct.args[i]);
+    }
+}
+
+
+int hoist_degree(struct Hoist *h, struct Node *n, NodeType *type, size_t *len, size_t *ops)
+{
+    switch (n->type)
+    {
+    case NODE_FLOAT:
+        *type = NODE_FLOAT;
+        *len = 1;
+        return 0;
+    case NODE_VEC:
+        *type = NODE_VEC;
+        *len = n->vec.len;
+        return 0;
+    case NODE_VAR:
+    {
+        for (size_t i = 0; i < h->nlocals; ++i)
+        {
+            if (strcmp(h->locals[i].name, n->var.name) == 0)
+                return -1;
+        }
+
+        // Only inputs that nothing overwrites are known to the vertex stage
+        struct Node *def = hoist_find_global(h->frag, n->var.name);
+
+        if (!def || def->vardef.modifier != VAR_IN || hoist_assigns(h->frag, n->var.name))
+            return -1;
+
+        if (def->vardef.type != NODE_FLOAT && def->vardef.type != NODE_VEC)
+            return -1;
+
+        *type = def->vardef.type;
+        *len = hoist_len(def);
+
+        // Bad swizzles are the compiler's to report
+        if (n->var.memb_access)
+        {
+            *len = strlen(n->var.memb_access);
+            *type = *len == 1 ? NODE_FLOAT : NODE_VEC;
+        }
+
+        return def->vardef.uniform ? 0 : 1;
+    }
+    case NODE_BINOP:
+    {
+        NodeType lt, rt;
+        size_t llen, rlen;
+
+        int l = hoist_degree(h, n->binop.l, &lt, &llen, ops);
+        int r = hoist_degree(h, n->binop.r, &rt, &rlen, ops);
+
+        if (l == -1 || r == -1)
+            return -1;
+
+        // Matching floats or vectors, or a float broadcast to a vector
+        if (llen != rlen && (llen == 1 ? lt : rt) != NODE_FLOAT)
+            return -1;
+
+        if (llen == rlen && lt != rt)
+            return -1;
+
+        ++*ops;
+        *type = llen > rlen ? lt : rt;
+        *len = llen > rlen ? llen : rlen;
+
+        switch (n->binop.op)
+        {
+        case BINOP_ADD:
+        case BINOP_SUB:
+            return l > r ? l : r;
+        case BINOP_MUL:
+            return l + r > 1 ? -1 : l + r;
+        case BINOP_DIV:
+            return r == 0 ? l : -1;
+        }
+
+        return -1;
+    }
+    case NODE_CONSTRUCTOR:
+    {
+        if (n->construct.type != NODE_FLOAT && n->construct.type != NODE_VEC)
+            return -1;
+
+        int degree = 0;
+
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            NodeType at;
+            size_t alen;
+            int d = hoist_degree(h, n->construct.args[i], &at, &alen, ops);
+
+            if (d == -1 || at != NODE_FLOAT)
+                return -1;
+
+            if (d > degree)
+                degree = d;
+        }
+
+        ++*ops;
+        *type = n->construct.type;
+        *len = n->construct.nargs;
+
+        return degree;
+    }
+    default:
+        return -1;
+    }
+}
+
+
+bool hoist_bind(struct Hoist *h, struct Node *n, bool add)
+{
+    switch (n->type)
+    {
+    case NODE_BINOP: return hoist_bind(h, n->binop.l, add) && hoist_bind(h, n->binop.r, add);
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            if (!hoist_bind(h, n->construct.args[i], add))
+                return false;
+        }
+
+        return true;
+    case NODE_VAR:
+        break;
+    default:
+        return true;
+    }
+
+    struct Node *def = hoist_find_global(h->frag, n->var.name);
+    struct Node *vdef = hoist_find_global(h->vert, n->var.name);
+
+    if (!vdef)
+    {
+        // Plain uniforms get a vertex stage input of their own
+        if (add)
+        {
+            struct Node *in = node_copy(h->arena, def);
+            hoist_insert(h->arena, h->vert, 0, in);
+        }
+
+        return true;
+    }
+
+    // Vertex inputs the vertex stage overwrites no longer hold the uniform
+    bool visible = vdef->vardef.modifier == VAR_OUT || (vdef->vardef.modifier == VAR_IN && vdef->vardef.uniform);
+    return visible && vdef->vardef.type == def->vardef.type && hoist_len(vdef) == hoist_len(def);
+}
+
+
+void hoist_replace(struct Hoist *h, struct Node *n, NodeType type, size_t len)
+{
+    if (!h->varyings)
+    {
+        h->varyings = node_alloc(h->arena, NODE_FUNC_DEF);
+        h->varyings->fdef.name = arena_strdup(h->arena, "$varyings");
+        h->varyings->fdef.type = NODE_VOID;
+        h->varyings->fdef.body = node_alloc(h->arena, NODE_COMPOUND);
+        hoist_append(h->arena, h->vert, h->varyings);
+
+        struct Node *call = node_alloc(h->arena, NODE_FUNC_CALL);
+        call->call.name = arena_strdup(h->arena, "$varyings");
+
+        // Before the return if main has one, it can only be the last
+        // statement
+        struct Node *body = hoist_find_func(h->vert, "main")->fdef.body;
+        size_t end = body->comp.nvalues;
+
+        if (end && body->comp.values[end - 1] && body->comp.values[end - 1]->type == NODE_RETURN)
+            --end;
+
+        hoist_insert(h->arena, body, end, call);
+    }
+
+    // Names the lexer can't produce never clash with the shader's own
+    char name[32];
+    snprintf(name, sizeof(name), "$v%zu", h->nmoved++);
+
+    for (int s = 0; s < 2; ++s)
+    {
+        struct Node *def = node_alloc(h->arena, NODE_VARDEF);
+        def->vardef.name = arena_strdup(h->arena, name);
+        def->vardef.modifier = s ? VAR_IN : VAR_OUT;
+        def->vardef.type = type;
+        def->vardef.value = node_alloc(h->arena, type);
+
+        if (type == NODE_VEC)
+            def->vardef.value->vec.len = len;
+
+        // Globals can only be read by the ones defined after them
+        hoist_insert(h->arena, s ? h->frag : h->vert, 0, def);
+    }
+
+    struct Node *assign = node_alloc(h->arena, NODE_ASSIGN);
+    assign->assign.left = node_alloc(h->arena, NODE_VAR);
+    assign->assign.left->var.name = arena_strdup(h->arena, name);
+    assign->assign.right = node_copy(h->arena, n);
+    hoist_append(h->arena, h->varyings->fdef.body, assign);
+
+    // Rewritten in place, whatever points at n now reads the varying
+    *n = (struct Node){ .type = NODE_VAR };
+    n->var.name = arena_strdup(h->arena, name);
+}
+
+
+void hoist_append(struct Arena *a, struct Node *comp, struct Node *n)
+{
+    hoist_insert(a, comp, comp->comp.nvalues, n);
+}
+
+
+void hoist_insert(struct Arena *a, struct Node *comp, size_t i, struct Node *n)
+{
+    comp->comp.values = arena_realloc(a, comp->comp.values, sizeof(struct Node*) * comp->comp.nvalues,
+                                      sizeof(struct Node*) * (comp->comp.nvalues + 1));
+
+    memmove(&comp->comp.values[i + 1], &comp->comp.values[i], sizeof(struct Node*) * (comp->comp.nvalues - i));
+    comp->comp.values[i] = n;
+    ++comp->comp.nvalues;
+}
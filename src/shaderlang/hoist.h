@@ -0,0 +1,74 @@
+#ifndef SHADER_HOIST_H
+#define SHADER_HOIST_H
+
+#include "node.h"
+
+// Fewest operations worth trading for an interpolated varying
+#define HOIST_MIN_OPS 2
+
+struct Hoist
+{
+    struct Arena *arena;
+    struct Node *vert, *frag;
+
+    // Per vertex stage global, whether it holds the same value for every
+    // vertex of a draw
+    bool *flat;
+    bool changed;
+
+    // Names in scope in the function being walked, locals shadow globals
+    struct HoistLocal
+    {
+        const char *name;
+        bool flat;
+    } *locals;
+    size_t nlocals;
+
+    // Vertex function computing the moved expressions, made on first use
+    struct Node *varyings;
+    size_t nmoved;
+};
+
+// Marks in variables whose value is the same for a whole draw, then moves
+// fragment expressions that are affine in the varyings into new vertex
+// outputs. Interpolating those gives the same result up to rounding.
+// Outputs left unread are dropped last.
+void hoist_stages(struct Arena *a, struct Node *vert, struct Node *frag);
+
+struct Hoist *hoist_alloc(struct Arena *a, struct Node *vert, struct Node *frag);
+void hoist_free(struct Hoist *h);
+
+// Global variable definition or 0
+struct Node *hoist_find_global(struct Node *root, const char *name);
+int hoist_global_index(struct Node *root, const char *name);
+struct Node *hoist_find_func(struct Node *root, const char *name);
+size_t hoist_len(struct Node *vardef);
+// Whether anything in the stage assigns to name
+bool hoist_assigns(struct Node *n, const char *name);
+bool hoist_reads(struct Node *n, const char *name);
+void hoist_mark_inputs(struct Node *root);
+
+// Finds vertex globals that only ever hold per draw values
+void hoist_find_flat(struct Hoist *h);
+void hoist_flow_fdef(struct Hoist *h, struct Node *fdef);
+bool hoist_flow(struct Hoist *h, struct Node *n);
+void hoist_mark_flat(struct Hoist *h);
+
+// Vertex outputs the fragment stage never reads become plain globals, so
+// the optimizer can drop their stores and the renderer never copies them.
+// gr_pos is read by the renderer.
+void hoist_drop_outputs(struct Node *vert, struct Node *frag);
+
+void hoist_move_all(struct Hoist *h);
+void hoist_move(struct Hoist *h, struct Node *n);
+// 0 for per draw values, 1 for affine in varyings, -1 for anything that
+// can't be interpolated. ops counts the operations in n.
+int hoist_degree(struct Hoist *h, struct Node *n, NodeType *type, size_t *len, size_t *ops);
+// Whether the vertex stage can see every variable n reads, declares the
+// missing inputs when add is true
+bool hoist_bind(struct Hoist *h, struct Node *n, bool add);
+void hoist_replace(struct Hoist *h, struct Node *n, NodeType type, size_t len);
+void hoist_append(struct Arena *a, struct Node *comp, struct Node *n);
+void hoist_insert(struct Arena *a, struct Node *comp, size_t i, struct Node *n);
+
+#endif
@@ -0,0 +1,701 @@
+#include "inliner.h"
+#include "hoist.h"
+#include "optimizer.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+
+void inliner_inline(struct Arena *a, struct Node *root)
+{
+    struct Inliner *in = inliner_alloc(a, root);
+
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        if (root->comp.values[i]->type == NODE_FUNC_DEF)
+            inliner_visit(in, i);
+    }
+
+    while (inliner_prune(in));
+
+    inliner_free(in);
+}
+
+
+struct Inliner *inliner_alloc(struct Arena *a, struct Node *root)
+{
+    struct Inliner *in = malloc(sizeof(struct Inliner));
+    in->arena = a;
+    in->root = root;
+    in->state = calloc(root->comp.nvalues ? root->comp.nvalues : 1, sizeof(char));
+    in->ninlined = 0;
+
+    return in;
+}
+
+
+void inliner_free(struct Inliner *in)
+{
+    free(in->state);
+    free(in);
+}
+
+
+int inliner_find_func(struct Inliner *in, const char *name)
+{
+    for (size_t i = 0; i < in->root->comp.nvalues; ++i)
+    {
+        struct Node *n = in->root->comp.values[i];
+
+        if (n->type == NODE_FUNC_DEF && strcmp(n->fdef.name, name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+
+void inliner_visit(struct Inliner *in, size_t idx)
+{
+    struct Node *fdef = in->root->comp.values[idx];
+
+    if (in->state[idx] == 2)
+        return;
+
+    if (in->state[idx] == 1)
+    {
+        fprintf(stderr, "[inliner_visit] Error: '%s' calls itself, recursion is not supported.\n", fdef->fdef.name);
+        exit(EXIT_FAILURE);
+    }
+
+    in->state[idx] = 1;
+
+    inliner_visit_calls(in, fdef->fdef.body);
+    inliner_fdef(in, fdef);
+
+    in->state[idx] = 2;
+}
+
+
+void inliner_visit_calls(struct Inliner *in, struct Node *n)
+{
+    if (!n) return;
+
+    switch (n->type)
+    {
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < n->comp.nvalues; ++i)
+            inliner_visit_calls(in, n->comp.values[i]);
+        break;
+    case NODE_VARDEF: inliner_visit_calls(in, n->vardef.value); break;
+    case NODE_ASSIGN: inliner_visit_calls(in, n->assign.right); break;
+    case NODE_RETURN: inliner_visit_calls(in, n->ret.value); break;
+    case NODE_BINOP:
+        inliner_visit_calls(in, n->binop.l);
+        inliner_visit_calls(in, n->binop.r);
+        break;
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+            inliner_visit_calls(in, n->construct.args[i]);
+        break;
+    case NODE_FUNC_CALL:
+    {
+        for (size_t i = 0; i < n->call.nargs; ++i)
+            inliner_visit_calls(in, n->call.args[i]);
+
+        int idx = inliner_find_func(in, n->call.name);
+
+        if (idx != -1)
+            inliner_visit(in, idx);
+    } break;
+    default:
+        break;
+    }
+}
+
+
+void inliner_fdef(struct Inliner *in, struct Node *fdef)
+{
+    struct Node *body = fdef->fdef.body;
+
+    for (size_t i = 0; i < body->comp.nvalues; ++i)
+    {
+        struct Node *stmt = body->comp.values[i];
+        if (!stmt || !inliner_can_expand(stmt) || !inliner_count_calls(in, stmt)) continue;
+
+        struct InlineSite site = { fdef, i, node_alloc(in->arena, NODE_COMPOUND), false, false };
+        site.single = inliner_count_calls(in, stmt) == 1;
+
+        inliner_expand(in, &site, stmt);
+
+        if (site.removed)
+            body->comp.values[i] = 0;
+
+        for (size_t j = 0; j < site.pre->comp.nvalues; ++j)
+            hoist_insert(in->arena, body, i++, site.pre->comp.values[j]);
+    }
+}
+
+
+bool inliner_can_expand(struct Node *stmt)
+{
+    switch (stmt->type)
+    {
+    case NODE_VARDEF:
+        // The compiler declares the local before evaluating its value,
+        // moving the value out of the statement would change what it reads
+        return !inliner_has_assign(stmt->vardef.value) && !inliner_refs(stmt->vardef.value, stmt->vardef.name, false);
+    case NODE_ASSIGN: return !inliner_has_assign(stmt->assign.right);
+    case NODE_RETURN: return !stmt->ret.value || !inliner_has_assign(stmt->ret.value);
+    default: return !inliner_has_assign(stmt);
+    }
+}
+
+
+void inliner_expand(struct Inliner *in, struct InlineSite *site, struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_VARDEF: inliner_expand(in, site, n->vardef.value); break;
+    case NODE_ASSIGN: inliner_expand(in, site, n->assign.right); break;
+    case NODE_RETURN:
+        if (n->ret.value)
+            inliner_expand(in, site, n->ret.value);
+        break;
+    case NODE_BINOP:
+        inliner_expand(in, site, n->binop.l);
+        inliner_expand(in, site, n->binop.r);
+        break;
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+            inliner_expand(in, site, n->construct.args[i]);
+        break;
+    case NODE_FUNC_CALL:
+    {
+        // Arguments run first, so their bodies go first too
+        for (size_t i = 0; i < n->call.nargs; ++i)
+            inliner_expand(in, site, n->call.args[i]);
+
+        int idx = inliner_find_func(in, n->call.name);
+        if (idx == -1) break;
+
+        struct Node *callee = in->root->comp.values[idx];
+        struct Node *stmt = site->fdef->fdef.body->comp.values[site->i];
+
+        // Anything the compiler would reject is left for it to report
+        if (callee->fdef.nparams != n->call.nargs || (callee->fdef.type == NODE_VOID && n != stmt))
+            break;
+
+        if (inliner_cost(callee->fdef.body) > INLINER_MAX_COST || inliner_captures(site, callee))
+            break;
+
+        inliner_splice(in, site, n, callee);
+    } break;
+    default:
+        break;
+    }
+}
+
+
+void inliner_splice(struct Inliner *in, struct InlineSite *site, struct Node *call, struct Node *callee)
+{
+    struct Node *body = callee->fdef.body;
+    size_t id = in->ninlined++;
+
+    // Names the lexer can't produce never clash with the shader's own
+    char name[64];
+
+    // Parameters and locals of the callee, latest first wins
+    size_t cap = callee->fdef.nparams + body->comp.nvalues + 1;
+    const char **from = malloc(sizeof(char*) * cap);
+    struct Node **to = malloc(sizeof(struct Node*) * cap);
+    size_t n_names = 0;
+
+    for (size_t i = 0; i < callee->fdef.nparams; ++i)
+    {
+        struct Node *param = callee->fdef.params[i];
+        struct Node *arg = call->call.args[i];
+
+        from[n_names] = param->param.name;
+
+        if (inliner_can_substitute(callee, param, arg))
+        {
+            to[n_names++] = arg;
+            continue;
+        }
+
+        // By value, the callee gets a copy
+        snprintf(name, sizeof(name), "$i%zu_%s", id, param->param.name);
+
+        struct Node *def = node_alloc(in->arena, NODE_VARDEF);
+        def->vardef.name = arena_strdup(in->arena, name);
+        def->vardef.type = param->param.type;
+        def->vardef.value = arg;
+        hoist_append(in->arena, site->pre, def);
+
+        to[n_names] = node_alloc(in->arena, NODE_VAR);
+        to[n_names++]->var.name = def->vardef.name;
+    }
+
+    struct Node *result = 0;
+
+    for (size_t i = 0; i < body->comp.nvalues; ++i)
+    {
+        if (!body->comp.values[i]) continue;
+
+        struct Node *stmt = node_copy(in->arena, body->comp.values[i]);
+
+        if (stmt->type == NODE_RETURN)
+        {
+            result = stmt->ret.value;
+
+            if (result)
+                inliner_rename(in->arena, result, from, to, n_names);
+
+            break;
+        }
+
+        // Locals are in scope of their own value
+        if (stmt->type == NODE_VARDEF)
+        {
+            snprintf(name, sizeof(name), "$i%zu_%s", id, stmt->vardef.name);
+
+            from[n_names] = stmt->vardef.name;
+            to[n_names] = node_alloc(in->arena, NODE_VAR);
+            to[n_names++]->var.name = arena_strdup(in->arena, name);
+
+            stmt->vardef.name = arena_strdup(in->arena, name);
+        }
+
+        inliner_rename(in->arena, stmt, from, to, n_names);
+        hoist_append(in->arena, site->pre, stmt);
+    }
+
+    free(from);
+    free(to);
+
+    if (!result)
+    {
+        site->removed = true;
+        return;
+    }
+
+    // With other calls in the statement the result has to be kept before
+    // their bodies run
+    if (!site->single)
+    {
+        snprintf(name, sizeof(name), "$i%zu", id);
+
+        struct Node *def = node_alloc(in->arena, NODE_VARDEF);
+        def->vardef.name = arena_strdup(in->arena, name);
+        def->vardef.type = callee->fdef.type;
+        def->vardef.value = result;
+        hoist_append(in->arena, site->pre, def);
+
+        result = node_alloc(in->arena, NODE_VAR);
+        result->var.name = def->vardef.name;
+    }
+
+    *call = *result;
+}
+
+
+bool inliner_captures(struct InlineSite *site, struct Node *callee)
+{
+    struct Node *body = callee->fdef.body;
+
+    const char **scope = malloc(sizeof(char*) * (callee->fdef.nparams + body->comp.nvalues + 1));
+    size_t nscope = 0;
+
+    for (size_t i = 0; i < callee->fdef.nparams; ++i)
+        scope[nscope++] = callee->fdef.params[i]->param.name;
+
+    bool captured = false;
+
+    for (size_t i = 0; i < body->comp.nvalues && !captured; ++i)
+    {
+        struct Node *stmt = body->comp.values[i];
+        if (!stmt) continue;
+
+        if (stmt->type == NODE_VARDEF)
+            scope[nscope++] = stmt->vardef.name;
+
+        captured = inliner_captures_in(site, scope, nscope, stmt);
+    }
+
+    free(scope);
+    return captured;
+}
+
+
+bool inliner_captures_in(struct InlineSite *site, const char **scope, size_t nscope, struct Node *n)
+{
+    const char *name = 0;
+
+    switch (n->type)
+    {
+    case NODE_VAR: name = n->var.name; break;
+    case NODE_ASSIGN:
+        if (inliner_captures_in(site, scope, nscope, n->assign.right))
+            return true;
+
+        name = n->assign.left->var.name;
+        break;
+    case NODE_VARDEF: return inliner_captures_in(site, scope, nscope, n->vardef.value);
+    case NODE_RETURN: return n->ret.value && inliner_captures_in(site, scope, nscope, n->ret.value);
+    case NODE_BINOP:
+        return inliner_captures_in(site, scope, nscope, n->binop.l) ||
+            inliner_captures_in(site, scope, nscope, n->binop.r);
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            if (inliner_captures_in(site, scope, nscope, n->construct.args[i]))
+                return true;
+        }
+
+        return false;
+    case NODE_FUNC_CALL:
+        for (size_t i = 0; i < n->call.nargs; ++i)
+        {
+            if (inliner_captures_in(site, scope, nscope, n->call.args[i]))
+                return true;
+        }
+
+        return false;
+    default:
+        return false;
+    }
+
+    for (size_t i = 0; i < nscope; ++i)
+    {
+        if (strcmp(scope[i], name) == 0)
+            return false;
+    }
+
+    return inliner_declared(site, name);
+}
+
+
+bool inliner_declared(struct InlineSite *site, const char *name)
+{
+    struct Node *fdef = site->fdef;
+
+    for (size_t i = 0; i < fdef->fdef.nparams; ++i)
+    {
+        if (strcmp(fdef->fdef.params[i]->param.name, name) == 0)
+            return true;
+    }
+
+    // Including the statement itself, a local is declared before its value
+    for (size_t i = 0; i <= site->i; ++i)
+    {
+        struct Node *stmt = fdef->fdef.body->comp.values[i];
+
+        if (stmt && stmt->type == NODE_VARDEF && strcmp(stmt->vardef.name, name) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+
+bool inliner_can_substitute(struct Node *callee, struct Node *param, struct Node *arg)
+{
+    struct Node *body = callee->fdef.body;
+    const char *name = param->param.name;
+
+    if (hoist_assigns(body, name))
+        return false;
+
+    switch (arg->type)
+    {
+    case NODE_INT:
+    case NODE_FLOAT:
+    case NODE_VEC:
+        // Literals can't take a swizzle
+        return !inliner_refs(body, name, true);
+    case NODE_VAR:
+    {
+        // Swizzles only go one layer deep
+        if (arg->var.memb_access && inliner_refs(body, name, true))
+            return false;
+
+        // The body must not be able to change the variable under it
+        if (hoist_assigns(body, arg->var.name))
+            return false;
+
+        for (size_t i = 0; i < body->comp.nvalues; ++i)
+        {
+            if (body->comp.values[i] && optimizer_has_call(body->comp.values[i]))
+                return false;
+        }
+
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+
+void inliner_rename(struct Arena *a, struct Node *n, const char **from, struct Node **to, size_t n_names)
+{
+    switch (n->type)
+    {
+    case NODE_VAR:
+        for (size_t i = n_names; i > 0; --i)
+        {
+            if (strcmp(from[i - 1], n->var.name) != 0) continue;
+
+            struct Node *sub = to[i - 1];
+            const char *memb = n->var.memb_access;
+
+            *n = *node_copy(a, sub);
+
+            // Checked by inliner_can_substitute, only one side has a swizzle
+            if (memb)
+                n->var.memb_access = memb;
+
+            return;
+        }
+        break;
+    case NODE_ASSIGN:
+        inliner_rename(a, n->assign.left, from, to, n_names);
+        inliner_rename(a, n->assign.right, from, to, n_names);
+        break;
+    case NODE_VARDEF: inliner_rename(a, n->vardef.value, from, to, n_names); break;
+    case NODE_RETURN:
+        if (n->ret.value)
+            inliner_rename(a, n->ret.value, from, to, n_names);
+        break;
+    case NODE_BINOP:
+        inliner_rename(a, n->binop.l, from, to, n_names);
+        inliner_rename(a, n->binop.r, from, to, n_names);
+        break;
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+            inliner_rename(a, n->construct.args[i], from, to, n_names);
+        break;
+    case NODE_FUNC_CALL:
+        for (size_t i = 0; i < n->call.nargs; ++i)
+            inliner_rename(a, n->call.args[i], from, to, n_names);
+        break;
+    default:
+        break;
+    }
+}
+
+
+size_t inliner_cost(struct Node *n)
+{
+    if (!n) return 0;
+
+    switch (n->type)
+    {
+    case NODE_COMPOUND:
+    {
+        size_t cost = 0;
+
+        for (size_t i = 0; i < n->comp.nvalues; ++i)
+            cost += inliner_cost(n->comp.values[i]);
+
+        return cost;
+    }
+    case NODE_VARDEF: return 1 + inliner_cost(n->vardef.value);
+    case NODE_ASSIGN: return 1 + inliner_cost(n->assign.right);
+    case NODE_RETURN: return 1 + inliner_cost(n->ret.value);
+    case NODE_BINOP: return 1 + inliner_cost(n->binop.l) + inliner_cost(n->binop.r);
+    case NODE_CONSTRUCTOR:
+    {
+        size_t cost = 1;
+
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+            cost += inliner_cost(n->construct.args[i]);
+
+        return cost;
+    }
+    case NODE_FUNC_CALL:
+    {
+        size_t cost = 1;
+
+        for (size_t i = 0; i < n->call.nargs; ++i)
+            cost += inliner_cost(n->call.args[i]);
+
+        return cost;
+    }
+    default:
+        return 1;
+    }
+}
+
+
+size_t inliner_count_calls(struct Inliner *in, struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_VARDEF: return inliner_count_calls(in, n->vardef.value);
+    case NODE_ASSIGN: return inliner_count_calls(in, n->assign.right);
+    case NODE_RETURN: return n->ret.value ? inliner_count_calls(in, n->ret.value) : 0;
+    case NODE_BINOP: return inliner_count_calls(in, n->binop.l) + inliner_count_calls(in, n->binop.r);
+    case NODE_CONSTRUCTOR:
+    {
+        size_t count = 0;
+
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+            count += inliner_count_calls(in, n->construct.args[i]);
+
+        return count;
+    }
+    case NODE_FUNC_CALL:
+    {
+        size_t count = inliner_find_func(in, n->call.name) != -1;
+
+        for (size_t i = 0; i < n->call.nargs; ++i)
+            count += inliner_count_calls(in, n->call.args[i]);
+
+        return count;
+    }
+    default:
+        return 0;
+    }
+}
+
+
+bool inliner_has_assign(struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_ASSIGN: return true;
+    case NODE_BINOP: return inliner_has_assign(n->binop.l) || inliner_has_assign(n->binop.r);
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            if (inliner_has_assign(n->construct.args[i]))
+                return true;
+        }
+
+        return false;
+    case NODE_FUNC_CALL:
+        for (size_t i = 0; i < n->call.nargs; ++i)
+        {
+            if (inliner_has_assign(n->call.args[i]))
+                return true;
+        }
+
+        return false;
+    default:
+        return false;
+    }
+}
+
+
+bool inliner_refs(struct Node *n, const char *name, bool swizzled)
+{
+    if (!n) return false;
+
+    switch (n->type)
+    {
+    case NODE_VAR: return strcmp(n->var.name, name) == 0 && (!swizzled || n->var.memb_access);
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < n->comp.nvalues; ++i)
+        {
+            if (inliner_refs(n->comp.values[i], name, swizzled))
+                return true;
+        }
+
+        return false;
+    case NODE_VARDEF: return inliner_refs(n->vardef.value, name, swizzled);
+    case NODE_ASSIGN: return inliner_refs(n->assign.right, name, swizzled);
+    case NODE_RETURN: return inliner_refs(n->ret.value, name, swizzled);
+    case NODE_BINOP: return inliner_refs(n->binop.l, name, swizzled) || inliner_refs(n->binop.r, name, swizzled);
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            if (inliner_refs(n->construct.args[i], name, swizzled))
+                return true;
+        }
+
+        return false;
+    case NODE_FUNC_CALL:
+        for (size_t i = 0; i < n->call.nargs; ++i)
+        {
+            if (inliner_refs(n->call.args[i], name, swizzled))
+                return true;
+        }
+
+        return false;
+    default:
+        return false;
+    }
+}
+
+
+bool inliner_prune(struct Inliner *in)
+{
+    struct Node *root = in->root;
+    size_t kept = 0;
+
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+        bool dead = n->type == NODE_FUNC_DEF && strcmp(n->fdef.name, "main") != 0;
+
+        for (size_t j = 0; dead && j < root->comp.nvalues; ++j)
+        {
+            if (j != i && inliner_calls(root->comp.values[j], n->fdef.name))
+                dead = false;
+        }
+
+        if (!dead)
+            root->comp.values[kept++] = n;
+    }
+
+    bool changed = kept != root->comp.nvalues;
+    root->comp.nvalues = kept;
+
+    return changed;
+}
+
+
+bool inliner_calls(struct Node *n, const char *name)
+{
+    if (!n) return false;
+
+    switch (n->type)
+    {
+    case NODE_FUNC_CALL:
+        if (strcmp(n->call.name, name) == 0)
+            return true;
+
+        for (size_t i = 0; i < n->call.nargs; ++i)
+        {
+            if (inliner_calls(n->call.args[i], name))
+                return true;
+        }
+
+        return false;
+    case NODE_COMPOUND:
+        for (size_t i = 0; i < n->comp.nvalues; ++i)
+        {
+            if (inliner_calls(n->comp.values[i], name))
+                return true;
+        }
+
+        return false;
+    case NODE_FUNC_DEF: return inliner_calls(n->fdef.body, name);
+    case NODE_VARDEF: return inliner_calls(n->vardef.value, name);
+    case NODE_ASSIGN: return inliner_calls(n->assign.right, name);
+    case NODE_RETURN: return inliner_calls(n->ret.value, name);
+    case NODE_BINOP: return inliner_calls(n->binop.l, name) || inliner_calls(n->binop.r, name);
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            if (inliner_calls(n->construct.args[i], name))
+                return true;
+        }
+
+        return false;
+    default:
+        return false;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef SHADER_INLINER_H
+#define SHADER_INLINER_H
+
+#include "node.h"
+
+// Largest function body, counted in nodes, that gets copied into callers
+#define INLINER_MAX_COST 64
+
+struct Inliner
+{
+    struct Arena *arena;
+    struct Node *root;
+
+    // Per top level node, 1 while the function's callees are being
+    // inlined and 2 once it's done
+    char *state;
+
+    // Numbers the names of inlined locals
+    size_t ninlined;
+};
+
+// Where inlined statements go, before statement i of fdef's body
+struct InlineSite
+{
+    struct Node *fdef;
+    size_t i;
+
+    // Statements to insert before it
+    struct Node *pre;
+
+    // The statement only has one call, its result can be used in place
+    bool single;
+
+    // The statement was a call to a void function that got inlined
+    bool removed;
+};
+
+// Expands calls to small user functions into their callers, callees first,
+// then drops functions nothing calls anymore. Exits on recursion, GRSL
+// has no branches to end it.
+void inliner_inline(struct Arena *a, struct Node *root);
+
+struct Inliner *inliner_alloc(struct Arena *a, struct Node *root);
+void inliner_free(struct Inliner *in);
+
+// Index in root of the function named name, -1 for built-ins and unknown
+// names
+int inliner_find_func(struct Inliner *in, const char *name);
+void inliner_visit(struct Inliner *in, size_t idx);
+// Visits every function n calls
+void inliner_visit_calls(struct Inliner *in, struct Node *n);
+void inliner_fdef(struct Inliner *in, struct Node *fdef);
+
+// Only statements without assignments in their expressions are expanded,
+// their evaluation order would change otherwise
+bool inliner_can_expand(struct Node *stmt);
+void inliner_expand(struct Inliner *in, struct InlineSite *site, struct Node *n);
+void inliner_splice(struct Inliner *in, struct InlineSite *site, struct Node *call, struct Node *callee);
+
+// Whether a free variable of the callee would resolve to one of the
+// caller's locals at the site
+bool inliner_captures(struct InlineSite *site, struct Node *callee);
+bool inliner_captures_in(struct InlineSite *site, const char **scope, size_t nscope, struct Node *n);
+bool inliner_declared(struct InlineSite *site, const char *name);
+// Whether uses of param can read arg directly instead of a copy
+bool inliner_can_substitute(struct Node *callee, struct Node *param, struct Node *arg);
+void inliner_rename(struct Arena *a, struct Node *n, const char **from, struct Node **to, size_t n_names);
+
+size_t inliner_cost(struct Node *n);
+size_t inliner_count_calls(struct Inliner *in, struct Node *n);
+bool inliner_has_assign(struct Node *n);
+bool inliner_refs(struct Node *n, const char *name, bool swizzled);
+// Drops functions other than main that nothing calls, returns whether
+// anything was dropped
+bool inliner_prune(struct Inliner *in);
+bool inliner_calls(struct Node *n, const char *name);
+
+#endif
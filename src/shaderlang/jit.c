@@ -0,0 +1,314 @@
+#include "jit.h"
+#include "builtin.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#if JIT_SUPPORTED
+#include <sys/mman.h>
+#endif
+
+// Byte offset of a slot's lane in the frame
+#define OFFSET(j, slot, lane) ((int)(((slot) * (j)->width + (lane)) * sizeof(float)))
+
+// SSE opcodes after 0F, ss with an F3 prefix and ps without
+#define SSE_LOAD 0x10
+#define SSE_STORE 0x11
+#define SSE_CVTTSS2SI 0x2c
+#define SSE_CVTSI2SS 0x2a
+
+
+struct Jit *jit_compile(struct Program *p, size_t width)
+{
+#if JIT_SUPPORTED
+    // Packets are processed four lanes per xmm register. Programs loaded
+    // from modules are native already.
+    if ((width != 1 && width % 4 != 0) || !p->ncode)
+        return 0;
+
+    struct Jit *j = malloc(sizeof(struct Jit));
+    j->width = width;
+    j->offsets = malloc(sizeof(size_t) * (p->ncode ? p->ncode : 1));
+    j->buf = 0;
+    j->len = 0;
+
+    // Calls can go forward, patched once every offset is known
+    size_t *calls = malloc(sizeof(size_t) * (p->ncode ? p->ncode : 1));
+    size_t ncalls = 0;
+
+    for (size_t i = 0; i < p->ncode; ++i)
+    {
+        j->offsets[i] = j->len;
+
+        if (p->code[i].op == OP_CALL)
+            calls[ncalls++] = i;
+
+        jit_emit_instr(j, &p->code[i]);
+    }
+
+    for (size_t i = 0; i < ncalls; ++i)
+    {
+        // call rel32 is five bytes, relative to its end
+        size_t end = j->offsets[calls[i]] + 5;
+        int32_t rel = (int32_t)(j->offsets[p->funcs[p->code[calls[i]].a].offset] - end);
+
+        memcpy(&j->buf[end - sizeof(int32_t)], &rel, sizeof(int32_t));
+    }
+
+    free(calls);
+
+    j->exec_size = j->len ? j->len : 1;
+    j->exec = mmap(0, j->exec_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (j->exec == MAP_FAILED)
+    {
+        j->exec = 0;
+        jit_free(j);
+        return 0;
+    }
+
+    memcpy(j->exec, j->buf, j->len);
+
+    if (mprotect(j->exec, j->exec_size, PROT_READ | PROT_EXEC) != 0)
+    {
+        jit_free(j);
+        return 0;
+    }
+
+    free(j->buf);
+    j->buf = 0;
+
+    return j;
+#else
+    (void)p;
+    (void)width;
+    return 0;
+#endif
+}
+
+
+void jit_free(struct Jit *j)
+{
+#if JIT_SUPPORTED
+    if (j->exec)
+        munmap(j->exec, j->exec_size);
+#endif
+
+    free(j->offsets);
+    free(j->buf);
+    free(j);
+}
+
+
+void jit_run(struct Jit *j, struct Frame *f, size_t offset)
+{
+    JitFn fn = (JitFn)(j->exec + j->offsets[offset]);
+    fn(f->slots, f->prog->consts);
+}
+
+
+void jit_emit(struct Jit *j, const unsigned char *bytes, size_t n)
+{
+    j->buf = realloc(j->buf, j->len + n);
+    memcpy(&j->buf[j->len], bytes, n);
+    j->len += n;
+}
+
+
+void jit_emit_u32(struct Jit *j, uint32_t v)
+{
+    unsigned char bytes[4] = { v, v >> 8, v >> 16, v >> 24 };
+    jit_emit(j, bytes, 4);
+}
+
+
+void jit_emit_mem(struct Jit *j, int prefix, int op, int reg, int base, int disp)
+{
+    if (prefix)
+        jit_emit(j, (unsigned char[]){ prefix }, 1);
+
+    // mod 10: [base + disp32]
+    jit_emit(j, (unsigned char[]){ 0x0f, op, 0x80 | reg << 3 | base }, 3);
+    jit_emit_u32(j, disp);
+}
+
+
+void jit_emit_instr(struct Jit *j, struct Instr *in)
+{
+    // Scalar frames use ss forms on one lane, packets ps forms on four
+    int prefix = j->width == 1 ? 0xf3 : 0;
+    size_t step = j->width == 1 ? 1 : 4;
+
+    switch (in->op)
+    {
+    case OP_LOADK:
+        jit_emit_mem(j, 0xf3, SSE_LOAD, 0, JIT_RSI, in->a * sizeof(float));
+
+        // shufps xmm0, xmm0, 0
+        if (j->width > 1)
+            jit_emit(j, (unsigned char[]){ 0x0f, 0xc6, 0xc0, 0x00 }, 4);
+
+        for (size_t l = 0; l < j->width; l += step)
+            jit_emit_mem(j, prefix, SSE_STORE, 0, JIT_RDI, OFFSET(j, in->dst, l));
+        break;
+    case OP_MOV:
+        for (int i = 0; i < in->n; ++i)
+        {
+            for (size_t l = 0; l < j->width; l += step)
+            {
+                jit_emit_mem(j, prefix, SSE_LOAD, 0, JIT_RDI, OFFSET(j, in->a + i, l));
+                jit_emit_mem(j, prefix, SSE_STORE, 0, JIT_RDI, OFFSET(j, in->dst + i, l));
+            }
+        }
+        break;
+
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_DIV:
+    {
+        static const int ops[] = { 0x58, 0x5c, 0x59, 0x5e };
+
+        for (size_t l = 0; l < j->width; l += step)
+        {
+            jit_emit_mem(j, prefix, SSE_LOAD, 0, JIT_RDI, OFFSET(j, in->a, l));
+            jit_emit_mem(j, prefix, ops[in->op - OP_ADD], 0, JIT_RDI, OFFSET(j, in->b, l));
+            jit_emit_mem(j, prefix, SSE_STORE, 0, JIT_RDI, OFFSET(j, in->dst, l));
+        }
+    } break;
+
+    case OP_IADD:
+    case OP_ISUB:
+    case OP_IMUL:
+    case OP_IDIV:
+    {
+        // eax op ecx
+        static const unsigned char ops[][3] = {
+            { 0x01, 0xc8 }, // add
+            { 0x29, 0xc8 }, // sub
+            { 0x0f, 0xaf, 0xc1 }, // imul
+            { 0x99, 0xf7, 0xf9 } // cdq, idiv
+        };
+        static const size_t lens[] = { 2, 2, 3, 3 };
+
+        // Idle lanes of a packet hold whatever their slots had, so lanes
+        // that would trap divide by 1 like vm_run_packet
+        static const unsigned char idiv_packet[] = {
+            0x83, 0xf9, 0xff, // cmp ecx, -1
+            0x75, 0x04, // jne nonneg
+            0xf7, 0xd8, // neg eax, INT_MIN stays INT_MIN
+            0xeb, 0x0c, // jmp done
+            0x85, 0xc9, // nonneg: test ecx, ecx
+            0x75, 0x05, // jnz divide
+            0xb9, 0x01, 0x00, 0x00, 0x00, // mov ecx, 1
+            0x99, 0xf7, 0xf9 // divide: cdq, idiv; done:
+        };
+
+        // SSE2 has no packed 32 bit multiply or divide, go lane by lane
+        for (size_t l = 0; l < j->width; ++l)
+        {
+            jit_emit_mem(j, 0xf3, SSE_CVTTSS2SI, 0, JIT_RDI, OFFSET(j, in->a, l));
+            jit_emit_mem(j, 0xf3, SSE_CVTTSS2SI, 1, JIT_RDI, OFFSET(j, in->b, l));
+
+            if (in->op == OP_IDIV && j->width > 1)
+                jit_emit(j, idiv_packet, sizeof(idiv_packet));
+            else
+                jit_emit(j, ops[in->op - OP_IADD], lens[in->op - OP_IADD]);
+
+            // cvtsi2ss xmm0, eax
+            jit_emit(j, (unsigned char[]){ 0xf3, 0x0f, SSE_CVTSI2SS, 0xc0 }, 4);
+            jit_emit_mem(j, 0xf3, SSE_STORE, 0, JIT_RDI, OFFSET(j, in->dst, l));
+        }
+    } break;
+
+    case OP_VADD:
+    case OP_VSUB:
+    case OP_VMUL:
+    case OP_VDIV:
+    {
+        static const int ops[] = { 0x58, 0x5c, 0x59, 0x5e };
+
+        // A scalar frame's vec4 fits one xmm register. Its slots aren't
+        // aligned, so both sides go through movups.
+        if (j->width == 1 && in->n == 4)
+        {
+            jit_emit_mem(j, 0, SSE_LOAD, 0, JIT_RDI, OFFSET(j, in->a, 0));
+            jit_emit_mem(j, 0, SSE_LOAD, 1, JIT_RDI, OFFSET(j, in->b, 0));
+
+            // op xmm0, xmm1
+            jit_emit(j, (unsigned char[]){ 0x0f, ops[in->op - OP_VADD], 0xc1 }, 3);
+            jit_emit_mem(j, 0, SSE_STORE, 0, JIT_RDI, OFFSET(j, in->dst, 0));
+            break;
+        }
+
+        for (int i = 0; i < in->n; ++i)
+        {
+            struct Instr s = { OP_ADD + in->op - OP_VADD, in->dst + i, in->a + i, in->b + i };
+            jit_emit_instr(j, &s);
+        }
+    } break;
+    case OP_SPLAT:
+        for (int i = 0; i < in->n; ++i)
+        {
+            struct Instr s = { OP_MOV, in->dst + i, in->a, .n = 1 };
+            jit_emit_instr(j, &s);
+        }
+        break;
+
+    case OP_BUILTIN:
+    case OP_BUILTIN_FAST:
+    {
+        BuiltinFn fn = builtin_fn(&builtins[in->b], in->op == OP_BUILTIN_FAST, j->width);
+        uint64_t addr = (uint64_t)(uintptr_t)fn;
+        unsigned char imm[8];
+
+        for (int i = 0; i < 8; ++i)
+            imm[i] = addr >> (i * 8);
+
+        // rdi and rsi are caller saved, rbp keeps rsp while the stack is
+        // aligned for the call
+        jit_emit(j, (unsigned char[]){
+            0x57, // push rdi
+            0x56, // push rsi
+            0x55, // push rbp
+            0x48, 0x89, 0xe5, // mov rbp, rsp
+            0x48, 0x83, 0xe4, 0xf0 // and rsp, -16
+        }, 10);
+
+        // lea rsi, [rdi + a]
+        jit_emit(j, (unsigned char[]){ 0x48, 0x8d, 0xb7 }, 3);
+        jit_emit_u32(j, OFFSET(j, in->a, 0));
+
+        // lea rdi, [rdi + dst]
+        jit_emit(j, (unsigned char[]){ 0x48, 0x8d, 0xbf }, 3);
+        jit_emit_u32(j, OFFSET(j, in->dst, 0));
+
+        // mov edx, n; mov ecx, width
+        jit_emit(j, (unsigned char[]){ 0xba }, 1);
+        jit_emit_u32(j, in->n);
+        jit_emit(j, (unsigned char[]){ 0xb9 }, 1);
+        jit_emit_u32(j, j->width);
+
+        // mov rax, fn; call rax
+        jit_emit(j, (unsigned char[]){ 0x48, 0xb8 }, 2);
+        jit_emit(j, imm, 8);
+        jit_emit(j, (unsigned char[]){ 0xff, 0xd0 }, 2);
+
+        jit_emit(j, (unsigned char[]){
+            0x48, 0x89, 0xec, // mov rsp, rbp
+            0x5d, // pop rbp
+            0x5e, // pop rsi
+            0x5f // pop rdi
+        }, 6);
+    } break;
+
+    case OP_CALL:
+        // Target patched by jit_compile
+        jit_emit(j, (unsigned char[]){ 0xe8 }, 1);
+        jit_emit_u32(j, 0);
+        break;
+    case OP_RET:
+        jit_emit(j, (unsigned char[]){ 0xc3 }, 1);
+        break;
+    }
+}
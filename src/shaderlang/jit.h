@@ -0,0 +1,50 @@
+#ifndef SHADER_JIT_H
+#define SHADER_JIT_H
+
+#include "vm.h"
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__linux__)
+#define JIT_SUPPORTED 1
+#else
+#define JIT_SUPPORTED 0
+#endif
+
+// Generated code is called with the frame slots and program constants
+typedef void (*JitFn)(float *slots, const float *consts);
+
+// x86-64 base registers holding the two arguments
+#define JIT_RSI 6
+#define JIT_RDI 7
+
+// Native translation of a whole program for frames of one width
+struct Jit
+{
+    // Executable mapping, never writable at the same time
+    unsigned char *exec;
+    size_t exec_size;
+
+    // Native offset of every instruction
+    size_t *offsets;
+    size_t width;
+
+    // Code while it's being emitted
+    unsigned char *buf;
+    size_t len;
+};
+
+// Returns 0 if the platform or frame width isn't supported, callers
+// should keep interpreting
+struct Jit *jit_compile(struct Program *p, size_t width);
+void jit_free(struct Jit *j);
+
+// Same as vm_run on a frame of the jit's width
+void jit_run(struct Jit *j, struct Frame *f, size_t offset);
+
+void jit_emit(struct Jit *j, const unsigned char *bytes, size_t n);
+void jit_emit_u32(struct Jit *j, uint32_t v);
+// [prefix] 0F op with a [base + disp32] operand, prefix 0 for none
+void jit_emit_mem(struct Jit *j, int prefix, int op, int reg, int base, int disp);
+void jit_emit_instr(struct Jit *j, struct Instr *in);
+
+#endif
@@ -5,13 +5,15 @@
 #include <stdio.h>
 
 
-struct Lexer *lexer_alloc(char *contents)
+struct Lexer *lexer_alloc(const char *contents, size_t len, struct Symtab *syms)
 {
     struct Lexer *l = malloc(sizeof(struct Lexer));
     l->contents = contents;
-    l->ch = contents[0];
+    l->len = len;
+    l->ch = len ? contents[0] : '\0';
     l->index = 0;
-    l->line_num = 0;
+    l->line_num = 1;
+    l->syms = syms;
 
     return l;
 }
@@ -19,103 +21,103 @@ struct Lexer *lexer_alloc(char *contents)
 
 void lexer_free(struct Lexer *l)
 {
-    free(l->contents);
     free(l);
 }
 
 
 void lexer_advance(struct Lexer *l)
 {
-    if (l->ch != '\0' && l->index < strlen(l->contents))
+    if (l->index < l->len)
     {
         ++l->index;
-        l->ch = l->contents[l->index];
+        l->ch = l->index < l->len ? l->contents[l->index] : '\0';
     }
 }
 
 
-char *lexer_collect_int(struct Lexer *l)
+const char *lexer_collect_int(struct Lexer *l)
 {
     size_t start = l->index;
 
-    while (isdigit(l->ch) && l->ch != '\n' && l->ch != '\0')
+    while (isdigit(l->ch))
         lexer_advance(l);
 
-    char *integer = malloc((l->index - start + 1) * sizeof(char));
-    integer[0] = '\0';
-    strncat(integer, &l->contents[start], sizeof(char) * (l->index - start));
-
-    return integer;
+    return symtab_intern(l->syms, &l->contents[start], l->index - start);
 }
 
 
-char *lexer_collect_id(struct Lexer *l)
+const char *lexer_collect_id(struct Lexer *l)
 {
     size_t start = l->index;
 
-    while ((isalnum(l->ch) || l->ch == '_') && l->ch != '\n' && l->ch != '\0')
+    while (isalnum(l->ch) || l->ch == '_')
         lexer_advance(l);
 
-    char *id = malloc((l->index - start + 1) * sizeof(char));
-    id[0] = '\0';
-    strncat(id, &l->contents[start], sizeof(char) * (l->index - start));
-
-    return id;
+    return symtab_intern(l->syms, &l->contents[start], l->index - start);
 }
 
 
-char *lexer_collect_float(struct Lexer *l)
+const char *lexer_collect_float(struct Lexer *l)
 {
     size_t start = l->index;
 
-    while ((isdigit(l->ch) || l->ch == '.') && l->ch != '\n' && l->ch != '\0')
+    while (isdigit(l->ch) || l->ch == '.')
         lexer_advance(l);
 
-    char *s = malloc(sizeof(char) * (l->index - start + 1));
-    s[0] = '\0';
-    strncat(s, l->contents + start, sizeof(char) * (l->index - start));
+    return symtab_intern(l->syms, &l->contents[start], l->index - start);
+}
 
-    return s;
+
+struct Token lexer_next_token(struct Lexer *l)
+{
+    // Tokens never span lines and the lexer stops right after them
+    struct Token t = lexer_scan(l);
+    t.line = l->line_num;
+
+    return t;
 }
 
 
-struct Token *lexer_next_token(struct Lexer *l)
+struct Token lexer_scan(struct Lexer *l)
 {
-    while (l->index < strlen(l->contents))
+    while (l->index < l->len)
     {
         while (isspace(l->ch) && l->ch != '\n')
             lexer_advance(l);
 
+        if (l->index == l->len)
+            break;
+
         if (isdigit(l->ch))
         {
             size_t tmp_i = l->index;
 
-            while (isdigit(l->contents[tmp_i]))
+            while (tmp_i < l->len && isdigit(l->contents[tmp_i]))
                 ++tmp_i;
 
-            if (l->contents[tmp_i] == '.')
-                return token_alloc(TT_FLOAT, lexer_collect_float(l));
+            if (tmp_i < l->len && l->contents[tmp_i] == '.')
+                return (struct Token){ TT_FLOAT, lexer_collect_float(l) };
             else
-                return token_alloc(TT_INT, lexer_collect_int(l));
+                return (struct Token){ TT_INT, lexer_collect_int(l) };
         }
 
         if (isalnum(l->ch) || l->ch == '_')
-            return token_alloc(TT_ID, lexer_collect_id(l));
+            return (struct Token){ TT_ID, lexer_collect_id(l) };
 
         switch (l->ch)
         {
-        case ';': return lexer_advance_with_token(l, token_alloc(TT_SEMI, strdup(";")));
-        case '(': return lexer_advance_with_token(l, token_alloc(TT_LPAREN, strdup("(")));
-        case ')': return lexer_advance_with_token(l, token_alloc(TT_RPAREN, strdup(")")));
-        case '{': return lexer_advance_with_token(l, token_alloc(TT_LBRACE, strdup("{")));
-        case '}': return lexer_advance_with_token(l, token_alloc(TT_RBRACE, strdup("}")));
-        case '=': return lexer_advance_with_token(l, token_alloc(TT_EQUAL, strdup("=")));
-        case ',': return lexer_advance_with_token(l, token_alloc(TT_COMMA, strdup(",")));
-        case '.': return lexer_advance_with_token(l, token_alloc(TT_PERIOD, strdup(".")));
-        case '+': return lexer_advance_with_token(l, token_binop_alloc(BT_PLUS, strdup("+")));
-        case '-': return lexer_advance_with_token(l, token_binop_alloc(BT_MINUS, strdup("-")));
-        case '*': return lexer_advance_with_token(l, token_binop_alloc(BT_MUL, strdup("*")));
-        case '/': return lexer_advance_with_token(l, token_binop_alloc(BT_DIV, strdup("/")));
+        case ';': return lexer_advance_with_token(l, (struct Token){ TT_SEMI, ";" });
+        case '(': return lexer_advance_with_token(l, (struct Token){ TT_LPAREN, "(" });
+        case ')': return lexer_advance_with_token(l, (struct Token){ TT_RPAREN, ")" });
+        case '{': return lexer_advance_with_token(l, (struct Token){ TT_LBRACE, "{" });
+        case '}': return lexer_advance_with_token(l, (struct Token){ TT_RBRACE, "}" });
+        case '=': return lexer_advance_with_token(l, (struct Token){ TT_EQUAL, "=" });
+        case ',': return lexer_advance_with_token(l, (struct Token){ TT_COMMA, "," });
+        case '.': return lexer_advance_with_token(l, (struct Token){ TT_PERIOD, "." });
+        case '+': return lexer_advance_with_token(l, (struct Token){ TT_BINOP, "+", BT_PLUS });
+        case '-': return lexer_advance_with_token(l, (struct Token){ TT_BINOP, "-", BT_MINUS });
+        case '*': return lexer_advance_with_token(l, (struct Token){ TT_BINOP, "*", BT_MUL });
+        case '/': return lexer_advance_with_token(l, (struct Token){ TT_BINOP, "/", BT_DIV });
         case '\n':
             ++l->line_num;
             lexer_advance(l);
@@ -127,11 +129,11 @@ struct Token *lexer_next_token(struct Lexer *l)
         }
     }
 
-    return token_alloc(TT_EOF, strdup(""));
+    return (struct Token){ TT_EOF, "" };
 }
 
 
-struct Token *lexer_advance_with_token(struct Lexer *l, struct Token *t)
+struct Token lexer_advance_with_token(struct Lexer *l, struct Token t)
 {
     lexer_advance(l);
     return t;
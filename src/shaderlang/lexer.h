@@ -2,6 +2,7 @@
 #define SHADER_LEXER_H
 
 #include "token.h"
+#include "symtab.h"
 #include <sys/types.h>
 
 struct Lexer
@@ -9,22 +10,29 @@ struct Lexer
     char ch;
     size_t index;
 
-    char *contents;
-    size_t line_num;
+    // Borrowed and not NUL terminated, ch is '\0' past the end
+    const char *contents;
+    size_t len;
+    size_t line_num; // From 1
+
+    // Identifiers and numbers are interned here
+    struct Symtab *syms;
 };
 
-// Contents must be heap allocated, lexer will free in lexer_free
-struct Lexer *lexer_alloc(char *contents);
+// contents must outlive the lexer
+struct Lexer *lexer_alloc(const char *contents, size_t len, struct Symtab *syms);
 void lexer_free(struct Lexer *l);
 
 void lexer_advance(struct Lexer *l);
 
-char *lexer_collect_int(struct Lexer *l);
-char *lexer_collect_id(struct Lexer *l);
-char *lexer_collect_float(struct Lexer *l);
+// Interned, the lexer is left after the collected characters
+const char *lexer_collect_int(struct Lexer *l);
+const char *lexer_collect_id(struct Lexer *l);
+const char *lexer_collect_float(struct Lexer *l);
 
-struct Token *lexer_next_token(struct Lexer *l);
-struct Token *lexer_advance_with_token(struct Lexer *l, struct Token *t);
+struct Token lexer_next_token(struct Lexer *l);
+// Next token without its line
+struct Token lexer_scan(struct Lexer *l);
+struct Token lexer_advance_with_token(struct Lexer *l, struct Token t);
 
 #endif
-
@@ -0,0 +1,379 @@
+#ifndef SHADER_MATHLIB_H
+#define SHADER_MATHLIB_H
+
+// Implementations of the GRSL built-in functions. Only depends on libm so
+// modules generated by grslc can include it too.
+//
+// Every function takes its arguments as consecutive registers of n
+// components each, and every register holds w lanes: lane l of component i
+// of argument k is a[(k * n + i) * w + l]. Results are laid out the same
+// way in d, which never overlaps a.
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MATH_ARG(k, i, l) a[((k) * n + (i)) * w + (l)]
+#define MATH_OUT(i, l) d[(i) * w + (l)]
+
+// Component wise, x, y and z are the arguments' matching components.
+// Expects a constant nargs in scope, missing arguments alias the first.
+#define MATH_MAP(expr) \
+    for (size_t i = 0; i < n; ++i) \
+        for (size_t l = 0; l < w; ++l) \
+        { \
+            float x = MATH_ARG(0, i, l); \
+            float y = MATH_ARG(nargs > 1 ? 1 : 0, i, l); \
+            float z = MATH_ARG(nargs > 2 ? 2 : 0, i, l); \
+            (void)y; \
+            (void)z; \
+            MATH_OUT(i, l) = (expr); \
+        }
+
+#define MATH_FN(name) static inline void name(float *d, const float *a, size_t n, size_t w)
+
+
+// Fast math approximations, shared by the *_fast builtins
+
+// Relative error below 5e-6 for x > 0, two Newton steps after the initial
+// guess. Gives a large finite value instead of inf for 0.
+static inline float math_rsqrt_approx(float x)
+{
+    uint32_t i;
+    memcpy(&i, &x, sizeof(i));
+    i = 0x5f375a86 - (i >> 1);
+
+    float y;
+    memcpy(&y, &i, sizeof(y));
+
+    y = y * (1.5f - 0.5f * x * y * y);
+    y = y * (1.5f - 0.5f * x * y * y);
+
+    return y;
+}
+
+
+// Odd polynomial for r in [-pi/2, pi/2]
+static inline float math_sin_poly(float r)
+{
+    float s = r * r;
+
+    return r * (1.f + s * (-1.66666667e-1f + s * (8.33333333e-3f + s * (-1.98412698e-4f +
+        s * (2.75573192e-6f + s * -2.50521084e-8f)))));
+}
+
+
+// Subtracts k * pi with pi split in two, exact for |k| < 2^15
+static inline float math_reduce(float x, float k)
+{
+    return x - k * 3.140625f - k * 9.67653589793e-4f;
+}
+
+
+// Absolute error below 1e-6 for |x| < 8192
+static inline float math_sin_approx(float x)
+{
+    // Nearest multiple of pi
+    int k = (int)(x * 0.318309886f + (x < 0 ? -0.5f : 0.5f));
+    float p = math_sin_poly(math_reduce(x, k));
+
+    return k & 1 ? -p : p;
+}
+
+
+// Same bound. With r = x - (k + 1/2) pi, cos(x) is -sin(r) for even k and
+// sin(r) for odd k.
+static inline float math_cos_approx(float x)
+{
+    float t = x * 0.318309886f - 0.5f;
+    int k = (int)(t + (t < 0 ? -0.5f : 0.5f));
+    float p = math_sin_poly(math_reduce(x, k + 0.5f));
+
+    return k & 1 ? p : -p;
+}
+
+
+static inline float math_min(float x, float y) { return y < x ? y : x; }
+static inline float math_max(float x, float y) { return y > x ? y : x; }
+
+
+static inline float math_smoothstep(float e0, float e1, float x)
+{
+    float t = math_min(math_max((x - e0) / (e1 - e0), 0.f), 1.f);
+    return t * t * (3.f - 2.f * t);
+}
+
+
+// One argument
+
+MATH_FN(math_sqrt)
+{
+    const size_t nargs = 1;
+    MATH_MAP(sqrtf(x));
+}
+
+
+MATH_FN(math_sqrt_fast)
+{
+    const size_t nargs = 1;
+    MATH_MAP(x * math_rsqrt_approx(x));
+}
+
+
+MATH_FN(math_inversesqrt)
+{
+    const size_t nargs = 1;
+    MATH_MAP(1.f / sqrtf(x));
+}
+
+
+MATH_FN(math_inversesqrt_fast)
+{
+    const size_t nargs = 1;
+    MATH_MAP(math_rsqrt_approx(x));
+}
+
+
+MATH_FN(math_sin)
+{
+    const size_t nargs = 1;
+    MATH_MAP(sinf(x));
+}
+
+
+MATH_FN(math_sin_fast)
+{
+    const size_t nargs = 1;
+    MATH_MAP(math_sin_approx(x));
+}
+
+
+MATH_FN(math_cos)
+{
+    const size_t nargs = 1;
+    MATH_MAP(cosf(x));
+}
+
+
+MATH_FN(math_cos_fast)
+{
+    const size_t nargs = 1;
+    MATH_MAP(math_cos_approx(x));
+}
+
+
+MATH_FN(math_abs)
+{
+    const size_t nargs = 1;
+    MATH_MAP(fabsf(x));
+}
+
+
+MATH_FN(math_floor)
+{
+    const size_t nargs = 1;
+    MATH_MAP(floorf(x));
+}
+
+
+MATH_FN(math_fract)
+{
+    const size_t nargs = 1;
+    MATH_MAP(x - floorf(x));
+}
+
+
+MATH_FN(math_exp)
+{
+    const size_t nargs = 1;
+    MATH_MAP(expf(x));
+}
+
+
+MATH_FN(math_log)
+{
+    const size_t nargs = 1;
+    MATH_MAP(logf(x));
+}
+
+
+// Two and three arguments
+
+MATH_FN(math_pow)
+{
+    const size_t nargs = 2;
+    MATH_MAP(powf(x, y));
+}
+
+
+MATH_FN(math_min2)
+{
+    const size_t nargs = 2;
+    MATH_MAP(math_min(x, y));
+}
+
+
+MATH_FN(math_max2)
+{
+    const size_t nargs = 2;
+    MATH_MAP(math_max(x, y));
+}
+
+
+MATH_FN(math_step)
+{
+    const size_t nargs = 2;
+    MATH_MAP(y < x ? 0.f : 1.f);
+}
+
+
+MATH_FN(math_clamp)
+{
+    const size_t nargs = 3;
+    MATH_MAP(math_min(math_max(x, y), z));
+}
+
+
+MATH_FN(math_mix)
+{
+    const size_t nargs = 3;
+    MATH_MAP(x * (1.f - z) + y * z);
+}
+
+
+MATH_FN(math_smoothstep3)
+{
+    const size_t nargs = 3;
+    MATH_MAP(math_smoothstep(x, y, z));
+}
+
+
+// Geometric, n is the vector length and the result may be a float
+
+MATH_FN(math_dot)
+{
+    for (size_t l = 0; l < w; ++l)
+    {
+        float sum = 0;
+
+        for (size_t i = 0; i < n; ++i)
+            sum += MATH_ARG(0, i, l) * MATH_ARG(1, i, l);
+
+        MATH_OUT(0, l) = sum;
+    }
+}
+
+
+MATH_FN(math_length)
+{
+    for (size_t l = 0; l < w; ++l)
+    {
+        float sum = 0;
+
+        for (size_t i = 0; i < n; ++i)
+            sum += MATH_ARG(0, i, l) * MATH_ARG(0, i, l);
+
+        MATH_OUT(0, l) = sqrtf(sum);
+    }
+}
+
+
+MATH_FN(math_length_fast)
+{
+    for (size_t l = 0; l < w; ++l)
+    {
+        float sum = 0;
+
+        for (size_t i = 0; i < n; ++i)
+            sum += MATH_ARG(0, i, l) * MATH_ARG(0, i, l);
+
+        MATH_OUT(0, l) = sum * math_rsqrt_approx(sum);
+    }
+}
+
+
+MATH_FN(math_distance)
+{
+    for (size_t l = 0; l < w; ++l)
+    {
+        float sum = 0;
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            float diff = MATH_ARG(0, i, l) - MATH_ARG(1, i, l);
+            sum += diff * diff;
+        }
+
+        MATH_OUT(0, l) = sqrtf(sum);
+    }
+}
+
+
+MATH_FN(math_distance_fast)
+{
+    for (size_t l = 0; l < w; ++l)
+    {
+        float sum = 0;
+
+        for (size_t i = 0; i < n; ++i)
+        {
+            float diff = MATH_ARG(0, i, l) - MATH_ARG(1, i, l);
+            sum += diff * diff;
+        }
+
+        MATH_OUT(0, l) = sum * math_rsqrt_approx(sum);
+    }
+}
+
+
+MATH_FN(math_normalize)
+{
+    for (size_t l = 0; l < w; ++l)
+    {
+        float sum = 0;
+
+        for (size_t i = 0; i < n; ++i)
+            sum += MATH_ARG(0, i, l) * MATH_ARG(0, i, l);
+
+        float len = sqrtf(sum);
+
+        for (size_t i = 0; i < n; ++i)
+            MATH_OUT(i, l) = MATH_ARG(0, i, l) / len;
+    }
+}
+
+
+MATH_FN(math_normalize_fast)
+{
+    for (size_t l = 0; l < w; ++l)
+    {
+        float sum = 0;
+
+        for (size_t i = 0; i < n; ++i)
+            sum += MATH_ARG(0, i, l) * MATH_ARG(0, i, l);
+
+        float inv = math_rsqrt_approx(sum);
+
+        for (size_t i = 0; i < n; ++i)
+            MATH_OUT(i, l) = MATH_ARG(0, i, l) * inv;
+    }
+}
+
+
+MATH_FN(math_cross)
+{
+    (void)n;
+
+    for (size_t l = 0; l < w; ++l)
+    {
+        float ax = a[0 * w + l], ay = a[1 * w + l], az = a[2 * w + l];
+        float bx = a[3 * w + l], by = a[4 * w + l], bz = a[5 * w + l];
+
+        d[0 * w + l] = ay * bz - az * by;
+        d[1 * w + l] = az * bx - ax * bz;
+        d[2 * w + l] = ax * by - ay * bx;
+    }
+}
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef SHADER_MODULE_H
+#define SHADER_MODULE_H
+
+// Interface between libgraph and shaders compiled ahead of time by grslc.
+// Included by generated code, so it depends on nothing else.
+
+#include <stddef.h>
+
+#define MODULE_VERSION 2
+#define MODULE_SYMBOL "grsl_module"
+
+// Runs the code block starting at bytecode offset
+typedef void (*ModuleFn)(float *slots, const float *consts, size_t offset);
+
+// Mirrors struct ProgramVar, modifier and type are VarModifier and NodeType
+struct ModuleVar
+{
+    const char *name;
+    int modifier;
+    int type;
+    size_t len;
+
+    int slot;
+    int layout_loc;
+    int uniform;
+};
+
+struct ModuleRange
+{
+    int slot;
+    size_t len;
+};
+
+// Everything the runtime keeps from a compiled stage
+struct ModuleStage
+{
+    const struct ModuleVar *vars;
+    size_t nvars;
+
+    const float *consts;
+    size_t nconsts;
+
+    // nvarslots floats
+    const float *image;
+
+    const struct ModuleRange *resets;
+    size_t nresets;
+
+    size_t nslots, nvarslots;
+    size_t init, entry, uniform;
+
+    // Frame width run was generated for
+    size_t width;
+    ModuleFn run;
+};
+
+struct Module
+{
+    int version;
+    struct ModuleStage vert, frag;
+};
+
+#endif
@@ -1,229 +1,88 @@
 #include "node.h"
-#include "visitor.h"
 #include <stdlib.h>
 #include <string.h>
 
 
-struct Node *node_alloc(NodeType type)
+struct Node *node_alloc(struct Arena *a, NodeType type)
 {
-    struct Node *n = malloc(sizeof(struct Node));
+    // Arena memory is zeroed, only non-zero defaults need setting
+    struct Node *n = arena_push(a, sizeof(struct Node));
     n->type = type;
 
-    n->vardef_name = 0;
-    n->vardef_value = 0;
-    n->vardef_modifier = VAR_REG;
-    n->vardef_type = 0;
-    n->vardef_layout_loc = -1;
-
-    n->var_name = 0;
-    n->var_memb_access = 0;
-
-    n->call_name = 0;
-    n->call_args = 0;
-    n->call_nargs = 0;
-
-    n->fdef_name = 0;
-    n->fdef_body = 0;
-    n->fdef_params = 0;
-    n->fdef_nparams = 0;
-    n->fdef_type = 0;
-
-    n->param_type = 0;
-    n->param_name = 0;
-
-    n->assign_left = 0;
-    n->assign_right = 0;
-
-    n->construct_type = 0;
-    n->construct_out = 0;
-
-    n->int_value = 0;
-
-    n->comp_nvalues = 0;
-    n->comp_value = 0;
-
-    n->vec_tree_values = 0;
-    n->vec_len = 0;
-    n->vec_runtime_values = 0;
-
-    n->float_value = 0.f;
-
-    n->op = 0;
-    n->op_l = 0;
-    n->op_r = 0;
-    n->op_priority = false;
-
-    if (type == NODE_BINOP)
-        n->op_res = node_alloc(0);
-    else
-        n->op_res = 0;
+    if (type == NODE_VARDEF)
+    {
+        n->vardef.modifier = VAR_REG;
+        n->vardef.layout_loc = -1;
+    }
 
     return n;
 }
 
 
-void node_free(struct Node *n)
+struct Node **node_copy_list(struct Arena *a, struct Node **src, size_t n)
 {
-    if (!n) return;
-
-    // Strings are copied so they must be freed
-    free(n->param_name);
-    free(n->fdef_name);
-    free(n->call_name);
-    free(n->var_name);
-    free(n->vardef_name);
-    free(n->var_memb_access);
-
-    if (n->vardef_value) node_free(n->vardef_value);
-    if (n->assign_left) node_free(n->assign_left);
-    if (n->assign_right) node_free(n->assign_right);
-    if (n->fdef_body) node_free(n->fdef_body);
-    if (n->construct_out) node_free(n->construct_out);
-    if (n->op_l) node_free(n->op_l);
-    if (n->op_r) node_free(n->op_r);
-    if (n->op_res) node_free(n->op_res);
-
-    if (n->call_args)
-    {
-        for (size_t i = 0; i < n->call_nargs; ++i)
-            node_free(n->call_args[i]);
-
-        free(n->call_args);
-    }
+    if (!src) return 0;
 
-    if (n->fdef_params)
-    {
-        for (size_t i = 0; i < n->fdef_nparams; ++i)
-            node_free(n->fdef_params[i]);
+    struct Node **list = arena_push(a, sizeof(struct Node*) * n);
 
-        free(n->fdef_params);
-    }
+    for (size_t i = 0; i < n; ++i)
+        list[i] = src[i] ? node_copy(a, src[i]) : 0;
 
-    if (n->comp_value)
-    {
-        for (size_t i = 0; i < n->comp_nvalues; ++i)
-            node_free(n->comp_value[i]);
-
-        free(n->comp_value);
-    }
-
-    if (n->vec_tree_values)
-    {
-        for (size_t i = 0; i < n->vec_len; ++i)
-            node_free(n->vec_tree_values[i]);
-
-        free(n->vec_tree_values);
-    }
-
-    if (n->vec_runtime_values)
-    {
-        for (size_t i = 0; i < n->vec_len; ++i)
-            node_free(n->vec_runtime_values[i]);
-
-        free(n->vec_runtime_values);
-    }
-
-    free(n);
+    return list;
 }
 
 
-struct Node *node_copy(struct Node *src)
+struct Node *node_copy(struct Arena *a, struct Node *src)
 {
-    struct Node *n = node_alloc(src->type);
+    struct Node *n = node_alloc(a, src->type);
+
+    // Plain values come along with the payload, only owned pointers need
+    // deep copies
+    *n = *src;
 
     switch (src->type)
     {
-    case NODE_VEC:
-    {
-        n->vec_len = src->vec_len;
-        n->vec_tree_values = malloc(sizeof(struct Node*) * n->vec_len);
-
-        if (src->vec_runtime_values)
-            n->vec_runtime_values = malloc(sizeof(struct Node*) * n->vec_len);
-
-        for (size_t i = 0; i < n->vec_len; ++i)
-        {
-            n->vec_tree_values[i] = node_copy(src->vec_tree_values[i]);
-
-            if (src->vec_runtime_values)
-                n->vec_runtime_values[i] = node_copy(src->vec_runtime_values[i]);
-        }
-    } break;
     case NODE_FUNC_CALL:
-    {
-        n->call_name = strdup(src->call_name);
-        n->call_nargs = src->call_nargs;
-        n->call_args = malloc(sizeof(struct Node*) * n->call_nargs);
-
-        for (size_t i = 0; i < n->call_nargs; ++i)
-            n->call_args[i] = node_copy(src->call_args[i]);
-    } break;
+        n->call.name = arena_strdup(a, src->call.name);
+        n->call.args = node_copy_list(a, src->call.args, src->call.nargs);
+        break;
     case NODE_VAR:
-    {
-        n->var_name = strdup(src->var_name);
+        n->var.name = arena_strdup(a, src->var.name);
 
-        if (src->var_memb_access)
-            n->var_memb_access = strdup(src->var_memb_access);
-    } break;
+        if (src->var.memb_access)
+            n->var.memb_access = arena_strdup(a, src->var.memb_access);
+        break;
     case NODE_VARDEF:
-    {
-        n->vardef_modifier = src->vardef_modifier;
-        n->vardef_type = src->vardef_type;
-        n->vardef_name = strdup(src->vardef_name);
-        n->vardef_value = node_copy(src->vardef_value);
-        n->vardef_layout_loc = src->vardef_layout_loc;
-    } break;
-    case NODE_INT:
-    {
-        n->int_value = src->int_value;
-    } break;
+        n->vardef.name = arena_strdup(a, src->vardef.name);
+        n->vardef.value = node_copy(a, src->vardef.value);
+        break;
     case NODE_COMPOUND:
-    {
-        n->comp_nvalues = src->comp_nvalues;
-        n->comp_value = malloc(sizeof(struct Node*) * n->comp_nvalues);
-
-        for (size_t i = 0; i < n->comp_nvalues; ++i)
-            n->comp_value[i] = node_copy(src->comp_value[i]);
-
-    } break;
+        n->comp.values = node_copy_list(a, src->comp.values, src->comp.nvalues);
+        break;
     case NODE_FUNC_DEF:
-    {
-        n->fdef_type = src->fdef_type;
-        n->fdef_body = node_copy(src->fdef_body);
-        n->fdef_name = strdup(src->fdef_name);
-        n->fdef_nparams = src->fdef_nparams;
-        n->fdef_params = malloc(sizeof(struct Node*) * n->fdef_nparams);
-
-        for (size_t i = 0; i < n->fdef_nparams; ++i)
-            n->fdef_params[i] = node_copy(src->fdef_params[i]);
-
-    } break;
+        n->fdef.name = arena_strdup(a, src->fdef.name);
+        n->fdef.body = node_copy(a, src->fdef.body);
+        n->fdef.params = node_copy_list(a, src->fdef.params, src->fdef.nparams);
+        break;
     case NODE_ASSIGN:
-    {
-        n->assign_left = node_copy(src->assign_left);
-        n->assign_right = node_copy(src->assign_right);
-    } break;
+        n->assign.left = node_copy(a, src->assign.left);
+        n->assign.right = node_copy(a, src->assign.right);
+        break;
     case NODE_PARAM:
-    {
-        n->param_name = strdup(src->param_name);
-        n->param_type = src->param_type;
-    } break;
+        n->param.name = arena_strdup(a, src->param.name);
+        break;
     case NODE_CONSTRUCTOR:
-    {
-        n->construct_type = src->construct_type;
-        n->construct_out = node_copy(src->construct_out);
-    } break;
-    case NODE_FLOAT:
-    {
-        n->float_value = src->float_value;
-    } break;
+        n->construct.args = node_copy_list(a, src->construct.args, src->construct.nargs);
+        break;
     case NODE_BINOP:
-    {
-        n->op_l = node_copy(src->op_l);
-        n->op_r = node_copy(src->op_r);
-        n->op = src->op;
-    } break;
-    case NODE_VOID:
+        n->binop.l = node_copy(a, src->binop.l);
+        n->binop.r = node_copy(a, src->binop.r);
+        break;
+    case NODE_RETURN:
+        if (src->ret.value)
+            n->ret.value = node_copy(a, src->ret.value);
+        break;
+    default:
         break;
     }
 
@@ -242,9 +101,17 @@ int node_str2nt(const char *str)
 }
 
 
-void node_to_vec(struct Node *vec, float *out)
+
+const char *node_nt2str(NodeType type, size_t len)
 {
-    for (size_t i = 0; i < vec->vec_len; ++i)
-        out[i] = visitor_visit(vec->vec_runtime_values[i])->float_value;
-}
+    static const char *vecs[] = { "vec2", "vec3", "vec4" };
 
+    switch (type)
+    {
+    case NODE_INT: return "int";
+    case NODE_FLOAT: return "float";
+    case NODE_VOID: return "void";
+    case NODE_VEC: return len >= 2 && len <= NODE_VEC_MAX ? vecs[len - 2] : "vec";
+    default: return "?";
+    }
+}
@@ -1,6 +1,7 @@
 #ifndef SHADER_NODE_H
 #define SHADER_NODE_H
 
+#include "arena.h"
 #include <sys/types.h>
 #include <cglm/cglm.h>
 
@@ -18,7 +19,8 @@ typedef enum
     NODE_PARAM,
     NODE_ASSIGN,
     NODE_BINOP,
-    NODE_CONSTRUCTOR
+    NODE_CONSTRUCTOR,
+    NODE_RETURN
 } NodeType;
 
 typedef enum
@@ -37,77 +39,117 @@ typedef enum
     VAR_LAYOUT = 8
 } VarModifier;
 
+// Longest vector type, vec4
+#define NODE_VEC_MAX 4
+
 struct Node
 {
     NodeType type;
 
-    // vardef
-    char *vardef_name;
-    struct Node *vardef_value;
-    VarModifier vardef_modifier;
-    NodeType vardef_type;
-    int vardef_layout_loc;
-
-    // var
-    char *var_name;
-    char *var_memb_access; // Only allowing one layer of member access
-
-    // func call
-    char *call_name;
-    struct Node **call_args;
-    size_t call_nargs;
-
-    // func def
-    char *fdef_name;
-    struct Node **fdef_params;
-    size_t fdef_nparams;
-    struct Node *fdef_body;
-    NodeType fdef_type;
-
-    // param
-    NodeType param_type;
-    char *param_name;
-
-    // assign
-    struct Node *assign_left, *assign_right;
-
-    // constructor
-    NodeType construct_type;
-    struct Node *construct_out;
-
-    // int
-    int int_value;
-
-    // compound
-    struct Node **comp_value;
-    size_t comp_nvalues;
-
-    // vec3
-    struct Node **vec_tree_values;
-    struct Node **vec_runtime_values;
-    size_t vec_len;
-
-    // float
-    float float_value;
-
-    // binop
-    Binop op;
-    struct Node *op_l, *op_r;
-    struct Node *op_res; // Hack around no heap allocations in visitor
-    bool op_priority;
+    // Source line, 0 for nodes added after parsing
+    size_t line;
+
+    // Only the member matching type is valid
+    union
+    {
+        struct
+        {
+            const char *name;
+            struct Node *value;
+            VarModifier modifier;
+            NodeType type;
+            size_t len; // Components of a vector type, 0 for added nodes
+            int layout_loc;
+
+            // In variable with the same value for a whole draw, set by
+            // hoist_stages
+            bool uniform;
+        } vardef;
+
+        struct
+        {
+            const char *name;
+            const char *memb_access; // Swizzle like .x or .zyx, only one layer
+        } var;
+
+        struct
+        {
+            const char *name;
+            struct Node **args;
+            size_t nargs;
+        } call;
+
+        struct
+        {
+            const char *name;
+            struct Node **params;
+            size_t nparams;
+            struct Node *body;
+            NodeType type;
+            size_t len; // Components of a vector return type
+        } fdef;
+
+        struct
+        {
+            const char *name;
+            NodeType type;
+            size_t len;
+        } param;
+
+        // value is 0 in void functions
+        struct
+        {
+            struct Node *value;
+        } ret;
+
+        struct
+        {
+            struct Node *left, *right;
+        } assign;
+
+        // Vectors take one arg per component, int and float take one
+        struct
+        {
+            struct Node **args;
+            size_t nargs;
+            NodeType type;
+        } construct;
+
+        struct
+        {
+            struct Node **values;
+            size_t nvalues;
+        } comp;
+
+        // Constant vector, stored inline
+        struct
+        {
+            float values[NODE_VEC_MAX];
+            size_t len;
+        } vec;
+
+        int int_value;
+        float float_value;
+
+        struct
+        {
+            struct Node *l, *r;
+            Binop op;
+            bool priority;
+        } binop;
+    };
 };
 
-struct Node *node_alloc(NodeType type);
-void node_free(struct Node *n);
+// Nodes and everything they point to live in the arena
+struct Node *node_alloc(struct Arena *a, NodeType type);
 
-struct Node *node_copy(struct Node *src);
+struct Node *node_copy(struct Arena *a, struct Node *src);
+struct Node **node_copy_list(struct Arena *a, struct Node **src, size_t n);
 
 // String to node type
 int node_str2nt(const char *str);
-
-// Out: out
-// Node parameter must be of type NODE_VEC
-void node_to_vec(struct Node *vec, float *out);
+// Type name for messages, len picks the vector type
+const char *node_nt2str(NodeType type, size_t len);
 
 #endif
 
@@ -0,0 +1,760 @@
+#include "optimizer.h"
+#include "builtin.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+
+void optimizer_optimize(struct Node *root)
+{
+    struct Optimizer *o = optimizer_alloc(root);
+
+    optimizer_fold_all(o, root);
+
+    // Removing code can leave more code dead
+    while (optimizer_dce(o, root));
+
+    optimizer_free(o);
+}
+
+
+struct Optimizer *optimizer_alloc(struct Node *root)
+{
+    struct Optimizer *o = malloc(sizeof(struct Optimizer));
+
+    // Every declaration is a global or a statement of some function body
+    o->cap = 1;
+
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+
+        if (n->type == NODE_VARDEF) ++o->cap;
+        if (n->type == NODE_FUNC_DEF) o->cap += n->fdef.nparams + n->fdef.body->comp.nvalues;
+    }
+
+    o->syms = malloc(sizeof(struct OptSymbol) * o->cap);
+    o->nsyms = 0;
+
+    o->nglobals = 0;
+    o->scope_start = 0;
+
+    o->read = calloc(o->cap, sizeof(bool));
+    o->consts = calloc(o->cap, sizeof(struct Node*));
+
+    return o;
+}
+
+
+void optimizer_free(struct Optimizer *o)
+{
+    free(o->syms);
+    free(o->read);
+    free(o->consts);
+    free(o);
+}
+
+
+void optimizer_declare(struct Optimizer *o, struct Node *vardef)
+{
+    o->syms[o->nsyms++] = (struct OptSymbol){
+        vardef->vardef.name,
+        vardef->vardef.type,
+        vardef->vardef.modifier
+    };
+}
+
+
+void optimizer_declare_params(struct Optimizer *o, struct Node *fdef)
+{
+    for (size_t i = 0; i < fdef->fdef.nparams; ++i)
+    {
+        struct Node *param = fdef->fdef.params[i];
+        o->syms[o->nsyms++] = (struct OptSymbol){ param->param.name, param->param.type, VAR_REG };
+    }
+}
+
+
+void optimizer_declare_globals(struct Optimizer *o, struct Node *root)
+{
+    o->nsyms = 0;
+
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        if (root->comp.values[i]->type == NODE_VARDEF)
+            optimizer_declare(o, root->comp.values[i]);
+    }
+
+    o->nglobals = o->nsyms;
+    o->scope_start = o->nsyms;
+}
+
+
+int optimizer_find(struct Optimizer *o, const char *name, size_t end)
+{
+    for (size_t i = end; i > o->scope_start; --i)
+    {
+        if (strcmp(o->syms[i - 1].name, name) == 0)
+            return i - 1;
+    }
+
+    for (size_t i = 0; i < o->nglobals; ++i)
+    {
+        if (strcmp(o->syms[i].name, name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+
+void optimizer_fold_all(struct Optimizer *o, struct Node *root)
+{
+    // Globals assigned anywhere keep being read from their slots
+    bool *stored = calloc(o->cap, sizeof(bool));
+    optimizer_declare_globals(o, root);
+
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+
+        if (n->type == NODE_VARDEF)
+            optimizer_mark_stores(o, n->vardef.value, stored, o->nsyms);
+
+        if (n->type != NODE_FUNC_DEF) continue;
+
+        struct Node *body = n->fdef.body;
+        optimizer_declare_params(o, n);
+
+        for (size_t j = 0; j < body->comp.nvalues; ++j)
+        {
+            struct Node *stmt = body->comp.values[j];
+            if (!stmt) continue;
+
+            if (stmt->type == NODE_VARDEF)
+                optimizer_declare(o, stmt);
+
+            optimizer_mark_stores(o, stmt, stored, o->nsyms);
+        }
+
+        o->nsyms = o->nglobals;
+    }
+
+    for (size_t i = 0, var = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+
+        // Initializers only see earlier globals, which are final by now
+        if (n->type == NODE_VARDEF)
+        {
+            optimizer_fold(o, n->vardef.value);
+
+            if (!stored[var])
+                o->consts[var] = optimizer_const_value(n);
+
+            ++var;
+        }
+
+        if (n->type != NODE_FUNC_DEF) continue;
+
+        struct Node *body = n->fdef.body;
+        optimizer_declare_params(o, n);
+
+        for (size_t j = 0; j < body->comp.nvalues; ++j)
+        {
+            struct Node *stmt = body->comp.values[j];
+            if (!stmt) continue;
+
+            // The compiler adds locals before evaluating their value
+            if (stmt->type == NODE_VARDEF)
+                optimizer_declare(o, stmt);
+
+            optimizer_fold(o, stmt);
+        }
+
+        o->nsyms = o->nglobals;
+    }
+
+    free(stored);
+}
+
+
+void optimizer_fold(struct Optimizer *o, struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_VAR: optimizer_fold_var(o, n); break;
+    case NODE_VARDEF: optimizer_fold(o, n->vardef.value); break;
+    case NODE_ASSIGN: optimizer_fold(o, n->assign.right); break;
+    case NODE_RETURN:
+        if (n->ret.value)
+            optimizer_fold(o, n->ret.value);
+        break;
+    case NODE_BINOP: optimizer_fold_binop(o, n); break;
+    case NODE_FUNC_CALL:
+        for (size_t i = 0; i < n->call.nargs; ++i)
+            optimizer_fold(o, n->call.args[i]);
+        break;
+    case NODE_CONSTRUCTOR:
+    {
+        bool literal = true;
+
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            struct Node *arg = n->construct.args[i];
+            optimizer_fold(o, arg);
+
+            if (arg->type != NODE_INT && arg->type != NODE_FLOAT)
+                literal = false;
+        }
+
+        if (n->construct.type != NODE_VEC || !literal) break;
+
+        // Same as an all literal constructor straight from the parser
+        float values[NODE_VEC_MAX];
+        size_t len = n->construct.nargs;
+
+        for (size_t i = 0; i < len; ++i)
+        {
+            struct Node *arg = n->construct.args[i];
+            values[i] = arg->type == NODE_INT ? arg->int_value : arg->float_value;
+        }
+
+        n->type = NODE_VEC;
+        n->vec.len = len;
+        memcpy(n->vec.values, values, sizeof(float) * len);
+    } break;
+    default:
+        break;
+    }
+}
+
+
+void optimizer_fold_binop(struct Optimizer *o, struct Node *n)
+{
+    struct Node *l = n->binop.l;
+    struct Node *r = n->binop.r;
+
+    optimizer_fold(o, l);
+    optimizer_fold(o, r);
+
+    if (l->type == NODE_INT && r->type == NODE_INT)
+    {
+        // Wrapping arithmetic, faulting divisions are left for runtime
+        unsigned a = l->int_value, b = r->int_value;
+
+        switch (n->binop.op)
+        {
+        case BINOP_ADD: n->int_value = a + b; break;
+        case BINOP_SUB: n->int_value = a - b; break;
+        case BINOP_MUL: n->int_value = a * b; break;
+        case BINOP_DIV:
+            if (r->int_value == 0 || (l->int_value == INT_MIN && r->int_value == -1)) return;
+            n->int_value = l->int_value / r->int_value;
+            break;
+        }
+
+        n->type = NODE_INT;
+        return;
+    }
+
+    if (l->type == NODE_FLOAT && r->type == NODE_FLOAT)
+    {
+        float a = l->float_value, b = r->float_value;
+
+        switch (n->binop.op)
+        {
+        case BINOP_ADD: n->float_value = a + b; break;
+        case BINOP_SUB: n->float_value = a - b; break;
+        case BINOP_MUL: n->float_value = a * b; break;
+        case BINOP_DIV: n->float_value = a / b; break;
+        }
+
+        n->type = NODE_FLOAT;
+        return;
+    }
+
+    if ((l->type == NODE_VEC || r->type == NODE_VEC) && optimizer_is_const(l) && optimizer_is_const(r))
+    {
+        size_t len = l->type == NODE_VEC ? l->vec.len : r->vec.len;
+        if (l->type == r->type && l->vec.len != r->vec.len) return;
+
+        // Same component wise order the vm uses
+        float values[NODE_VEC_MAX];
+
+        for (size_t i = 0; i < len; ++i)
+        {
+            float a = l->type == NODE_VEC ? l->vec.values[i] : l->float_value;
+            float b = r->type == NODE_VEC ? r->vec.values[i] : r->float_value;
+
+            switch (n->binop.op)
+            {
+            case BINOP_ADD: values[i] = a + b; break;
+            case BINOP_SUB: values[i] = a - b; break;
+            case BINOP_MUL: values[i] = a * b; break;
+            case BINOP_DIV: values[i] = a / b; break;
+            }
+        }
+
+        n->type = NODE_VEC;
+        n->vec.len = len;
+        memcpy(n->vec.values, values, sizeof(float) * len);
+        return;
+    }
+
+    // Identities only hold when both sides have the literal's type,
+    // mismatches are left for the compiler to report
+    NodeType type = optimizer_type(o, l);
+    if (type != optimizer_type(o, r)) return;
+
+    struct Node *keep = 0;
+
+    switch (n->binop.op)
+    {
+    case BINOP_ADD:
+        if (optimizer_is_literal(r, 0)) keep = l;
+        else if (optimizer_is_literal(l, 0)) keep = r;
+        break;
+    case BINOP_SUB:
+        if (optimizer_is_literal(r, 0)) keep = l;
+        break;
+    case BINOP_MUL:
+        if (optimizer_is_literal(r, 1)) keep = l;
+        else if (optimizer_is_literal(l, 1)) keep = r;
+        // Not for floats, x * 0 is nan for infinite or nan x
+        else if (type == NODE_INT && optimizer_is_literal(r, 0) && optimizer_is_pure(l)) keep = r;
+        else if (type == NODE_INT && optimizer_is_literal(l, 0) && optimizer_is_pure(r)) keep = l;
+        break;
+    case BINOP_DIV:
+        if (optimizer_is_literal(r, 1)) keep = l;
+        break;
+    }
+
+    if (keep)
+        *n = *keep;
+}
+
+
+void optimizer_fold_var(struct Optimizer *o, struct Node *n)
+{
+    int i = optimizer_find(o, n->var.name, o->nsyms);
+    if (i == -1 || (size_t)i >= o->nglobals || !o->consts[i]) return;
+
+    struct Node *value = o->consts[i];
+    const char *memb = n->var.memb_access;
+
+    if (!memb)
+    {
+        *n = *value;
+        return;
+    }
+
+    // Swizzles were checked by sema
+    float values[NODE_VEC_MAX];
+    size_t len = strlen(memb);
+
+    for (size_t c = 0; c < len; ++c)
+    {
+        const char *at = strchr("xyzw", memb[c]);
+        values[c] = value->vec.values[at ? at - "xyzw" : strchr("rgba", memb[c]) - "rgba"];
+    }
+
+    if (len == 1)
+    {
+        n->type = NODE_FLOAT;
+        n->float_value = values[0];
+        return;
+    }
+
+    n->type = NODE_VEC;
+    n->vec.len = len;
+    memcpy(n->vec.values, values, sizeof(float) * len);
+}
+
+
+struct Node *optimizer_const_value(struct Node *vardef)
+{
+    struct Node *value = vardef->vardef.value;
+
+    if (vardef->vardef.modifier != VAR_REG || value->type != vardef->vardef.type)
+        return 0;
+
+    return value->type == NODE_INT || value->type == NODE_FLOAT || value->type == NODE_VEC ? value : 0;
+}
+
+
+NodeType optimizer_type(struct Optimizer *o, struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_INT:
+    case NODE_FLOAT:
+    case NODE_VEC:
+        return n->type;
+    case NODE_VAR:
+    {
+        if (n->var.memb_access) return strlen(n->var.memb_access) == 1 ? NODE_FLOAT : NODE_VEC;
+
+        int i = optimizer_find(o, n->var.name, o->nsyms);
+        return i == -1 ? NODE_VOID : o->syms[i].type;
+    }
+    case NODE_CONSTRUCTOR:
+        return n->construct.type == NODE_VEC ? NODE_VEC : optimizer_type(o, n->construct.args[0]);
+    case NODE_BINOP:
+    {
+        // Scalars are broadcast against vectors
+        NodeType l = optimizer_type(o, n->binop.l);
+        return l == NODE_VEC ? l : optimizer_type(o, n->binop.r) == NODE_VEC ? NODE_VEC : l;
+    }
+    case NODE_ASSIGN: return optimizer_type(o, n->assign.left);
+    case NODE_FUNC_CALL:
+    {
+        int idx = builtin_find(n->call.name);
+        if (idx == -1) return NODE_VOID;
+        if (builtins[idx].shape == BUILTIN_REDUCE) return NODE_FLOAT;
+
+        for (size_t i = 0; i < n->call.nargs; ++i)
+        {
+            if (optimizer_type(o, n->call.args[i]) == NODE_VEC)
+                return NODE_VEC;
+        }
+
+        return NODE_FLOAT;
+    }
+    default: return NODE_VOID;
+    }
+}
+
+
+bool optimizer_is_literal(struct Node *n, float f)
+{
+    return (n->type == NODE_INT && n->int_value == f) ||
+        (n->type == NODE_FLOAT && n->float_value == f);
+}
+
+
+bool optimizer_is_const(struct Node *n)
+{
+    return n->type == NODE_FLOAT || n->type == NODE_VEC;
+}
+
+
+bool optimizer_is_var(struct Optimizer *o, struct Node *n, int sym, size_t end)
+{
+    return n->type == NODE_VAR && !n->var.memb_access && optimizer_find(o, n->var.name, end) == sym;
+}
+
+
+bool optimizer_is_pure(struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_ASSIGN:
+    case NODE_RETURN:
+        return false;
+    case NODE_FUNC_CALL:
+        // Built-ins have no side effects of their own
+        if (builtin_find(n->call.name) == -1)
+            return false;
+
+        for (size_t i = 0; i < n->call.nargs; ++i)
+        {
+            if (!optimizer_is_pure(n->call.args[i]))
+                return false;
+        }
+
+        return true;
+    case NODE_BINOP: return optimizer_is_pure(n->binop.l) && optimizer_is_pure(n->binop.r);
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            if (!optimizer_is_pure(n->construct.args[i]))
+                return false;
+        }
+
+        return true;
+    default:
+        return true;
+    }
+}
+
+
+bool optimizer_has_call(struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_FUNC_CALL:
+        if (builtin_find(n->call.name) == -1)
+            return true;
+
+        for (size_t i = 0; i < n->call.nargs; ++i)
+        {
+            if (optimizer_has_call(n->call.args[i]))
+                return true;
+        }
+
+        return false;
+    case NODE_VARDEF: return optimizer_has_call(n->vardef.value);
+    case NODE_ASSIGN: return optimizer_has_call(n->assign.right);
+    case NODE_RETURN: return n->ret.value && optimizer_has_call(n->ret.value);
+    case NODE_BINOP: return optimizer_has_call(n->binop.l) || optimizer_has_call(n->binop.r);
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+        {
+            if (optimizer_has_call(n->construct.args[i]))
+                return true;
+        }
+
+        return false;
+    default:
+        return false;
+    }
+}
+
+
+bool optimizer_dce(struct Optimizer *o, struct Node *root)
+{
+    optimizer_mark_all(o, root, o->read, false);
+
+    bool changed = false;
+
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        if (root->comp.values[i]->type == NODE_FUNC_DEF)
+            changed |= optimizer_dce_fdef(o, root->comp.values[i]);
+    }
+
+    // Unreferenced globals go too, unless the outside sees them
+    bool *used = calloc(o->cap, sizeof(bool));
+    optimizer_mark_all(o, root, used, true);
+
+    size_t kept = 0;
+
+    for (size_t i = 0, var = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+
+        if (n->type == NODE_VARDEF)
+        {
+            bool dead = !used[var] && n->vardef.modifier == VAR_REG && optimizer_is_pure(n->vardef.value);
+            ++var;
+
+            if (dead)
+            {
+                changed = true;
+                continue;
+            }
+        }
+
+        root->comp.values[kept++] = n;
+    }
+
+    root->comp.nvalues = kept;
+
+    free(used);
+    return changed;
+}
+
+
+bool optimizer_dce_fdef(struct Optimizer *o, struct Node *fdef)
+{
+    struct Node *body = fdef->fdef.body;
+    bool main = strcmp(fdef->fdef.name, "main") == 0;
+
+    // Locals visible at each statement
+    size_t *ends = malloc(sizeof(size_t) * (body->comp.nvalues ? body->comp.nvalues : 1));
+    optimizer_declare_params(o, fdef);
+
+    for (size_t i = 0; i < body->comp.nvalues; ++i)
+    {
+        struct Node *n = body->comp.values[i];
+
+        if (n && n->type == NODE_VARDEF)
+            optimizer_declare(o, n);
+
+        ends[i] = o->nsyms;
+    }
+
+    bool *live = calloc(o->cap, sizeof(bool));
+    bool *used = calloc(o->cap, sizeof(bool));
+
+    // Only outputs outlive main, helpers return to code that may read any
+    // global
+    for (size_t i = 0; i < o->nglobals; ++i)
+        live[i] = o->syms[i].modifier == VAR_OUT || (!main && o->read[i]);
+
+    bool changed = false;
+
+    for (size_t i = body->comp.nvalues; i-- > 0;)
+    {
+        struct Node *n = body->comp.values[i];
+        if (!n) continue;
+
+        int def = -1;
+        struct Node *value = n;
+
+        if (n->type == NODE_VARDEF)
+        {
+            def = ends[i] - 1;
+            value = n->vardef.value;
+        }
+        else if (n->type == NODE_ASSIGN)
+        {
+            def = optimizer_find(o, n->assign.left->var.name, ends[i]);
+            value = n->assign.right;
+        }
+
+        bool dead = optimizer_is_pure(value);
+
+        if (n->type == NODE_VARDEF)
+            dead = dead && !live[def] && !used[def];
+        else if (n->type == NODE_ASSIGN)
+            dead = dead && def != -1 && (!live[def] || optimizer_is_var(o, value, def, ends[i]));
+
+        if (dead)
+        {
+            body->comp.values[i] = 0;
+            changed = true;
+            continue;
+        }
+
+        if (def != -1)
+            live[def] = false;
+
+        // Callees run before the assignment and may read any global
+        if (optimizer_has_call(n))
+        {
+            for (size_t j = 0; j < o->nglobals; ++j)
+                live[j] |= o->read[j];
+        }
+
+        optimizer_mark(o, value, live, ends[i], false);
+        optimizer_mark(o, n, used, ends[i], true);
+    }
+
+    size_t kept = 0;
+
+    for (size_t i = 0; i < body->comp.nvalues; ++i)
+    {
+        if (body->comp.values[i])
+            body->comp.values[kept++] = body->comp.values[i];
+    }
+
+    body->comp.nvalues = kept;
+
+    free(ends);
+    free(live);
+    free(used);
+
+    o->nsyms = o->nglobals;
+    return changed;
+}
+
+
+void optimizer_mark(struct Optimizer *o, struct Node *n, bool *set, size_t end, bool targets)
+{
+    switch (n->type)
+    {
+    case NODE_VAR:
+    {
+        int i = optimizer_find(o, n->var.name, end);
+        if (i != -1) set[i] = true;
+    } break;
+    case NODE_VARDEF:
+        optimizer_mark(o, n->vardef.value, set, end, targets);
+        break;
+    case NODE_ASSIGN:
+        if (targets)
+            optimizer_mark(o, n->assign.left, set, end, targets);
+
+        optimizer_mark(o, n->assign.right, set, end, targets);
+        break;
+    case NODE_BINOP:
+        optimizer_mark(o, n->binop.l, set, end, targets);
+        optimizer_mark(o, n->binop.r, set, end, targets);
+        break;
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+            optimizer_mark(o, n->construct.args[i], set, end, targets);
+        break;
+    case NODE_FUNC_CALL:
+        for (size_t i = 0; i < n->call.nargs; ++i)
+            optimizer_mark(o, n->call.args[i], set, end, targets);
+        break;
+    case NODE_RETURN:
+        if (n->ret.value)
+            optimizer_mark(o, n->ret.value, set, end, targets);
+        break;
+    default:
+        break;
+    }
+}
+
+
+void optimizer_mark_all(struct Optimizer *o, struct Node *root, bool *set, bool targets)
+{
+    optimizer_declare_globals(o, root);
+    memset(set, 0, sizeof(bool) * o->cap);
+
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+
+        if (n->type == NODE_VARDEF)
+            optimizer_mark(o, n->vardef.value, set, o->nsyms, targets);
+
+        if (n->type != NODE_FUNC_DEF) continue;
+
+        struct Node *body = n->fdef.body;
+        optimizer_declare_params(o, n);
+
+        for (size_t j = 0; j < body->comp.nvalues; ++j)
+        {
+            struct Node *stmt = body->comp.values[j];
+            if (!stmt) continue;
+
+            if (stmt->type == NODE_VARDEF)
+                optimizer_declare(o, stmt);
+
+            optimizer_mark(o, stmt, set, o->nsyms, targets);
+        }
+
+        o->nsyms = o->nglobals;
+    }
+}
+
+
+void optimizer_mark_stores(struct Optimizer *o, struct Node *n, bool *set, size_t end)
+{
+    switch (n->type)
+    {
+    case NODE_VARDEF:
+        optimizer_mark_stores(o, n->vardef.value, set, end);
+        break;
+    case NODE_ASSIGN:
+    {
+        int i = optimizer_find(o, n->assign.left->var.name, end);
+        if (i != -1) set[i] = true;
+
+        optimizer_mark_stores(o, n->assign.right, set, end);
+    } break;
+    case NODE_BINOP:
+        optimizer_mark_stores(o, n->binop.l, set, end);
+        optimizer_mark_stores(o, n->binop.r, set, end);
+        break;
+    case NODE_CONSTRUCTOR:
+        for (size_t i = 0; i < n->construct.nargs; ++i)
+            optimizer_mark_stores(o, n->construct.args[i], set, end);
+        break;
+    case NODE_FUNC_CALL:
+        for (size_t i = 0; i < n->call.nargs; ++i)
+            optimizer_mark_stores(o, n->call.args[i], set, end);
+        break;
+    case NODE_RETURN:
+        if (n->ret.value)
+            optimizer_mark_stores(o, n->ret.value, set, end);
+        break;
+    default:
+        break;
+    }
+}
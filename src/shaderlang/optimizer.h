@@ -0,0 +1,73 @@
+#ifndef SHADER_OPTIMIZER_H
+#define SHADER_OPTIMIZER_H
+
+#include "node.h"
+
+struct Optimizer
+{
+    // Declarations seen so far, globals first, visible by the same rules
+    // the compiler uses
+    struct OptSymbol
+    {
+        const char *name;
+        NodeType type;
+        VarModifier modifier;
+    } *syms;
+    size_t nsyms;
+
+    size_t nglobals, scope_start;
+
+    // Upper bound on nsyms, size of every per symbol array
+    size_t cap;
+
+    // Globals read by any remaining code
+    bool *read;
+
+    // Per global, the literal value of a plain global nothing assigns to,
+    // 0 otherwise. Reads of it are replaced by the value.
+    struct Node **consts;
+};
+
+// Rewrites root in place, nodes are only ever reused or dropped
+void optimizer_optimize(struct Node *root);
+
+struct Optimizer *optimizer_alloc(struct Node *root);
+void optimizer_free(struct Optimizer *o);
+
+void optimizer_declare(struct Optimizer *o, struct Node *vardef);
+void optimizer_declare_params(struct Optimizer *o, struct Node *fdef);
+void optimizer_declare_globals(struct Optimizer *o, struct Node *root);
+// Locals declared before end shadow globals, -1 if there's no such variable
+int optimizer_find(struct Optimizer *o, const char *name, size_t end);
+
+// Constant folding and algebraic identities
+void optimizer_fold_all(struct Optimizer *o, struct Node *root);
+void optimizer_fold(struct Optimizer *o, struct Node *n);
+void optimizer_fold_binop(struct Optimizer *o, struct Node *n);
+void optimizer_fold_var(struct Optimizer *o, struct Node *n);
+// Literal value of a global that can be propagated, or 0
+struct Node *optimizer_const_value(struct Node *vardef);
+NodeType optimizer_type(struct Optimizer *o, struct Node *n);
+
+bool optimizer_is_literal(struct Node *n, float f);
+// Float scalar or vector literal
+bool optimizer_is_const(struct Node *n);
+// Whether n is exactly the variable sym, x = x is dead
+bool optimizer_is_var(struct Optimizer *o, struct Node *n, int sym, size_t end);
+// Expressions without assignments can be dropped
+bool optimizer_is_pure(struct Node *n);
+// Whether n calls a user function
+bool optimizer_has_call(struct Node *n);
+
+// Dead code elimination, returns whether anything was removed
+bool optimizer_dce(struct Optimizer *o, struct Node *root);
+bool optimizer_dce_fdef(struct Optimizer *o, struct Node *fdef);
+// Flags every variable n reads, assignment targets are flagged too when
+// targets is true
+void optimizer_mark(struct Optimizer *o, struct Node *n, bool *set, size_t end, bool targets);
+// Same over the whole tree, leaves globals declared
+void optimizer_mark_all(struct Optimizer *o, struct Node *root, bool *set, bool targets);
+// Flags every variable n assigns to
+void optimizer_mark_stores(struct Optimizer *o, struct Node *n, bool *set, size_t end);
+
+#endif
@@ -6,62 +6,113 @@
 
 #define IS_TYPE(str) (node_str2nt(str) != -1)
 
-struct Parser *parser_alloc(const char *path)
+struct Parser *parser_alloc(const char *path, struct Arena *arena)
+{
+    size_t len;
+    const char *contents = util_map_file(path, &len);
+
+    struct Parser *p = parser_alloc_source(contents, len, arena);
+    p->mapped = true;
+
+    return p;
+}
+
+
+struct Parser *parser_alloc_source(const char *contents, size_t len, struct Arena *arena)
 {
     struct Parser *p = malloc(sizeof(struct Parser));
-    p->lexer = lexer_alloc(util_read_file(path));
+    p->arena = arena;
+    p->contents = contents;
+    p->len = len;
+    p->mapped = false;
+    p->syms = symtab_alloc(arena);
+    p->lexer = lexer_alloc(p->contents, p->len, p->syms);
     p->curr = lexer_next_token(p->lexer);
-    p->prev = 0;
+    p->prev = (struct Token){ TT_EOF, "" };
     p->prev_node = 0;
 
+    p->kw_in = symtab_intern(p->syms, "in", 2);
+    p->kw_out = symtab_intern(p->syms, "out", 3);
+    p->kw_return = symtab_intern(p->syms, "return", 6);
+    p->kw_layout = symtab_intern(p->syms, "layout", 6);
+
     return p;
 }
 
 
 void parser_free(struct Parser *p)
 {
-    token_free(p->prev);
-    token_free(p->curr);
     lexer_free(p->lexer);
+    symtab_free(p->syms);
+    if (p->mapped)
+        util_unmap_file(p->contents, p->len);
+
     free(p);
 }
 
 
 void parser_expect(struct Parser *p, TokenType type)
 {
-    if (p->curr->type == type)
+    if (p->curr.type == type)
     {
-        if (p->prev) token_free(p->prev);
         p->prev = p->curr;
         p->curr = lexer_next_token(p->lexer);
     }
     else
     {
-        fprintf(stderr, "Parser error: Unexpected token '%s' of type %d; expected token of type %d.\n",
-                p->curr->value, p->curr->type, type);
+        fprintf(stderr, "Parser error on line %zu: Unexpected token '%s' of type %d; expected token of type %d.\n",
+                p->curr.line, p->curr.value, p->curr.type, type);
         exit(EXIT_FAILURE);
     }
 }
 
 
+struct Node *parser_node(struct Parser *p, NodeType type)
+{
+    struct Node *n = node_alloc(p->arena, type);
+    n->line = p->curr.line;
+
+    return n;
+}
+
+
 struct Node *parser_parse(struct Parser *p)
 {
-    struct Node *root = node_alloc(NODE_COMPOUND);
-    root->comp_value = malloc(sizeof(struct Node*));
-    root->comp_value[0] = parser_parse_expr(p);
-    ++root->comp_nvalues;
+    // Collected outside the arena, growing the list in it would copy it
+    // for every statement once nodes are allocated after it
+    size_t cap = 16, n = 0;
+    struct Node **values = malloc(sizeof(struct Node*) * cap);
+
+    struct Node *expr = parser_parse_expr(p);
 
-    while (p->lexer->index < strlen(p->lexer->contents))
+    // Empty bodies have no statements at all
+    while (expr)
     {
-        parser_expect(p, TT_SEMI);
+        if (n == cap)
+        {
+            cap *= 2;
+            values = realloc(values, sizeof(struct Node*) * cap);
+        }
 
-        struct Node *expr = parser_parse_expr(p);
-        if (!expr) break;
+        values[n++] = expr;
+
+        if (p->curr.type == TT_EOF)
+            break;
 
-        root->comp_value = realloc(root->comp_value, sizeof(struct Node) * ++root->comp_nvalues);
-        root->comp_value[root->comp_nvalues - 1] = expr;
+        // Function definitions end in a brace, the semicolon after them is
+        // optional
+        if (expr->type != NODE_FUNC_DEF || p->curr.type == TT_SEMI)
+            parser_expect(p, TT_SEMI);
+
+        expr = parser_parse_expr(p);
     }
 
+    struct Node *root = parser_node(p, NODE_COMPOUND);
+    root->comp.values = arena_push(p->arena, sizeof(struct Node*) * n);
+    root->comp.nvalues = n;
+    memcpy(root->comp.values, values, sizeof(struct Node*) * n);
+
+    free(values);
     return root;
 }
 
@@ -70,7 +121,7 @@ struct Node *parser_parse_expr(struct Parser *p)
 {
     bool found = true;
 
-    switch (p->curr->type)
+    switch (p->curr.type)
     {
     case TT_INT: p->prev_node = parser_parse_int(p); break;
     case TT_FLOAT: p->prev_node = parser_parse_float(p); break;
@@ -80,7 +131,7 @@ struct Node *parser_parse_expr(struct Parser *p)
         p->prev_node = parser_parse_expr(p);
 
         if (p->prev_node->type == NODE_BINOP)
-            p->prev_node->op_priority = true;
+            p->prev_node->binop.priority = true;
 
         parser_expect(p, TT_RPAREN);
         break;
@@ -89,7 +140,7 @@ struct Node *parser_parse_expr(struct Parser *p)
 
     if (found)
     {
-        if (p->curr->type == TT_BINOP)
+        if (p->curr.type == TT_BINOP)
         {
             struct Node *n = parser_parse_binop(p, p->prev_node);
             p->prev_node = n;
@@ -106,8 +157,8 @@ struct Node *parser_parse_expr(struct Parser *p)
 
 struct Node *parser_parse_int(struct Parser *p)
 {
-    struct Node *n = node_alloc(NODE_INT);
-    n->int_value = atoi(p->curr->value);
+    struct Node *n = parser_node(p, NODE_INT);
+    n->int_value = atoi(p->curr.value);
     parser_expect(p, TT_INT);
 
     return n;
@@ -116,8 +167,8 @@ struct Node *parser_parse_int(struct Parser *p)
 
 struct Node *parser_parse_float(struct Parser *p)
 {
-    struct Node *n = node_alloc(NODE_FLOAT);
-    n->float_value = atof(p->curr->value);
+    struct Node *n = parser_node(p, NODE_FLOAT);
+    n->float_value = atof(p->curr.value);
     parser_expect(p, TT_FLOAT);
 
     return n;
@@ -126,34 +177,43 @@ struct Node *parser_parse_float(struct Parser *p)
 
 struct Node *parser_parse_id(struct Parser *p)
 {
-    if (strcmp(p->curr->value, "in") == 0)
+    if (p->curr.value == p->kw_in)
     {
         parser_expect(p, TT_ID);
         struct Node *n = parser_parse_vardef(p);
-        n->vardef_modifier = VAR_IN;
+        n->vardef.modifier = VAR_IN;
         return n;
     }
-    else if (strcmp(p->curr->value, "out") == 0)
+    else if (p->curr.value == p->kw_out)
     {
         parser_expect(p, TT_ID);
         struct Node *n = parser_parse_vardef(p);
-        n->vardef_modifier = VAR_OUT;
+        n->vardef.modifier = VAR_OUT;
         return n;
     }
-    else if (strcmp(p->curr->value, "layout") == 0)
+    else if (p->curr.value == p->kw_return)
     {
         parser_expect(p, TT_ID);
-        int loc = atoi(p->curr->value);
+
+        // No value before the semicolon in void functions
+        struct Node *n = parser_node(p, NODE_RETURN);
+        n->ret.value = parser_parse_expr(p);
+        return n;
+    }
+    else if (p->curr.value == p->kw_layout)
+    {
+        parser_expect(p, TT_ID);
+        int loc = atoi(p->curr.value);
         parser_expect(p, TT_INT);
 
         struct Node *n = parser_parse_vardef(p);
-        n->vardef_modifier = VAR_LAYOUT;
-        n->vardef_layout_loc = loc;
+        n->vardef.modifier = VAR_LAYOUT;
+        n->vardef.layout_loc = loc;
 
         return n;
     }
 
-    if (IS_TYPE(p->curr->value))
+    if (IS_TYPE(p->curr.value))
         return parser_parse_vardef(p);
     else
         return parser_parse_var(p);
@@ -162,20 +222,19 @@ struct Node *parser_parse_id(struct Parser *p)
 
 struct Node *parser_parse_var(struct Parser *p)
 {
-    // No strdup, early return leaks memory
-    char *id = p->curr->value;
+    const char *id = p->curr.value;
     parser_expect(p, TT_ID);
 
-    if (p->curr->type == TT_LPAREN) return parser_parse_call(p);
-    if (p->curr->type == TT_EQUAL) return parser_parse_assign(p);
+    if (p->curr.type == TT_LPAREN) return parser_parse_call(p);
+    if (p->curr.type == TT_EQUAL) return parser_parse_assign(p);
 
-    struct Node *n = node_alloc(NODE_VAR);
-    n->var_name = strdup(id);
+    struct Node *n = parser_node(p, NODE_VAR);
+    n->var.name = id;
 
-    if (p->curr->type == TT_PERIOD)
+    if (p->curr.type == TT_PERIOD)
     {
         parser_expect(p, TT_PERIOD);
-        n->var_memb_access = strdup(p->curr->value);
+        n->var.memb_access = p->curr.value;
         parser_expect(p, TT_ID);
     }
 
@@ -185,51 +244,46 @@ struct Node *parser_parse_var(struct Parser *p)
 
 struct Node *parser_parse_vardef(struct Parser *p)
 {
-    NodeType type = node_str2nt(p->curr->value);
+    NodeType type = node_str2nt(p->curr.value);
 
-    int vlen;
+    size_t vlen = 0;
     if (type == NODE_VEC)
-        vlen = p->curr->value[3] - '0';
+        vlen = parser_vec_len(p->curr.value);
 
     parser_expect(p, TT_ID);
 
-    if (p->curr->type == TT_LPAREN)
+    if (p->curr.type == TT_LPAREN)
         return parser_parse_constructor(p);
 
-    char *name = strdup(p->curr->value);
+    const char *name = p->curr.value;
     parser_expect(p, TT_ID);
 
-    if (p->curr->type == TT_LPAREN)
-        return parser_parse_fdef(p, type, name);
+    if (p->curr.type == TT_LPAREN)
+        return parser_parse_fdef(p, type, vlen, name);
 
-    struct Node *n = node_alloc(NODE_VARDEF);
+    struct Node *n = parser_node(p, NODE_VARDEF);
+    n->vardef.len = vlen;
 
-    if (p->curr->type == TT_EQUAL)
+    if (p->curr.type == TT_EQUAL)
     {
         parser_expect(p, TT_EQUAL);
 
         struct Node *value = parser_parse_expr(p);
-        n->vardef_name = name;
-        n->vardef_type = type;
+        n->vardef.name = name;
+        n->vardef.type = type;
 
-        n->vardef_value = value;
+        n->vardef.value = value;
     }
     else
     {
-        n->vardef_name = name;
-        n->vardef_type = type;
+        n->vardef.name = name;
+        n->vardef.type = type;
 
-        // Default value allocation
-        n->vardef_value = node_alloc(n->vardef_type);
+        // Default value, zeroed by the arena
+        n->vardef.value = parser_node(p, n->vardef.type);
 
         if (type == NODE_VEC)
-        {
-            n->vardef_value->vec_len = vlen;
-            n->vardef_value->vec_tree_values = malloc(sizeof(struct Node*) * vlen);
-
-            for (size_t i = 0; i < vlen; ++i)
-                n->vardef_value->vec_tree_values[i] = node_alloc(NODE_FLOAT);
-        }
+            n->vardef.value->vec.len = vlen;
     }
 
     return n;
@@ -238,20 +292,22 @@ struct Node *parser_parse_vardef(struct Parser *p)
 
 struct Node *parser_parse_call(struct Parser *p)
 {
-    struct Node *n = node_alloc(NODE_FUNC_CALL);
-    n->call_name = p->prev->value;
+    struct Node *n = parser_node(p, NODE_FUNC_CALL);
+    n->call.name = p->prev.value;
 
     parser_expect(p, TT_LPAREN);
 
     // Function args
-    while (p->curr->type != TT_RPAREN)
+    while (p->curr.type != TT_RPAREN)
     {
         struct Node *expr = parser_parse_expr(p);
 
-        n->call_args = realloc(n->call_args, sizeof(struct Node*) * ++n->call_nargs);
-        n->call_args[n->call_nargs - 1] = expr;
+        n->call.args = arena_realloc(p->arena, n->call.args, sizeof(struct Node*) * n->call.nargs,
+                                     sizeof(struct Node*) * (n->call.nargs + 1));
+        ++n->call.nargs;
+        n->call.args[n->call.nargs - 1] = expr;
 
-        if (p->curr->type != TT_RPAREN)
+        if (p->curr.type != TT_RPAREN)
             parser_expect(p, TT_COMMA);
     }
 
@@ -260,29 +316,36 @@ struct Node *parser_parse_call(struct Parser *p)
 }
 
 
-struct Node *parser_parse_fdef(struct Parser *p, NodeType type, char *name)
+struct Node *parser_parse_fdef(struct Parser *p, NodeType type, size_t len, const char *name)
 {
-    struct Node *n = node_alloc(NODE_FUNC_DEF);
-    n->fdef_type = type;
-    n->fdef_name = name;
+    struct Node *n = parser_node(p, NODE_FUNC_DEF);
+    n->fdef.type = type;
+    n->fdef.len = len;
+    n->fdef.name = name;
 
     // Parameters
     parser_expect(p, TT_LPAREN);
 
-    while (p->curr->type != TT_RPAREN)
+    while (p->curr.type != TT_RPAREN)
     {
-        struct Node *param = node_alloc(NODE_PARAM);
+        struct Node *param = parser_node(p, NODE_PARAM);
+
+        param->param.type = node_str2nt(p->curr.value);
+
+        if (param->param.type == NODE_VEC)
+            param->param.len = parser_vec_len(p->curr.value);
 
-        param->param_type = node_str2nt(p->curr->value);
         parser_expect(p, TT_ID);
 
-        param->param_name = strdup(p->curr->value);
+        param->param.name = p->curr.value;
         parser_expect(p, TT_ID);
 
-        n->fdef_params = realloc(n->fdef_params, sizeof(struct Node*) * ++n->fdef_nparams);
-        n->fdef_params[n->fdef_nparams - 1] = param;
+        n->fdef.params = arena_realloc(p->arena, n->fdef.params, sizeof(struct Node*) * n->fdef.nparams,
+                                       sizeof(struct Node*) * (n->fdef.nparams + 1));
+        ++n->fdef.nparams;
+        n->fdef.params[n->fdef.nparams - 1] = param;
 
-        if (p->curr->type != TT_RPAREN)
+        if (p->curr.type != TT_RPAREN)
             parser_expect(p, TT_COMMA);
     }
 
@@ -290,9 +353,18 @@ struct Node *parser_parse_fdef(struct Parser *p, NodeType type, char *name)
 
     // Function body
     parser_expect(p, TT_LBRACE);
-    n->fdef_body = parser_parse(p);
+    n->fdef.body = parser_parse(p);
     parser_expect(p, TT_RBRACE);
 
+    // Without branches nothing after a return can run
+    struct Node *body = n->fdef.body;
+
+    for (size_t i = 0; i < body->comp.nvalues; ++i)
+    {
+        if (body->comp.values[i] && body->comp.values[i]->type == NODE_RETURN)
+            body->comp.nvalues = i + 1;
+    }
+
     return n;
 }
 
@@ -300,14 +372,14 @@ struct Node *parser_parse_fdef(struct Parser *p, NodeType type, char *name)
 struct Node *parser_parse_assign(struct Parser *p)
 {
     // On equal
-    struct Node *n = node_alloc(NODE_ASSIGN);
+    struct Node *n = parser_node(p, NODE_ASSIGN);
 
-    n->assign_left = node_alloc(NODE_VAR);
-    n->assign_left->var_name = strdup(p->prev->value);
+    n->assign.left = parser_node(p, NODE_VAR);
+    n->assign.left->var.name = p->prev.value;
 
     parser_expect(p, TT_EQUAL);
 
-    n->assign_right = parser_parse_expr(p);
+    n->assign.right = parser_parse_expr(p);
 
     return n;
 }
@@ -316,25 +388,31 @@ struct Node *parser_parse_assign(struct Parser *p)
 struct Node *parser_parse_constructor(struct Parser *p)
 {
     // On lparen
-    NodeType type = node_str2nt(p->prev->value);
-    // For vec
-    size_t expect_len = p->prev->value[3] - '0';
-    char *name = strdup(p->prev->value);
+    NodeType type = node_str2nt(p->prev.value);
+    size_t expect_len = type == NODE_VEC ? parser_vec_len(p->prev.value) : 1;
+    const char *name = p->prev.value;
 
     parser_expect(p, TT_LPAREN);
 
-    struct Node *n = node_alloc(NODE_CONSTRUCTOR);
-    n->construct_type = type;
+    struct Node *n = parser_node(p, NODE_CONSTRUCTOR);
+    n->construct.type = type;
 
-    struct Node **values = 0;
-    size_t nvalues = 0;
+    // Only literals can be folded into an inline vector
+    bool literal = true;
 
-    while (p->curr->type != TT_RPAREN)
+    while (p->curr.type != TT_RPAREN)
     {
-        values = realloc(values, sizeof(struct Node*) * ++nvalues);
-        values[nvalues - 1] = parser_parse_expr(p);
+        struct Node *arg = parser_parse_expr(p);
+
+        n->construct.args = arena_realloc(p->arena, n->construct.args, sizeof(struct Node*) * n->construct.nargs,
+                                          sizeof(struct Node*) * (n->construct.nargs + 1));
+        ++n->construct.nargs;
+        n->construct.args[n->construct.nargs - 1] = arg;
+
+        if (arg->type != NODE_INT && arg->type != NODE_FLOAT)
+            literal = false;
 
-        if (p->curr->type != TT_RPAREN)
+        if (p->curr.type != TT_RPAREN)
             parser_expect(p, TT_COMMA);
     }
 
@@ -344,73 +422,89 @@ struct Node *parser_parse_constructor(struct Parser *p)
     {
     case NODE_FLOAT:
     case NODE_INT:
-    {
-        n->construct_out = values[0];
-    } break;
     case NODE_VEC:
-    {
-        if (expect_len != nvalues)
+        if (expect_len != n->construct.nargs)
         {
-            fprintf(stderr, "Parser error: Constructor of type '%s' does not take %zu args - "
+            fprintf(stderr, "Parser error on line %zu: Constructor of type '%s' does not take %zu args - "
                     "%zu were expected.\n",
-                    name, nvalues, expect_len);
+                    n->line, name, n->construct.nargs, expect_len);
             exit(EXIT_FAILURE);
         }
-
-        n->construct_out = node_alloc(NODE_VEC);
-        n->construct_out->vec_len = nvalues;
-        n->construct_out->vec_tree_values = malloc(sizeof(struct Node*) * n->construct_out->vec_len);
-
-        for (size_t i = 0; i < n->construct_out->vec_len; ++i)
-            n->construct_out->vec_tree_values[i] = values[i];
-    } break;
+        break;
     default:
         fprintf(stderr, "[parser_parse_constructor] Error: %d is not a data type.\n", type);
         exit(EXIT_FAILURE);
     }
 
-    free(values);
-    free(name);
+    if (type == NODE_VEC && literal)
+    {
+        struct Node *vec = parser_node(p, NODE_VEC);
+        vec->vec.len = n->construct.nargs;
+
+        for (size_t i = 0; i < vec->vec.len; ++i)
+        {
+            struct Node *arg = n->construct.args[i];
+            vec->vec.values[i] = arg->type == NODE_INT ? arg->int_value : arg->float_value;
+        }
+
+        return vec;
+    }
+
     return n;
 }
 
 
+size_t parser_vec_len(const char *type)
+{
+    size_t len = type[3] - '0';
+
+    if (len < 2 || len > NODE_VEC_MAX || type[4] != '\0')
+    {
+        fprintf(stderr, "Parser error: '%s' is not a vector type.\n", type);
+        exit(EXIT_FAILURE);
+    }
+
+    return len;
+}
+
+
 struct Node *parser_parse_binop(struct Parser *p, struct Node *left)
 {
-    struct Node *n = node_alloc(NODE_BINOP);
+    struct Node *n = parser_node(p, NODE_BINOP);
 
-    switch (p->curr->value[0])
+    switch (p->curr.value[0])
     {
-    case '+': n->op = BINOP_ADD; break;
-    case '-': n->op = BINOP_SUB; break;
-    case '*': n->op = BINOP_MUL; break;
-    case '/': n->op = BINOP_DIV; break;
+    case '+': n->binop.op = BINOP_ADD; break;
+    case '-': n->binop.op = BINOP_SUB; break;
+    case '*': n->binop.op = BINOP_MUL; break;
+    case '/': n->binop.op = BINOP_DIV; break;
     default:
-        fprintf(stderr, "[parser_parse_binop] Error: Operator '%c' not defined.\n", p->curr->value[0]);
+        fprintf(stderr, "[parser_parse_binop] Error: Operator '%c' not defined.\n", p->curr.value[0]);
         exit(EXIT_FAILURE);
     }
 
     parser_expect(p, TT_BINOP);
 
-    n->op_l = left;
+    n->binop.l = left;
 
     struct Node *parent = parser_parse_expr(p);
 
-    if (parent->type == NODE_BINOP && !parent->op_priority)
+    if (parent->type == NODE_BINOP && !parent->binop.priority)
     {
         struct Node *bot_left = parent;
 
-        while (bot_left->op_l->type == NODE_BINOP)
-            bot_left = bot_left->op_l;
+        // Parenthesized operands stay whole
+        while (bot_left->binop.l->type == NODE_BINOP && !bot_left->binop.l->binop.priority)
+            bot_left = bot_left->binop.l;
 
-        n->op_r = bot_left->op_l;
-        bot_left->op_l = n;
+        n->binop.r = bot_left->binop.l;
+        bot_left->binop.l = n;
 
         return parent;
     }
     else
     {
-        n->op_r = parent;
+        n->binop.r = parent;
         return n;
     }
 }
@@ -7,16 +7,34 @@
 
 struct Parser
 {
-    struct Token *curr, *prev;
+    struct Token curr, prev;
     struct Lexer *lexer;
 
     struct Node *prev_node;
+
+    // Owns every node the parser produces
+    struct Arena *arena;
+
+    // Source text, mapped from a file unless given by the caller
+    const char *contents;
+    size_t len;
+    bool mapped;
+
+    // Names in nodes are interned, their copies live in the arena
+    struct Symtab *syms;
+
+    // Interned keywords, compared by pointer
+    const char *kw_in, *kw_out, *kw_return, *kw_layout;
 };
 
-struct Parser *parser_alloc(const char *path);
+struct Parser *parser_alloc(const char *path, struct Arena *arena);
+// Parses len bytes at contents, which must outlive the parser
+struct Parser *parser_alloc_source(const char *contents, size_t len, struct Arena *arena);
 void parser_free(struct Parser *p);
 
 void parser_expect(struct Parser *p, TokenType type);
+// Node on the line of the current token
+struct Node *parser_node(struct Parser *p, NodeType type);
 
 struct Node *parser_parse(struct Parser *p);
 struct Node *parser_parse_expr(struct Parser *p);
@@ -28,9 +46,12 @@ struct Node *parser_parse_id(struct Parser *p);
 struct Node *parser_parse_var(struct Parser *p);
 struct Node *parser_parse_vardef(struct Parser *p);
 struct Node *parser_parse_call(struct Parser *p);
-struct Node *parser_parse_fdef(struct Parser *p, NodeType type, char *name);
+// len is the vector length of the return type
+struct Node *parser_parse_fdef(struct Parser *p, NodeType type, size_t len, const char *name);
 struct Node *parser_parse_assign(struct Parser *p);
 struct Node *parser_parse_constructor(struct Parser *p);
+// Component count of a vecN type name, exits if it isn't one
+size_t parser_vec_len(const char *type);
 struct Node *parser_parse_binop(struct Parser *p, struct Node *left);
 
 #endif
@@ -0,0 +1,484 @@
+#include "sema.h"
+#include "builtin.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TYPE_STR(t) node_nt2str((t).type, (t).len)
+
+
+void sema_check(struct Node *root)
+{
+    struct Sema *s = sema_alloc(root);
+
+    sema_check_funcs(s);
+
+    // Initializers only see the globals before them, functions see all
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        struct Node *n = root->comp.values[i];
+
+        switch (n->type)
+        {
+        case NODE_VARDEF:
+            sema_check_vardef(s, n);
+            s->nglobals = s->nvars;
+            break;
+        case NODE_FUNC_DEF: break;
+        default:
+            fprintf(stderr, "[sema_check] Error: Line %zu: Only variables and functions can be declared "
+                    "outside of functions.\n", n->line);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (size_t i = 0; i < root->comp.nvalues; ++i)
+    {
+        if (root->comp.values[i]->type == NODE_FUNC_DEF)
+            sema_check_fdef(s, root->comp.values[i]);
+    }
+
+    sema_free(s);
+}
+
+
+struct Sema *sema_alloc(struct Node *root)
+{
+    struct Sema *s = malloc(sizeof(struct Sema));
+    s->root = root;
+
+    s->vars = 0;
+    s->nvars = 0;
+    s->nglobals = 0;
+
+    s->fdef = 0;
+
+    return s;
+}
+
+
+void sema_free(struct Sema *s)
+{
+    free(s->vars);
+    free(s);
+}
+
+
+void sema_declare(struct Sema *s, const char *name, VarModifier modifier, struct SemaType t)
+{
+    s->vars = realloc(s->vars, sizeof(struct SemaVar) * ++s->nvars);
+    s->vars[s->nvars - 1] = (struct SemaVar){ name, modifier, t };
+}
+
+
+struct SemaVar *sema_find_var(struct Sema *s, struct Node *n, const char *name)
+{
+    // Locals shadow globals, later definitions shadow earlier ones
+    for (size_t i = s->nvars; i > s->nglobals; --i)
+    {
+        if (strcmp(s->vars[i - 1].name, name) == 0)
+            return &s->vars[i - 1];
+    }
+
+    for (size_t i = 0; i < s->nglobals; ++i)
+    {
+        if (strcmp(s->vars[i].name, name) == 0)
+            return &s->vars[i];
+    }
+
+    fprintf(stderr, "[sema_find_var] Error: Line %zu: No variable named '%s'.\n", n->line, name);
+    exit(EXIT_FAILURE);
+}
+
+
+struct Node *sema_find_func(struct Sema *s, const char *name)
+{
+    for (size_t i = 0; i < s->root->comp.nvalues; ++i)
+    {
+        struct Node *n = s->root->comp.values[i];
+
+        if (n->type == NODE_FUNC_DEF && strcmp(n->fdef.name, name) == 0)
+            return n;
+    }
+
+    return 0;
+}
+
+
+struct SemaType sema_type(NodeType type, size_t len)
+{
+    switch (type)
+    {
+    case NODE_INT:
+    case NODE_FLOAT:
+        return (struct SemaType){ type, 1 };
+    case NODE_VEC: return (struct SemaType){ type, len };
+    default:
+        return (struct SemaType){ NODE_VOID, 0 };
+    }
+}
+
+
+void sema_check_funcs(struct Sema *s)
+{
+    for (size_t i = 0; i < s->root->comp.nvalues; ++i)
+    {
+        struct Node *n = s->root->comp.values[i];
+        if (n->type != NODE_FUNC_DEF) continue;
+
+        if (builtin_find(n->fdef.name) != -1)
+        {
+            fprintf(stderr, "[sema_check_funcs] Error: Line %zu: '%s' is a built-in function.\n",
+                    n->line, n->fdef.name);
+            exit(EXIT_FAILURE);
+        }
+
+        if (sema_find_func(s, n->fdef.name) != n)
+        {
+            fprintf(stderr, "[sema_check_funcs] Error: Line %zu: '%s' is already defined.\n",
+                    n->line, n->fdef.name);
+            exit(EXIT_FAILURE);
+        }
+
+        for (size_t j = 0; j < n->fdef.nparams; ++j)
+        {
+            struct Node *param = n->fdef.params[j];
+
+            if (sema_type(param->param.type, param->param.len).type == NODE_VOID)
+            {
+                fprintf(stderr, "[sema_check_funcs] Error: Line %zu: Parameter '%s' of '%s' does not have "
+                        "a data type.\n", param->line, param->param.name, n->fdef.name);
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+
+    if (!sema_find_func(s, "main"))
+    {
+        fprintf(stderr, "[sema_check_funcs] Error: Shader has no main function.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+void sema_check_vardef(struct Sema *s, struct Node *n)
+{
+    struct SemaType t = sema_type(n->vardef.type, n->vardef.len);
+
+    if (t.type == NODE_VOID)
+    {
+        fprintf(stderr, "[sema_check_vardef] Error: Line %zu: '%s' does not have a data type.\n",
+                n->line, n->vardef.name);
+        exit(EXIT_FAILURE);
+    }
+
+    // Written from vertex buffers, which only hold floats
+    if (n->vardef.modifier == VAR_LAYOUT && t.type == NODE_INT)
+    {
+        fprintf(stderr, "[sema_check_vardef] Error: Line %zu: Layout variable '%s' must be a float or "
+                "vector.\n", n->line, n->vardef.name);
+        exit(EXIT_FAILURE);
+    }
+
+    // The value comes before the name is in scope
+    sema_check_store(n, n->vardef.name, t, sema_check_expr(s, n->vardef.value));
+    sema_declare(s, n->vardef.name, n->vardef.modifier, t);
+}
+
+
+void sema_check_fdef(struct Sema *s, struct Node *fdef)
+{
+    s->fdef = fdef;
+
+    // Parameters and locals go out of scope with the function
+    s->nvars = s->nglobals;
+
+    for (size_t i = 0; i < fdef->fdef.nparams; ++i)
+    {
+        struct Node *param = fdef->fdef.params[i];
+        sema_declare(s, param->param.name, VAR_REG, sema_type(param->param.type, param->param.len));
+    }
+
+    struct Node *body = fdef->fdef.body;
+    bool returned = false;
+
+    for (size_t i = 0; i < body->comp.nvalues; ++i)
+    {
+        if (!body->comp.values[i]) continue;
+
+        sema_check_stmt(s, body->comp.values[i]);
+        returned = body->comp.values[i]->type == NODE_RETURN;
+    }
+
+    if (!returned && fdef->fdef.type != NODE_VOID)
+    {
+        fprintf(stderr, "[sema_check_fdef] Error: Line %zu: '%s' does not return a value.\n",
+                fdef->line, fdef->fdef.name);
+        exit(EXIT_FAILURE);
+    }
+
+    s->nvars = s->nglobals;
+    s->fdef = 0;
+}
+
+
+void sema_check_stmt(struct Sema *s, struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_VARDEF: sema_check_vardef(s, n); break;
+    // Void calls are only valid as statements
+    case NODE_FUNC_CALL: sema_check_call(s, n); break;
+    case NODE_RETURN:
+    {
+        struct Node *fdef = s->fdef;
+        struct SemaType ret = sema_type(fdef->fdef.type, fdef->fdef.len);
+
+        if (!n->ret.value != (ret.type == NODE_VOID))
+        {
+            fprintf(stderr, "[sema_check_stmt] Error: Line %zu: '%s' must return %s.\n", n->line,
+                    fdef->fdef.name, ret.type == NODE_VOID ? "nothing" : "a value");
+            exit(EXIT_FAILURE);
+        }
+
+        if (n->ret.value)
+            sema_check_store(n, fdef->fdef.name, ret, sema_check_expr(s, n->ret.value));
+    } break;
+    default:
+        sema_check_expr(s, n);
+    }
+}
+
+
+void sema_check_store(struct Node *n, const char *what, struct SemaType t, struct SemaType value)
+{
+    if (t.type != value.type || t.len != value.len)
+    {
+        fprintf(stderr, "[sema_check_store] Error: Line %zu: Cannot store %s in '%s' of type %s.\n",
+                n->line, TYPE_STR(value), what, TYPE_STR(t));
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+struct SemaType sema_check_expr(struct Sema *s, struct Node *n)
+{
+    switch (n->type)
+    {
+    case NODE_INT:
+    case NODE_FLOAT:
+        return sema_type(n->type, 1);
+    case NODE_VEC: return sema_type(NODE_VEC, n->vec.len);
+    case NODE_VAR: return sema_check_var(s, n);
+    case NODE_CONSTRUCTOR: return sema_check_construct(s, n);
+    case NODE_BINOP: return sema_check_binop(s, n);
+    case NODE_ASSIGN: return sema_check_assign(s, n);
+    case NODE_FUNC_CALL:
+    {
+        struct SemaType t = sema_check_call(s, n);
+
+        if (t.type == NODE_VOID)
+        {
+            fprintf(stderr, "[sema_check_expr] Error: Line %zu: '%s' does not return a value.\n",
+                    n->line, n->call.name);
+            exit(EXIT_FAILURE);
+        }
+
+        return t;
+    }
+    default:
+        fprintf(stderr, "[sema_check_expr] Error: Line %zu: Expected an expression.\n", n->line);
+        exit(EXIT_FAILURE);
+    }
+}
+
+
+struct SemaType sema_check_var(struct Sema *s, struct Node *n)
+{
+    struct SemaVar *var = sema_find_var(s, n, n->var.name);
+
+    if (!n->var.memb_access)
+        return var->t;
+
+    size_t len = sema_check_swizzle(n, var);
+    return len == 1 ? sema_type(NODE_FLOAT, 1) : sema_type(NODE_VEC, len);
+}
+
+
+struct SemaType sema_check_construct(struct Sema *s, struct Node *n)
+{
+    for (size_t i = 0; i < n->construct.nargs; ++i)
+    {
+        struct SemaType t = sema_check_expr(s, n->construct.args[i]);
+
+        if (t.len != 1)
+        {
+            fprintf(stderr, "[sema_check_construct] Error: Line %zu: Constructor arguments must be scalars, "
+                    "argument %zu is a %s.\n", n->line, i + 1, TYPE_STR(t));
+            exit(EXIT_FAILURE);
+        }
+
+        // Scalar constructors pass their argument through unchanged
+        if (n->construct.type != NODE_VEC)
+            return t;
+    }
+
+    return sema_type(NODE_VEC, n->construct.nargs);
+}
+
+
+struct SemaType sema_check_binop(struct Sema *s, struct Node *n)
+{
+    struct SemaType l = sema_check_expr(s, n->binop.l);
+    struct SemaType r = sema_check_expr(s, n->binop.r);
+
+    // Float scalars are broadcast against vectors
+    if (l.type == NODE_VEC && r.type == NODE_FLOAT)
+        r = l;
+    else if (r.type == NODE_VEC && l.type == NODE_FLOAT)
+        l = r;
+
+    if (l.type != r.type || l.len != r.len)
+    {
+        fprintf(stderr, "[sema_check_binop] Error: Line %zu: Types %s and %s are incompatible.\n",
+                n->line, TYPE_STR(l), TYPE_STR(r));
+        exit(EXIT_FAILURE);
+    }
+
+    return l;
+}
+
+
+struct SemaType sema_check_assign(struct Sema *s, struct Node *n)
+{
+    struct SemaType value = sema_check_expr(s, n->assign.right);
+    struct SemaVar *var = sema_find_var(s, n, n->assign.left->var.name);
+
+    if (var->modifier & (VAR_IN | VAR_LAYOUT))
+    {
+        fprintf(stderr, "[sema_check_assign] Error: Line %zu: Cannot assign to input variable '%s'.\n",
+                n->line, var->name);
+        exit(EXIT_FAILURE);
+    }
+
+    sema_check_store(n, var->name, var->t, value);
+    return var->t;
+}
+
+
+struct SemaType sema_check_call(struct Sema *s, struct Node *n)
+{
+    struct Node *fdef = sema_find_func(s, n->call.name);
+
+    if (!fdef)
+    {
+        int idx = builtin_find(n->call.name);
+        if (idx != -1) return sema_check_builtin(s, n, idx);
+
+        fprintf(stderr, "[sema_check_call] Error: Line %zu: No function named '%s'.\n", n->line, n->call.name);
+        exit(EXIT_FAILURE);
+    }
+
+    if (n->call.nargs != fdef->fdef.nparams)
+    {
+        fprintf(stderr, "[sema_check_call] Error: Line %zu: '%s' takes %zu arguments, %zu were given.\n",
+                n->line, n->call.name, fdef->fdef.nparams, n->call.nargs);
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < n->call.nargs; ++i)
+    {
+        struct Node *param = fdef->fdef.params[i];
+
+        sema_check_store(n, param->param.name, sema_type(param->param.type, param->param.len),
+                         sema_check_expr(s, n->call.args[i]));
+    }
+
+    return sema_type(fdef->fdef.type, fdef->fdef.len);
+}
+
+
+struct SemaType sema_check_builtin(struct Sema *s, struct Node *n, int idx)
+{
+    const struct Builtin *b = &builtins[idx];
+
+    if (n->call.nargs != b->nargs)
+    {
+        fprintf(stderr, "[sema_check_builtin] Error: Line %zu: '%s' takes %zu arguments, %zu were given.\n",
+                n->line, b->name, b->nargs, n->call.nargs);
+        exit(EXIT_FAILURE);
+    }
+
+    // Arguments are as long as the longest one
+    size_t len = 1;
+    struct SemaType args[b->nargs];
+
+    for (size_t i = 0; i < n->call.nargs; ++i)
+    {
+        args[i] = sema_check_expr(s, n->call.args[i]);
+
+        if (args[i].type != NODE_FLOAT && args[i].type != NODE_VEC)
+        {
+            fprintf(stderr, "[sema_check_builtin] Error: Line %zu: '%s' takes float or vector arguments.\n",
+                    n->line, b->name);
+            exit(EXIT_FAILURE);
+        }
+
+        if (args[i].len > len)
+            len = args[i].len;
+    }
+
+    if (b->len && len != b->len)
+    {
+        fprintf(stderr, "[sema_check_builtin] Error: Line %zu: '%s' takes vec%zu arguments.\n",
+                n->line, b->name, b->len);
+        exit(EXIT_FAILURE);
+    }
+
+    // Only component wise functions broadcast floats
+    for (size_t i = 0; i < n->call.nargs; ++i)
+    {
+        if (args[i].len != len && (args[i].len != 1 || b->shape != BUILTIN_MAP))
+        {
+            fprintf(stderr, "[sema_check_builtin] Error: Line %zu: Arguments of '%s' must have the same "
+                    "length.\n", n->line, b->name);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    size_t out = builtin_result_len(b, len);
+    return out == 1 ? sema_type(NODE_FLOAT, 1) : sema_type(NODE_VEC, out);
+}
+
+
+size_t sema_check_swizzle(struct Node *n, struct SemaVar *var)
+{
+    static const char *sets[] = { "xyzw", "rgba" };
+
+    const char *memb = n->var.memb_access;
+    size_t len = strlen(memb);
+    const char *set = 0;
+
+    for (size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); ++i)
+    {
+        if (strchr(sets[i], memb[0]))
+            set = sets[i];
+    }
+
+    bool valid = var->t.type == NODE_VEC && set && len <= NODE_VEC_MAX;
+
+    for (size_t i = 0; valid && i < len; ++i)
+    {
+        const char *at = strchr(set, memb[i]);
+        valid = at && (size_t)(at - set) < var->t.len;
+    }
+
+    if (!valid)
+    {
+        fprintf(stderr, "[sema_check_swizzle] Error: Line %zu: Invalid member access '%s.%s' on %s.\n",
+                n->line, var->name, memb, TYPE_STR(var->t));
+        exit(EXIT_FAILURE);
+    }
+
+    return len;
+}
@@ -0,0 +1,62 @@
+#ifndef SHADER_SEMA_H
+#define SHADER_SEMA_H
+
+#include "node.h"
+
+struct SemaType
+{
+    NodeType type;
+    size_t len;
+};
+
+struct SemaVar
+{
+    const char *name;
+    VarModifier modifier;
+    struct SemaType t;
+};
+
+struct Sema
+{
+    struct Node *root;
+
+    // Globals declared so far, then the current function's parameters and
+    // locals
+    struct SemaVar *vars;
+    size_t nvars, nglobals;
+
+    // Function being checked, 0 in global initializers
+    struct Node *fdef;
+};
+
+// Checks the types of a parsed shader once, before any other pass, so the
+// compiled code needs no checks. Exits with the line of the first error.
+void sema_check(struct Node *root);
+
+struct Sema *sema_alloc(struct Node *root);
+void sema_free(struct Sema *s);
+
+void sema_declare(struct Sema *s, const char *name, VarModifier modifier, struct SemaType t);
+struct SemaVar *sema_find_var(struct Sema *s, struct Node *n, const char *name);
+struct Node *sema_find_func(struct Sema *s, const char *name);
+// Type a parameter, vardef or function of type and len holds
+struct SemaType sema_type(NodeType type, size_t len);
+
+void sema_check_funcs(struct Sema *s);
+void sema_check_vardef(struct Sema *s, struct Node *n);
+void sema_check_fdef(struct Sema *s, struct Node *fdef);
+void sema_check_stmt(struct Sema *s, struct Node *n);
+// Exits unless value has type t, what names the destination in errors
+void sema_check_store(struct Node *n, const char *what, struct SemaType t, struct SemaType value);
+
+struct SemaType sema_check_expr(struct Sema *s, struct Node *n);
+struct SemaType sema_check_var(struct Sema *s, struct Node *n);
+struct SemaType sema_check_construct(struct Sema *s, struct Node *n);
+struct SemaType sema_check_binop(struct Sema *s, struct Node *n);
+struct SemaType sema_check_assign(struct Sema *s, struct Node *n);
+struct SemaType sema_check_call(struct Sema *s, struct Node *n);
+struct SemaType sema_check_builtin(struct Sema *s, struct Node *n, int idx);
+// Length of a swizzle like .zyx on var
+size_t sema_check_swizzle(struct Node *n, struct SemaVar *var);
+
+#endif
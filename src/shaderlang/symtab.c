@@ -0,0 +1,85 @@
+#include "symtab.h"
+#include <stdlib.h>
+#include <string.h>
+
+
+struct Symtab *symtab_alloc(struct Arena *a)
+{
+    struct Symtab *t = malloc(sizeof(struct Symtab));
+    t->arena = a;
+    t->cap = SYMTAB_MIN_CAP;
+    t->n = 0;
+    t->slots = calloc(t->cap, sizeof(struct SymtabSlot));
+
+    return t;
+}
+
+
+void symtab_free(struct Symtab *t)
+{
+    free(t->slots);
+    free(t);
+}
+
+
+const char *symtab_intern(struct Symtab *t, const char *s, size_t len)
+{
+    uint32_t hash = symtab_hash(s, len);
+    size_t i = hash & (t->cap - 1);
+
+    for (; t->slots[i].str; i = (i + 1) & (t->cap - 1))
+    {
+        struct SymtabSlot *slot = &t->slots[i];
+
+        if (slot->hash == hash && slot->len == len && memcmp(slot->str, s, len) == 0)
+            return slot->str;
+    }
+
+    // Zeroed by the arena, so already terminated
+    char *str = arena_push(t->arena, len + 1);
+    memcpy(str, s, len);
+
+    t->slots[i] = (struct SymtabSlot){ str, len, hash };
+
+    // At most half full keeps probes short
+    if (++t->n * 2 > t->cap)
+        symtab_grow(t);
+
+    return str;
+}
+
+
+void symtab_grow(struct Symtab *t)
+{
+    struct SymtabSlot *old = t->slots;
+    size_t old_cap = t->cap;
+
+    t->cap *= 2;
+    t->slots = calloc(t->cap, sizeof(struct SymtabSlot));
+
+    for (size_t i = 0; i < old_cap; ++i)
+    {
+        if (!old[i].str) continue;
+
+        size_t j = old[i].hash & (t->cap - 1);
+
+        while (t->slots[j].str)
+            j = (j + 1) & (t->cap - 1);
+
+        t->slots[j] = old[i];
+    }
+
+    free(old);
+}
+
+
+uint32_t symtab_hash(const char *s, size_t len)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; ++i)
+        hash = (hash ^ (unsigned char)s[i]) * 16777619u;
+
+    return hash;
+}
@@ -0,0 +1,34 @@
+#ifndef SHADER_SYMTAB_H
+#define SHADER_SYMTAB_H
+
+#include "arena.h"
+#include <stdint.h>
+
+// Initial slot count, a power of two
+#define SYMTAB_MIN_CAP 256
+
+// Interns strings, equal strings share one copy so they can be compared by
+// pointer. Copies live in the arena.
+struct Symtab
+{
+    struct Arena *arena;
+
+    // Open addressing, empty slots have no string
+    struct SymtabSlot
+    {
+        const char *str;
+        size_t len;
+        uint32_t hash;
+    } *slots;
+    size_t cap, n;
+};
+
+struct Symtab *symtab_alloc(struct Arena *a);
+void symtab_free(struct Symtab *t);
+
+// The NUL terminated copy of the len bytes at s
+const char *symtab_intern(struct Symtab *t, const char *s, size_t len);
+void symtab_grow(struct Symtab *t);
+uint32_t symtab_hash(const char *s, size_t len);
+
+#endif
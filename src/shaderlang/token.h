@@ -1,6 +1,8 @@
 #ifndef SHADER_TOKEN_H
 #define SHADER_TOKEN_H
 
+#include <stddef.h>
+
 typedef enum
 {
     TT_ID,
@@ -26,18 +28,17 @@ typedef enum
     BT_DIV
 } BinopToken;
 
+// Plain value, value is interned or a string literal and lives as long as
+// the lexer's symbol table
 struct Token
 {
     int type;
-    char *value;
+    const char *value;
 
     BinopToken binop;
-};
 
-// Value must be heap allocated, will be freed in token_free
-struct Token *token_alloc(TokenType type, char *value);
-struct Token *token_binop_alloc(BinopToken type, char *value);
-void token_free(struct Token *t);
+    // Set by the lexer
+    size_t line;
+};
 
 #endif
-
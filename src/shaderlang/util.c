@@ -1,38 +1,47 @@
 #include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 
-char *util_read_file(const char *path)
+const char *util_map_file(const char *path, size_t *len)
 {
-    FILE* file = fopen(path, "r");
+    int fd = open(path, O_RDONLY);
+    struct stat st;
 
-    if (!file)
+    if (fd == -1 || fstat(fd, &st) == -1)
     {
         fprintf(stderr, "Error: Unable to open file '%s'.\n", path);
         exit(EXIT_FAILURE);
     }
 
-    char* contents = malloc(sizeof(char));
-    contents[0] = '\0';
+    *len = st.st_size;
 
-    char* line = 0;
-    size_t len = 0;
-    ssize_t read;
-
-    while ((read = getline(&line, &len, file)) != -1)
+    // Zero length mappings fail
+    if (!*len)
     {
-        int prev_len = strlen(contents);
-        contents = realloc(contents, sizeof(char) * (prev_len + read + 1));
-
-        memcpy(&contents[prev_len], line, read);
-        contents[prev_len + read] = '\0';
+        close(fd);
+        return "";
     }
 
-    free(line);
-    fclose(file);
+    void *contents = mmap(0, *len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (contents == MAP_FAILED)
+    {
+        fprintf(stderr, "Error: Unable to map file '%s'.\n", path);
+        exit(EXIT_FAILURE);
+    }
 
     return contents;
 }
 
+
+void util_unmap_file(const char *contents, size_t len)
+{
+    if (len)
+        munmap((void*)contents, len);
+}
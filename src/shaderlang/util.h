@@ -1,7 +1,11 @@
 #ifndef SHADER_UTIL_H
 #define SHADER_UTIL_H
 
-char *util_read_file(const char *path);
+#include <sys/types.h>
 
-#endif
+// Maps the file read only, the contents are not NUL terminated. Empty
+// files give an empty string.
+const char *util_map_file(const char *path, size_t *len);
+void util_unmap_file(const char *contents, size_t len);
 
+#endif
@@ -0,0 +1,218 @@
+#include "vm.h"
+#include "jit.h"
+#include "builtin.h"
+#include <stdlib.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+
+// Component by component, r is either a float or a VmLane pointer
+#define VM_VECTOR(op) for (int i = 0; i < in->n; ++i) r[in->dst + i] = r[in->a + i] op r[in->b + i]
+#define VM_SPLAT() for (int i = 0; i < in->n; ++i) r[in->dst + i] = r[in->a]
+#define VM_BUILTIN(fast, width) \
+    builtin_fn(&builtins[in->b], fast, width)((float*)&r[in->dst], (const float*)&r[in->a], in->n, width)
+
+
+struct Frame *frame_alloc(struct Program *p, size_t width)
+{
+    struct Frame *f = malloc(sizeof(struct Frame));
+    f->prog = p;
+    f->width = width;
+    f->jit = 0;
+    f->native = 0;
+
+    // Packet registers are loaded as whole vectors
+    size_t size = sizeof(VmLane) * ((p->nslots * width * sizeof(float) + sizeof(VmLane) - 1) / sizeof(VmLane));
+    f->slots = aligned_alloc(sizeof(VmLane), size ? size : sizeof(VmLane));
+    memset(f->slots, 0, size);
+
+    frame_store(f, 0, p->image, p->nvarslots);
+
+    return f;
+}
+
+
+void frame_free(struct Frame *f)
+{
+    free(f->slots);
+    free(f);
+}
+
+
+void frame_reset(struct Frame *f)
+{
+    struct Program *p = f->prog;
+
+    for (size_t i = 0; i < p->nresets; ++i)
+    {
+        struct ProgramRange *r = &p->resets[i];
+        frame_store(f, r->slot, &p->image[r->slot], r->len);
+    }
+}
+
+
+void frame_store(struct Frame *f, int slot, const float *values, size_t len)
+{
+    if (f->width == 1)
+    {
+        memcpy(&f->slots[slot], values, sizeof(float) * len);
+        return;
+    }
+
+    for (size_t i = 0; i < len; ++i)
+    {
+        for (size_t j = 0; j < f->width; ++j)
+            FRAME_AT(f, slot + i, j) = values[i];
+    }
+}
+
+
+void vm_exec(struct Frame *f, size_t offset)
+{
+    if (f->jit)
+        jit_run(f->jit, f, offset);
+    else if (f->native)
+        f->native(f->slots, f->prog->consts, offset);
+    else if (f->width == 1)
+        vm_run(f, offset);
+    else
+        vm_run_packet(f, offset);
+}
+
+
+void vm_run(struct Frame *f, size_t offset)
+{
+    struct Program *p = f->prog;
+    float *r = f->slots;
+    const struct Instr *code = p->code;
+
+    size_t stack[VM_CALL_DEPTH];
+    size_t sp = 0;
+
+    size_t pc = offset;
+
+    while (true)
+    {
+        const struct Instr *in = &code[pc++];
+
+        switch (in->op)
+        {
+        case OP_LOADK: r[in->dst] = p->consts[in->a]; break;
+        case OP_MOV:
+            for (int i = 0; i < in->n; ++i)
+                r[in->dst + i] = r[in->a + i];
+            break;
+
+        case OP_ADD: r[in->dst] = r[in->a] + r[in->b]; break;
+        case OP_SUB: r[in->dst] = r[in->a] - r[in->b]; break;
+        case OP_MUL: r[in->dst] = r[in->a] * r[in->b]; break;
+        case OP_DIV: r[in->dst] = r[in->a] / r[in->b]; break;
+
+        case OP_IADD: r[in->dst] = (int)r[in->a] + (int)r[in->b]; break;
+        case OP_ISUB: r[in->dst] = (int)r[in->a] - (int)r[in->b]; break;
+        case OP_IMUL: r[in->dst] = (int)r[in->a] * (int)r[in->b]; break;
+        case OP_IDIV: r[in->dst] = (int)r[in->a] / (int)r[in->b]; break;
+
+        case OP_VADD: VM_VECTOR(+); break;
+        case OP_VSUB: VM_VECTOR(-); break;
+        case OP_VMUL: VM_VECTOR(*); break;
+        case OP_VDIV: VM_VECTOR(/); break;
+        case OP_SPLAT: VM_SPLAT(); break;
+        case OP_BUILTIN: VM_BUILTIN(false, 1); break;
+        case OP_BUILTIN_FAST: VM_BUILTIN(true, 1); break;
+
+        case OP_CALL:
+            if (sp == VM_CALL_DEPTH)
+            {
+                fprintf(stderr, "[vm_run] Error: Call stack overflow in '%s'.\n", p->funcs[in->a].name);
+                exit(EXIT_FAILURE);
+            }
+
+            stack[sp++] = pc;
+            pc = p->funcs[in->a].offset;
+            break;
+        case OP_RET:
+            if (sp == 0) return;
+            pc = stack[--sp];
+            break;
+        }
+    }
+}
+
+
+#if defined(__x86_64__)
+__attribute__((target_clones("avx2", "default")))
+#endif
+void vm_run_packet(struct Frame *f, size_t offset)
+{
+    struct Program *p = f->prog;
+    VmLane *r = (VmLane*)f->slots;
+    const struct Instr *code = p->code;
+
+    size_t stack[VM_CALL_DEPTH];
+    size_t sp = 0;
+
+    size_t pc = offset;
+
+#define INT(reg) __builtin_convertvector(r[reg], VmLaneInt)
+#define FLOAT(v) __builtin_convertvector(v, VmLane)
+
+    while (true)
+    {
+        const struct Instr *in = &code[pc++];
+
+        switch (in->op)
+        {
+        case OP_LOADK: r[in->dst] = (VmLane){ 0 } + p->consts[in->a]; break;
+        case OP_MOV:
+            for (int i = 0; i < in->n; ++i)
+                r[in->dst + i] = r[in->a + i];
+            break;
+
+        case OP_ADD: r[in->dst] = r[in->a] + r[in->b]; break;
+        case OP_SUB: r[in->dst] = r[in->a] - r[in->b]; break;
+        case OP_MUL: r[in->dst] = r[in->a] * r[in->b]; break;
+        case OP_DIV: r[in->dst] = r[in->a] / r[in->b]; break;
+
+        case OP_IADD: r[in->dst] = FLOAT(INT(in->a) + INT(in->b)); break;
+        case OP_ISUB: r[in->dst] = FLOAT(INT(in->a) - INT(in->b)); break;
+        case OP_IMUL: r[in->dst] = FLOAT(INT(in->a) * INT(in->b)); break;
+        case OP_IDIV:
+        {
+            // Idle lanes hold whatever their slots had, lanes that would
+            // trap divide by 1 instead
+            VmLaneInt a = INT(in->a), b = INT(in->b);
+            VmLaneInt trap = (b == 0) | ((a == INT_MIN) & (b == -1));
+            b = (b & ~trap) | (trap & 1);
+
+            r[in->dst] = FLOAT(a / b);
+        } break;
+
+        case OP_VADD: VM_VECTOR(+); break;
+        case OP_VSUB: VM_VECTOR(-); break;
+        case OP_VMUL: VM_VECTOR(*); break;
+        case OP_VDIV: VM_VECTOR(/); break;
+        case OP_SPLAT: VM_SPLAT(); break;
+        case OP_BUILTIN: VM_BUILTIN(false, VM_PACKET_W); break;
+        case OP_BUILTIN_FAST: VM_BUILTIN(true, VM_PACKET_W); break;
+
+        case OP_CALL:
+            if (sp == VM_CALL_DEPTH)
+            {
+                fprintf(stderr, "[vm_run_packet] Error: Call stack overflow in '%s'.\n", p->funcs[in->a].name);
+                exit(EXIT_FAILURE);
+            }
+
+            stack[sp++] = pc;
+            pc = p->funcs[in->a].offset;
+            break;
+        case OP_RET:
+            if (sp == 0) return;
+            pc = stack[--sp];
+            break;
+        }
+    }
+
+#undef INT
+#undef FLOAT
+}
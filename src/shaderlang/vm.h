@@ -0,0 +1,51 @@
+#ifndef SHADER_VM_H
+#define SHADER_VM_H
+
+#include "bytecode.h"
+
+#define VM_CALL_DEPTH 64
+
+// Invocations run side by side by vm_run_packet
+#define VM_PACKET_W 8
+
+// One register across a whole packet. Compiles to SSE or AVX2 on x86-64,
+// NEON on ARM and plain scalar code anywhere else.
+typedef float VmLane __attribute__((vector_size(sizeof(float) * VM_PACKET_W), may_alias));
+typedef int VmLaneInt __attribute__((vector_size(sizeof(int) * VM_PACKET_W)));
+
+struct Jit;
+
+// Long-lived state of one shader stage, reused across invocations
+struct Frame
+{
+    struct Program *prog;
+
+    // Lanes are interleaved per slot: slots[slot * width + lane]
+    float *slots;
+    size_t width;
+
+    // Native code for this frame's width, 0 to interpret
+    struct Jit *jit;
+    ModuleFn native;
+};
+
+#define FRAME_AT(f, slot, lane) ((f)->slots[(slot) * (f)->width + (lane)])
+
+// Slots start out as the program's image in every lane. width is 1 for
+// vm_run and VM_PACKET_W for vm_run_packet.
+struct Frame *frame_alloc(struct Program *p, size_t width);
+void frame_free(struct Frame *f);
+
+// Restores only the slots an invocation reads before writing
+void frame_reset(struct Frame *f);
+// Writes the same values to every lane
+void frame_store(struct Frame *f, int slot, const float *values, size_t len);
+
+// Runs code starting at offset against the frame
+void vm_run(struct Frame *f, size_t offset);
+// Same for a packet frame, every lane executes every instruction
+void vm_run_packet(struct Frame *f, size_t offset);
+// Runs the frame's jit or module code if it has any, otherwise interprets
+void vm_exec(struct Frame *f, size_t offset);
+
+#endif